@@ -0,0 +1,183 @@
+#ifndef __WIRE_CAPTURE_HPP__
+#define __WIRE_CAPTURE_HPP__
+
+#include "types.hpp"
+#include "util.hpp"
+#include "nodes.hpp"
+
+#include "stream.nanopb.h"
+#include "pb_encode.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wire {
+    enum class trigger_mode {
+        Manual, // only trigger() fires (i.e from an action)
+        Rising, Falling, Either // crossing of the level
+    };
+
+    /**
+     * Records samples of a variable into a RAM ring buffer at full rate
+     * and freezes a window of pre/post-trigger samples around a trigger.
+     * A finished capture is uploaded in bulk through
+     * uart_interface::upload_capture() once the link has time for it.
+     *
+     * sample() should be called at a fixed rate, every period microseconds.
+     * Holds N samples, so pre + post + 1 must be at most N.
+     *
+     * An action owned by the capture (action.set_owner(&c)) fires the
+     * trigger when called from the host, and returns whether it fired.
+     */
+    template<typename T, size_t N, typename Clock>
+        class capture : public source {
+        public:
+            enum class state { Idle, Armed, Triggered, Ready };
+
+            capture(Clock* c, uint32_t period) :
+                clock_(c), period_(period), state_(state::Idle),
+                mode_(trigger_mode::Manual), level_(), pre_(0), post_(0),
+                rearm_(false), head_(0), filled_(0), prev_(),
+                post_left_(0), trigger_index_(0), count_(0),
+                trigger_time_(0), done_time_(0) {}
+
+            // non-copyable, uploads point into the buffer
+            capture(const capture&) = delete;
+            void operator=(const capture&) = delete;
+
+            constexpr state get_state() const { return state_; }
+            constexpr bool ready() const { return state_ == state::Ready; }
+
+            // rearm: whether to arm again after each upload
+            void configure(trigger_mode m, const T& level,
+                            size_t pre, size_t post, bool rearm=false) {
+                if (post >= N) post = N - 1;
+                if (pre + post + 1 > N) pre = N - post - 1;
+                mode_ = m;
+                level_ = level;
+                pre_ = pre;
+                post_ = post;
+                rearm_ = rearm;
+            }
+
+            void arm() {
+                state_ = state::Armed;
+                filled_ = 0;
+                count_ = 0;
+            }
+            void disarm() {
+                state_ = state::Idle;
+            }
+
+            // fire the trigger on the latest sample,
+            // false if not armed or nothing was sampled yet
+            bool trigger() {
+                if (state_ != state::Armed || filled_ == 0) return false;
+                state_ = state::Triggered;
+                trigger_time_ = clock_->millis();
+                trigger_index_ = filled_ - 1 < pre_ ? filled_ - 1 : pre_;
+                post_left_ = post_;
+                if (post_left_ == 0) finish();
+                return true;
+            }
+
+            promise<subscription_ptr> subscribe(variable_base* v,
+                    interval min_interval, interval max_interval, interval timeout) override {
+                return promise<subscription_ptr>(promise_status::Rejected);
+            }
+
+            promise<value> call(action_base* a, value arg, interval timeout) override {
+                value fired{type_class::Bool};
+                fired.set<bool>(trigger());
+                return promise<value>(std::move(fired));
+            }
+
+            void sample(const T& v) {
+                if (state_ == state::Idle || state_ == state::Ready) return;
+                buf_[head_] = v;
+                head_ = (head_ + 1) % N;
+                if (filled_ < N) filled_++;
+
+                if (state_ == state::Armed) {
+                    if (filled_ > 1 && crossed(prev_, v)) trigger();
+                } else if (state_ == state::Triggered) {
+                    if (--post_left_ == 0) finish();
+                }
+                prev_ = v;
+            }
+
+            // to be called once the capture has been written out
+            void uploaded() {
+                if (rearm_) arm();
+                else state_ = state::Idle;
+            }
+
+            void pack(telegraph_stream_Capture* c) const {
+                uint32_t now = clock_->millis();
+                c->trigger_index = trigger_index_;
+                c->age = now - done_time_; // wraps like the clock
+                c->has_samples = true;
+                telegraph_Block& b = c->samples;
+                b.type = to_proto_type_class(get_type_class<T>());
+                // device clock, rebased by the host
+                b.start = (uint64_t) trigger_time_ * 1000 - (uint64_t) trigger_index_ * period_;
+                b.period = period_;
+                b.count = count_;
+                b.data.arg = (void*) this;
+                b.data.funcs.encode =
+                    [](pb_ostream_t* stream, const pb_field_iter_t* field, void* const* arg) {
+                        const capture* cap = (const capture*) *arg;
+                        if (!pb_encode_tag_for_field(stream, field))
+                            return false;
+                        // the window may wrap around the end of the ring
+                        size_t first = (cap->head_ + N - cap->count_) % N;
+                        size_t n1 = first + cap->count_ > N ? N - first : cap->count_;
+                        size_t n2 = cap->count_ - n1;
+                        if (!pb_encode_varint(stream, cap->count_ * sizeof(T)))
+                            return false;
+                        if (!pb_write(stream, (const uint8_t*) &cap->buf_[first], n1 * sizeof(T)))
+                            return false;
+                        return pb_write(stream, (const uint8_t*) &cap->buf_[0], n2 * sizeof(T));
+                    };
+            }
+        private:
+            bool crossed(const T& a, const T& b) const {
+                switch (mode_) {
+                case trigger_mode::Rising: return a < level_ && !(b < level_);
+                case trigger_mode::Falling: return !(a < level_) && b < level_;
+                case trigger_mode::Either: return (a < level_) != (b < level_);
+                default: return false;
+                }
+            }
+
+            void finish() {
+                count_ = trigger_index_ + 1 + post_;
+                done_time_ = clock_->millis();
+                state_ = state::Ready;
+            }
+
+            Clock* clock_;
+            const uint32_t period_; // in microseconds
+            state state_;
+
+            trigger_mode mode_;
+            T level_;
+            size_t pre_;
+            size_t post_;
+            bool rearm_;
+
+            T buf_[N];
+            size_t head_; // next slot to write
+            size_t filled_;
+            T prev_;
+
+            size_t post_left_;
+            size_t trigger_index_; // within the captured window
+            size_t count_; // samples in the captured window
+
+            uint32_t trigger_time_; // clock millis
+            uint32_t done_time_;
+        };
+}
+
+#endif
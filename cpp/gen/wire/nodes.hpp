@@ -204,6 +204,7 @@ namespace wire {
     public:
         inline subscription(interval min_time, interval max_time) : 
                 min_interval_(min_time), max_interval_(max_time), 
+                deadband_(0), relative_(false),
                 cb_(), cancel_cb_() {}
         // subscription is cancelled on destructor
         virtual inline ~subscription() {}
@@ -216,6 +217,15 @@ namespace wire {
         constexpr interval get_min_interval() const { return min_interval_; }
         constexpr interval get_max_interval() const { return max_interval_; }
 
+        // updates within the deadband of the last sent value are dropped,
+        // relative makes it a fraction of that value. zero disables it
+        void set_deadband(float deadband, bool relative) {
+            deadband_ = deadband;
+            relative_ = relative;
+        }
+        constexpr float get_deadband() const { return deadband_; }
+        constexpr bool is_relative() const { return relative_; }
+
         // set the handler
         void handler(const stdext::inplace_function<void(const value&), 16>& cb) {
             cb_ = cb;
@@ -226,6 +236,8 @@ namespace wire {
     protected:
         interval min_interval_;
         interval max_interval_;
+        float deadband_;
+        bool relative_;
         stdext::inplace_function<void(const value& val), 16> cb_;
         // note: may be invoked even after 
         // subscription object has been deleted if
@@ -4,6 +4,8 @@
 #include "nodes.hpp"
 #include "source.hpp"
 
+#include <type_traits>
+
 namespace wire {
     class publisher_base : public source, public coroutine {
     };
@@ -16,6 +18,9 @@ namespace wire {
             public:
                 // the last time a value was sent out
                 uint32_t last_time_;
+                // the last value sent out, for the deadband
+                T last_sent_;
+                bool sent_;
                 // the two alarms
                 uint32_t delay_alarm_;
                 uint32_t resend_alarm_;
@@ -23,7 +28,8 @@ namespace wire {
 
                 sub_impl(publisher<T,Clock>* pub, int32_t min_interval, int32_t max_interval) : 
                     subscription(min_interval, max_interval),
-                    last_time_(0), delay_alarm_(std::numeric_limits<uint32_t>::max()), 
+                    last_time_(0), last_sent_(), sent_(false),
+                    delay_alarm_(std::numeric_limits<uint32_t>::max()), 
                                    resend_alarm_(std::numeric_limits<uint32_t>::max()),
                     pub_(pub) {}
 
@@ -68,7 +74,37 @@ namespace wire {
                     return promise<>(promise_status::Resolved);
                 }
 
+                // whether v is close enough to the last
+                // sent value to not be worth sending
+                bool within_deadband(const T& v) const {
+                    if constexpr (std::is_arithmetic<T>::value) {
+                        if (deadband_ <= 0 || !sent_) return false;
+                        float d = (float) v - (float) last_sent_;
+                        if (d < 0) d = -d;
+                        float limit = deadband_;
+                        if (relative_) {
+                            float l = (float) last_sent_;
+                            limit *= l < 0 ? -l : l;
+                        }
+                        return d <= limit;
+                    } else {
+                        return false;
+                    }
+                }
+
+                void send(const T& v) {
+                    last_sent_ = v;
+                    sent_ = true;
+                    value val(get_type_class<T>());
+                    val.set<T>(v);
+                    cb_(val);
+                }
+
                 void push(const T& v, int32_t now_time) {
+                    // suppress at the source, the resend
+                    // alarm still goes off as a heartbeat
+                    if (within_deadband(v)) return;
+
                     // deal (messily) with timestamp wraparound
                     // should happen around 1/mo but let's make sure
                     // all alarms don't stop working just in case
@@ -78,10 +114,7 @@ namespace wire {
                         // we are larger than min_interval 
                         // since last update
                         last_time_ = now_time;
-
-                        value val(get_type_class<T>());
-                        val.set<T>(v);
-                        cb_(val);
+                        send(v);
                     } else {
                         // set an alarm
                         delay_alarm_ = last_time_ + min_interval_;
@@ -95,9 +128,7 @@ namespace wire {
                 }
 
                 void push_delayed(const T& v, uint32_t now_time) {
-                    value val(get_type_class<T>());
-                    val.set<T>(v);
-                    cb_(val);
+                    send(v);
 
                     last_time_ = delay_alarm_;
                     delay_alarm_ = std::numeric_limits<uint32_t>::max();
@@ -106,9 +137,7 @@ namespace wire {
                 }
 
                 void push_resend(const T& v, int32_t now_time) {
-                    value val(get_type_class<T>());
-                    val.set<T>(v);
-                    cb_(val);
+                    send(v);
 
                     last_time_ = resend_alarm_;
                     resend_alarm_ = max_interval_ == 0 ? std::numeric_limits<uint32_t>::max()
@@ -116,12 +145,12 @@ namespace wire {
                 }
             };
 
-            publisher(Clock* c) : initialized_(false), last_val_(0), 
+            publisher(Clock* c) : initialized_(false), last_val_(), 
                     next_alarm_(std::numeric_limits<uint32_t>::max()),
                     subs_(), clock_(c) {}
 
             publisher(Clock* c, variable<T>* var) : 
-                    initialized_(false), last_val_(0), 
+                    initialized_(false), last_val_(), 
                     next_alarm_(std::numeric_limits<uint32_t>::max()),
                     subs_(), clock_(c) {
                 var->set_owner(this);
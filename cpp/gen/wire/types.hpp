@@ -18,7 +18,37 @@ namespace wire {
         Invalid, None, Enum, Bool, 
         Uint8, Uint16, Uint32, Uint64,
         Int8,   Int16,  Int32,  Int64,
-        Float, Double 
+        Float, Double,
+        Block
+    };
+
+    constexpr size_t sample_size(type_class c) {
+        switch (c) {
+        case type_class::Enum: case type_class::Bool:
+        case type_class::Uint8: case type_class::Int8: return 1;
+        case type_class::Uint16: case type_class::Int16: return 2;
+        case type_class::Uint32: case type_class::Int32:
+        case type_class::Float: return 4;
+        case type_class::Uint64: case type_class::Int64:
+        case type_class::Double: return 8;
+        default: return 0;
+        }
+    }
+
+    // a view of evenly spaced samples owned by the firmware.
+    // the samples are encoded straight out of data, which
+    // must stay valid until the value has been written out
+    struct block {
+        type_class type; // sample type
+        uint32_t start; // device clock (microseconds) of the first sample
+        uint32_t period; // microseconds between samples
+        uint16_t count;
+        const void* data;
+
+        constexpr size_t bytes() const { return count * sample_size(type); }
+        constexpr bool operator==(const block& o) const {
+            return data == o.data && count == o.count && start == o.start;
+        }
     };
 
     template<typename T>
@@ -46,6 +76,8 @@ namespace wire {
     constexpr type_class get_type_class<float>() { return type_class::Float; }
     template<>
     constexpr type_class get_type_class<double>() { return type_class::Double; }
+    template<>
+    constexpr type_class get_type_class<block>() { return type_class::Block; }
 
     constexpr telegraph_Type_Class to_proto_type_class(type_class c) {
         switch (c) {
@@ -63,6 +95,7 @@ namespace wire {
         case type_class::Int64: return telegraph_Type_Class_INT64;
         case type_class::Float: return telegraph_Type_Class_FLOAT;
         case type_class::Double: return telegraph_Type_Class_DOUBLE;
+        case type_class::Block: return telegraph_Type_Class_BLOCK;
         default: return telegraph_Type_Class_INVALID;
         }
     }
@@ -74,17 +107,20 @@ namespace wire {
             using value_type = T;
 
             constexpr type_info(const char* nm, 
-                    size_t nl, const char* const *l) : 
-                class_(get_type_class<T>()),
+                    size_t nl, const char* const *l,
+                    type_class element = type_class::Invalid) : 
+                class_(get_type_class<T>()), element_(element),
                 name(nm), num_labels(nl), labels(l) {}
 
             type_class class_;
+            type_class element_; // sample type of a block
             const char* name;
             uint8_t num_labels;
             const char* const *labels; // array of strings
 
             void pack(telegraph_Type* type) const {
                 type->type = to_proto_type_class(class_);
+                type->element = to_proto_type_class(element_);
                 type->name.arg = (void*) name;
                 type->name.funcs.encode = util::proto_string_encoder;
                 type->labels.arg = (void*) this;
@@ -129,4 +165,22 @@ constexpr wire::type_info<int64_t> int64_type =
 
 constexpr wire::type_info<float> float_type = wire::type_info<float>("", 0, {});
 constexpr wire::type_info<double> double_type = wire::type_info<double>("", 0, {});
+
+// sample blocks
+constexpr wire::type_info<wire::block> uint8_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Uint8);
+constexpr wire::type_info<wire::block> uint16_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Uint16);
+constexpr wire::type_info<wire::block> uint32_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Uint32);
+constexpr wire::type_info<wire::block> int8_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Int8);
+constexpr wire::type_info<wire::block> int16_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Int16);
+constexpr wire::type_info<wire::block> int32_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Int32);
+constexpr wire::type_info<wire::block> float_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Float);
+constexpr wire::type_info<wire::block> double_block_type =
+            wire::type_info<wire::block>("", 0, {}, wire::type_class::Double);
 #endif
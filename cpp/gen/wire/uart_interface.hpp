@@ -63,6 +63,19 @@ namespace wire {
                 return promise<value>(promise_status::Rejected);
             }
 
+            void notify_call(uint32_t req_id, promise_status s, const value& v) {
+                telegraph_stream_Packet p = telegraph_stream_Packet_init_default;
+                p.req_id = req_id;
+                if (s == promise_status::Resolved) {
+                    p.which_event = telegraph_stream_Packet_call_completed_tag;
+                    v.pack(&p.event.call_completed);
+                } else {
+                    p.which_event = telegraph_stream_Packet_call_failed_tag;
+                    p.event.call_failed = telegraph_Empty_init_default;
+                }
+                write_packet(p);
+            }
+
             void notify_success(uint32_t req_id, bool success) {
                 telegraph_stream_Packet p = telegraph_stream_Packet_init_default;
                 p.req_id = req_id;
@@ -88,6 +101,21 @@ namespace wire {
                 write_packet(p);
             }
 
+            // writes out a finished capture (see capture.hpp) in a single
+            // packet, straight from its ring buffer
+            template<typename Capture>
+                bool upload_capture(node::id var_id, Capture& c) {
+                    if (!c.ready()) return false;
+                    telegraph_stream_Packet p =
+                        telegraph_stream_Packet_init_default;
+                    p.req_id = var_id;
+                    p.which_event = telegraph_stream_Packet_capture_tag;
+                    c.pack(&p.event.capture);
+                    write_packet(p);
+                    c.uploaded();
+                    return true;
+                }
+
             // called by receive() when we get an event
             void received_packet(const telegraph_stream_Packet& packet) {
                 last_time_ = clock_->millis();
@@ -124,6 +152,8 @@ namespace wire {
                     interval min_int = (interval) packet.event.change_sub.debounce;
                     interval max_int = (interval) packet.event.change_sub.refresh;
                     interval timeout = (interval) packet.event.change_sub.sub_timeout;
+                    float band = packet.event.change_sub.deadband;
+                    bool relative = packet.event.change_sub.relative;
 
                     // the callback for when the operation is complete
                     // NOTE: since we are capturing two variables, requires malloc?
@@ -132,6 +162,7 @@ namespace wire {
 
                     if (subs_.find(var_id) != subs_.end()) {
                         auto& s = subs_.at(var_id);
+                        s->set_deadband(band, relative);
                         auto p = s->change(min_int, max_int, timeout);
                         // on change completion
                         p.then([this, req_id] (promise_status s) {
@@ -141,8 +172,10 @@ namespace wire {
                         if (v) {
                             auto p = v->subscribe(min_int, max_int, timeout);
                             // on subscribe completion
-                            p.then([this, req_id, var_id] (promise_status s, subscription_ptr&& sub) {
+                            p.then([this, req_id, var_id, band, relative]
+                                        (promise_status s, subscription_ptr&& sub) {
                                 if (s == promise_status::Resolved) {
+                                    sub->set_deadband(band, relative);
                                     // put the subscribe in the subs map
                                     // set the handler to push updates
                                     sub->handler([this, var_id] (const value& v) {
@@ -172,6 +205,20 @@ namespace wire {
                         subs_.erase(var_id);
                     }
                 } break;
+                case telegraph_stream_Packet_call_action_tag: {
+                    const telegraph_stream_Call& c = packet.event.call_action;
+                    if (c.action_id >= table_size_ || !lookup_table_[c.action_id] ||
+                            c.call_timeout > std::numeric_limits<interval>::max()) {
+                        notify_call(req_id, promise_status::Rejected, value{});
+                        return;
+                    }
+                    action_base* a = (action_base*) lookup_table_[c.action_id];
+                    value arg = c.has_arg ? value::unpack(c.arg) : value{type_class::None};
+                    auto p = a->call(a, arg, (interval) c.call_timeout);
+                    p.then([this, req_id] (promise_status s, value&& v) {
+                        notify_call(req_id, s, v);
+                    });
+                } break;
                 case telegraph_stream_Packet_ping_tag: {
                     telegraph_stream_Packet p = telegraph_stream_Packet_init_default;
                     p.which_event = telegraph_stream_Packet_pong_tag;
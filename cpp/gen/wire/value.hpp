@@ -21,6 +21,7 @@ namespace wire {
             int64_t int64;
             float f;
             double d;
+            block blk;
         }; 
 
         constexpr value() : type_(type_class::Invalid), value_() {}
@@ -97,7 +98,59 @@ namespace wire {
                 val->which_type = telegraph_Value_d_tag;
                 val->type.d = value_.d;
             } break;
+            case type_class::Block: {
+                const block& b = value_.blk;
+                val->which_type = telegraph_Value_block_tag;
+                val->type.block.type = to_proto_type_class(b.type);
+                val->type.block.start = b.start;
+                val->type.block.period = b.period;
+                val->type.block.count = b.count;
+                // samples are written straight from the firmware buffer
+                val->type.block.data.arg = (void*) &value_.blk;
+                val->type.block.data.funcs.encode =
+                    [](pb_ostream_t* stream, const pb_field_iter_t* field, void* const* arg) {
+                        const block* b = (const block*) *arg;
+                        if (!pb_encode_tag_for_field(stream, field))
+                            return false;
+                        return pb_encode_string(stream, (const uint8_t*) b->data, b->bytes());
+                    };
+            } break;
+            default: break;
+            }
+        }
+
+        // blocks can't be received, their samples aren't decoded
+        static value unpack(const telegraph_Value& val) {
+            value v;
+            switch (val.which_type) {
+            case telegraph_Value_none_tag: v.type_ = type_class::None; break;
+            case telegraph_Value_en_tag: v.type_ = type_class::Enum;
+                                         v.value_.uint8 = (uint8_t) val.type.en; break;
+            case telegraph_Value_b_tag: v.type_ = type_class::Bool;
+                                        v.value_.b = val.type.b; break;
+            case telegraph_Value_u8_tag: v.type_ = type_class::Uint8;
+                                         v.value_.uint8 = (uint8_t) val.type.u8; break;
+            case telegraph_Value_u16_tag: v.type_ = type_class::Uint16;
+                                          v.value_.uint16 = (uint16_t) val.type.u16; break;
+            case telegraph_Value_u32_tag: v.type_ = type_class::Uint32;
+                                          v.value_.uint32 = val.type.u32; break;
+            case telegraph_Value_u64_tag: v.type_ = type_class::Uint64;
+                                          v.value_.uint64 = val.type.u64; break;
+            case telegraph_Value_i8_tag: v.type_ = type_class::Int8;
+                                         v.value_.int8 = (int8_t) val.type.i8; break;
+            case telegraph_Value_i16_tag: v.type_ = type_class::Int16;
+                                          v.value_.int16 = (int16_t) val.type.i16; break;
+            case telegraph_Value_i32_tag: v.type_ = type_class::Int32;
+                                          v.value_.int32 = val.type.i32; break;
+            case telegraph_Value_i64_tag: v.type_ = type_class::Int64;
+                                          v.value_.int64 = val.type.i64; break;
+            case telegraph_Value_f_tag: v.type_ = type_class::Float;
+                                        v.value_.f = val.type.f; break;
+            case telegraph_Value_d_tag: v.type_ = type_class::Double;
+                                        v.value_.d = val.type.d; break;
+            default: break;
             }
+            return v;
         }
     private:
         type_class type_;
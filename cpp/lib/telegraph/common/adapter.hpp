@@ -5,8 +5,11 @@
 #include <functional>
 #include <unordered_set>
 #include <memory>
+#include <optional>
 
 #include "data.hpp"
+#include "tap_buffer.hpp"
+#include "timer_wheel.hpp"
 
 #include "../utils/io.hpp"
 #include <boost/asio/error.hpp>
@@ -19,8 +22,24 @@ namespace telegraph {
         virtual ~adapter_base() {}
         // return null on failure
         virtual subscription_ptr subscribe(io::yield_ctx& yield, 
-                float debounce, float refresh, float timeout) = 0;
+                float debounce, float refresh, const deadband& band,
+                float timeout) = 0;
         virtual void update(value v) = 0;
+        // datapoints recorded earlier (i.e a capture), which only go to
+        // the taps. subscribers and last() keep following the live values
+        virtual void backfill(const datapoint_batch& d) = 0;
+        // every update, regardless of the subscription rates. keeps
+        // the provider subscribed at full rate while it exists
+        virtual recording_tap_ptr tap(io::yield_ctx& yield, float timeout) = 0;
+        // the latest value pushed through the adapter
+        virtual std::optional<datapoint> last() const = 0;
+
+        // the merged rates the provider was last
+        // successfully subscribed with
+        virtual bool is_subscribed() const = 0;
+        virtual float get_debounce() const = 0;
+        virtual float get_refresh() const = 0;
+        virtual deadband get_deadband() const = 0;
     };
 
     template<typename PollFunc, typename ChangeFunc, typename CancelFunc>
@@ -34,11 +53,18 @@ namespace telegraph {
             private:
                 wadapter_ptr adapter_;
                 time_point last_update_;
+                // trailing-edge debounce, delivers
+                // the latest value once the window closes
+                timer_wheel::timer debounce_timer_;
+                bool pending_;
+                value pending_value_;
             public:
-                sub(const wadapter_ptr& a, 
+                sub(const timer_wheel_ptr& wheel, const wadapter_ptr& a, 
                    value_type t, float debounce, float refresh) 
                     : subscription(t, debounce, refresh),
-                      adapter_(a), last_update_() {}
+                      adapter_(a), last_update_(),
+                      debounce_timer_(wheel, [this]() { on_debounce(); }),
+                      pending_(false), pending_value_() {}
 
                 // on destruct do immediate cancel
                 ~sub() {
@@ -54,6 +80,7 @@ namespace telegraph {
                     // reset the last update time
                     // so everything goes through
                     last_update_ = time_point();
+                    delivered_.reset();
                     a->poll();
                 }
 
@@ -70,7 +97,44 @@ namespace telegraph {
                     a->change(yield, timeout);
                 }
 
+                void change(io::yield_ctx& yield, float debounce, float refresh,
+                            const deadband& d, float timeout) override {
+                    debounce_ = debounce;
+                    refresh_ = refresh;
+                    if (d != deadband_) {
+                        deadband_ = d;
+                        delivered_.reset();
+                    }
+                    auto a = adapter_.lock();
+                    if (!a) {
+                        cancel();
+                        return;
+                    }
+                    a->change(yield, timeout);
+                }
+
+                void set_deadband(io::yield_ctx& yield, const deadband& d,
+                                    float timeout) override {
+                    deadband_ = d;
+                    delivered_.reset();
+                    auto a = adapter_.lock();
+                    if (!a) {
+                        cancel();
+                        return;
+                    }
+                    a->change(yield, timeout);
+                }
+
+                // deliver a cached value shortly after subscribing,
+                // once the data handlers have been attached
+                void prime(value v) {
+                    pending_value_ = v;
+                    pending_ = true;
+                    debounce_timer_.expires_from_now(std::chrono::milliseconds(0));
+                }
+
                 void cancel(io::yield_ctx& yield, float timeout) override {
+                    debounce_timer_.cancel();
                     if (!cancelled_) {
                         cancelled_ = true;
                         auto a = adapter_.lock();
@@ -84,6 +148,7 @@ namespace telegraph {
                 }
 
                 void cancel() override {
+                    debounce_timer_.cancel();
                     if (!cancelled_) {
                         cancelled_ = true;
                         auto a = adapter_.lock();
@@ -95,72 +160,146 @@ namespace telegraph {
                 }
             private:
                 void update(time_point tp, value v) {
+                    // back within the dead-band, anything
+                    // still held back is stale as well
+                    if (within_deadband(v)) {
+                        pending_ = false;
+                        debounce_timer_.cancel();
+                        return;
+                    }
                     // check if enough time has expired to send another update
                     // for this sub or if last_update_ is at epoch (for poll())
                     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(tp - last_update_);
-                    if (duration.count() > refresh_*1000 ||
+                    if (duration.count() >= debounce_*1000 ||
                             last_update_.time_since_epoch().count() == 0) {
                         last_update_ = tp;
+                        pending_ = false;
+                        debounce_timer_.cancel();
+                        delivered(v);
                         data(v);
+                    } else {
+                        // hold on to the latest value until
+                        // the debounce window closes
+                        pending_value_ = v;
+                        if (!pending_) {
+                            pending_ = true;
+                            debounce_timer_.expires_from_now(
+                                std::chrono::milliseconds((int) (debounce_*1000)) - duration);
+                        }
                     }
                 }
+
+                void on_debounce() {
+                    if (!pending_) return;
+                    pending_ = false;
+                    last_update_ = std::chrono::system_clock::now();
+                    delivered(pending_value_);
+                    data(pending_value_);
+                }
             };
 
 
             io::io_context& ioc_;
+            timer_wheel_ptr wheel_;
             value_type type_; // type of the variable
 
             // current values
             bool subscribed_;
             float debounce_;
             float refresh_;
+            deadband deadband_;
 
             // if an op is running
             bool running_op_;
             std::deque<io::deadline_timer*> waiting_ops_;
             std::unordered_set<sub*> subs_;
+            std::vector<std::weak_ptr<tap_buffer>> taps_;
+            // last-value cache, handed to new subscribers
+            std::optional<datapoint> last_;
 
             PollFunc poll_;
             ChangeFunc change_;
             CancelFunc cancel_;
         public:
-            adapter(io::io_context& ioc, value_type t, 
+            adapter(io::io_context& ioc, const timer_wheel_ptr& wheel, value_type t, 
                     PollFunc poll, ChangeFunc change, CancelFunc cancel) :
-                    ioc_(ioc), type_(t), subscribed_(false),
-                    debounce_(0), refresh_(0), 
-                    running_op_(false), waiting_ops_(), subs_(),
+                    ioc_(ioc), wheel_(wheel), type_(t), subscribed_(false),
+                    debounce_(0), refresh_(0), deadband_(),
+                    running_op_(false), waiting_ops_(), subs_(), taps_(), last_(),
                     poll_(poll), change_(change), cancel_(cancel) {}
 
             // will push out an update...
             void update(value v) override {
                 // push out values...
                 auto tp = std::chrono::system_clock::now();
+                last_.emplace(tp, v);
+                if (!taps_.empty()) feed_taps(taps_, tp, v);
                 for (sub* s : subs_) s->update(tp, v);
             }
 
+            void backfill(const datapoint_batch& d) override {
+                if (!taps_.empty()) feed_taps(taps_, d);
+            }
+
+            recording_tap_ptr tap(io::yield_ctx& yield, float timeout) override {
+                // a full rate subscription without any handlers,
+                // the existing subscribers still get their own rates
+                auto keepalive = subscribe(yield, 0, subscription::DISABLED,
+                                            deadband{}, timeout);
+                if (!keepalive) return nullptr;
+                auto t = std::make_shared<tap_buffer>(wheel_, type_.get_class(),
+                                                        std::move(keepalive));
+                taps_.push_back(t);
+                return t;
+            }
+
+            std::optional<datapoint> last() const override { return last_; }
+
+            bool is_subscribed() const override { return subscribed_; }
+            float get_debounce() const override { return debounce_; }
+            float get_refresh() const override { return refresh_; }
+            deadband get_deadband() const override { return deadband_; }
+
             // will block until the change subscribe
             // request goes through
             subscription_ptr subscribe(io::yield_ctx& yield, 
                     float min_interval, float max_interval, 
-                    float timeout) override {
+                    const deadband& band, float timeout) override {
                 // calculate new min_interval_
                 auto wp = std::enable_shared_from_this<
                             adapter<PollFunc, ChangeFunc, CancelFunc>>::
                                 weak_from_this();
-                sub* s = new sub(wp,
+                sub* s = new sub(wheel_, wp,
                     type_, min_interval, max_interval);
+                // in place before the change, so it goes out with the rates
+                s->deadband_ = band;
                 subs_.insert(s);
                 if (!change(yield, timeout)) {
                     // create a new subscription object
                     subs_.erase(s);
                     return nullptr;
                 }
+                if (last_) s->prime(last_->get_value());
                 return std::unique_ptr<subscription>(s);
             }
         private:
             void poll() {
                 poll_();
             }
+            // the provider may only drop what every sub would drop,
+            // so the narrowest band if they all agree on the kind
+            deadband merged_deadband() const {
+                deadband d;
+                bool first = true;
+                for (sub* s : subs_) {
+                    const deadband& b = s->get_deadband();
+                    if (!b.enabled() || (!first && b.relative != d.relative))
+                        return deadband{};
+                    if (first || b.threshold < d.threshold) d = b;
+                    first = false;
+                }
+                return d;
+            }
             bool change(io::yield_ctx& yield, float timeout) {
                 float new_db = std::numeric_limits<float>::infinity();
                 float new_rf = std::numeric_limits<float>::infinity();
@@ -169,9 +308,10 @@ namespace telegraph {
                     new_db = std::min(new_db, s->get_debounce());
                     new_rf = std::min(new_rf, s->get_refresh());
                 }
+                deadband new_band = merged_deadband();
                 // if we don't need a new subscription
                 if (subscribed_ && new_db == debounce_ && 
-                        new_rf == refresh_) {
+                        new_rf == refresh_ && new_band == deadband_) {
                     return true;
                 }
                 // queue a request
@@ -194,7 +334,13 @@ namespace telegraph {
                 }
                 running_op_ = true;
 
-                bool s = change_(yield, new_db, new_rf, timeout);
+                bool s = change_(yield, new_db, new_rf, new_band, timeout);
+                if (s) {
+                    subscribed_ = true;
+                    debounce_ = new_db;
+                    refresh_ = new_rf;
+                    deadband_ = new_band;
+                }
 
                 running_op_ = false;
                 // notify next person
@@ -235,13 +381,23 @@ namespace telegraph {
                         new_db = std::min(new_db, s->get_debounce());
                         new_rf = std::min(new_rf, s->get_refresh());
                     }
+                    deadband new_band = merged_deadband();
                     // if we don't need a new subscription
                     if (!subscribed_ || new_db != debounce_ ||
-                            new_rf != refresh_) {
-                        success = change_(yield, new_db, new_rf, timeout);
+                            new_rf != refresh_ || new_band != deadband_) {
+                        success = change_(yield, new_db, new_rf, new_band, timeout);
+                        if (success) {
+                            subscribed_ = true;
+                            debounce_ = new_db;
+                            refresh_ = new_rf;
+                            deadband_ = new_band;
+                        }
                     }
                 } else {
                     success = cancel_(yield, timeout);
+                    // nothing keeps the cache fresh anymore
+                    subscribed_ = false;
+                    last_.reset();
                 }
                 running_op_ = false;
                 // notify next person
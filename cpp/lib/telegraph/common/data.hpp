@@ -6,18 +6,51 @@
 #include "../utils/signal.hpp"
 #include "../utils/io_fwd.hpp"
 
+#include <algorithm>
 #include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <chrono>
+#include <vector>
 
 namespace telegraph {
+    // suppresses updates which stay within a threshold of the
+    // last delivered value, either absolute or as a fraction of it
+    struct deadband {
+        float threshold;
+        bool relative;
+
+        deadband(float t=0, bool r=false) : threshold(t), relative(r) {}
+
+        constexpr bool enabled() const { return threshold > 0; }
+
+        bool suppresses(const value& last, const value& v) const {
+            if (!enabled()) return false;
+            auto a = to_double(last);
+            auto b = to_double(v);
+            if (!a || !b) return false;
+            double d = std::abs(*b - *a);
+            return d <= (relative ? threshold*std::abs(*a) : threshold);
+        }
+
+        bool operator==(const deadband& o) const {
+            return threshold == o.threshold && relative == o.relative;
+        }
+        bool operator!=(const deadband& o) const { return !(*this == o); }
+    };
+
     class subscription {
     public:
         static constexpr float DISABLED = std::numeric_limits<float>::infinity();
 
         subscription(value_type t, float debounce, float refresh) 
             : cancelled_(false), type_(t),
-            debounce_(debounce), refresh_(refresh) {}
+            debounce_(debounce), refresh_(refresh),
+            deadband_(), delivered_() {}
 
         /**
          * On destruction cancel() should be triggered
@@ -27,6 +60,7 @@ namespace telegraph {
         constexpr const value_type& get_type() const { return type_; }
         constexpr float get_debounce() const { return debounce_; }
         constexpr float get_refresh() const { return refresh_; }
+        constexpr const deadband& get_deadband() const { return deadband_; }
 
         /**
          * Whether this subscription is getting data
@@ -39,16 +73,41 @@ namespace telegraph {
 
         virtual void change(io::yield_ctx&, float debounce, 
                             float refresh, float timeout) = 0;
+        // the rates and the dead-band together, providers which push
+        // both down should override this to make a single request
+        virtual void change(io::yield_ctx& yield, float debounce, float refresh,
+                            const deadband& d, float timeout) {
+            if (d != deadband_) set_deadband(yield, d, timeout);
+            change(yield, debounce, refresh, timeout);
+        }
         virtual void cancel(io::yield_ctx& yield, float timeout) = 0;
         virtual void cancel() = 0; // cancel immediately
 
+        // providers which can filter at the source should override
+        // this and push the dead-band down, the default only filters here
+        virtual void set_deadband(io::yield_ctx&, const deadband& d, float timeout) {
+            deadband_ = d;
+            delivered_.reset();
+        }
+
         signal<value> data;
         signal<> cancelled;
     protected:
+        // whether the dead-band holds back an update
+        bool within_deadband(const value& v) const {
+            return delivered_ && deadband_.suppresses(*delivered_, v);
+        }
+        // to be called with every value handed to data
+        void delivered(const value& v) {
+            if (deadband_.enabled()) delivered_ = v;
+        }
+
         bool cancelled_;
         value_type type_;
         float debounce_;
         float refresh_;
+        deadband deadband_;
+        std::optional<value> delivered_;
     };
     using subscription_ptr = std::shared_ptr<subscription>;
 
@@ -62,7 +121,7 @@ namespace telegraph {
     public:
         datapoint(time_point time, value val) : time_(time), val_(val) {}
         constexpr time_point get_time() const { return time_; }
-        constexpr value get_value() const { return val_; }
+        value get_value() const { return val_; }
 
         void pack(Datapoint* dp) {
             auto micro = 
@@ -77,12 +136,279 @@ namespace telegraph {
         }
     };
 
+    // datapoints stored as columns: the timestamps (microseconds since
+    // the epoch) and the values, packed back to back like the samples
+    // of a block while they share a scalar type. anything else (blocks,
+    // mixed types) is kept boxed
+    class datapoint_batch {
+    private:
+        value_type::type_class type_; // Invalid once the types are mixed
+        bool packed_;
+        std::vector<int64_t> times_;
+        std::vector<uint8_t> data_;
+        std::vector<value> boxed_;
+    public:
+        datapoint_batch(value_type::type_class t=value_type::Invalid)
+            : type_(t), packed_(block::sample_size(t) > 0),
+              times_(), data_(), boxed_() {}
+        datapoint_batch(const datapoint& d) : datapoint_batch() {
+            push_back(d);
+        }
+        datapoint_batch(const std::vector<datapoint>& d) : datapoint_batch() {
+            reserve(d.size());
+            for (const datapoint& p : d) push_back(p);
+        }
+
+        // the samples of a block, each stamped with its own time
+        static datapoint_batch from_block(const block& b) {
+            datapoint_batch r{b.get_type_class()};
+            if (!r.packed_) return r;
+            r.times_.reserve(b.size());
+            for (uint32_t i = 0; i < b.size(); i++) {
+                r.times_.push_back((int64_t) (b.get_start() + (uint64_t) b.get_period() * i));
+            }
+            const uint8_t* d = reinterpret_cast<const uint8_t*>(b.data().data());
+            r.data_.assign(d, d + (size_t) b.size() * block::sample_size(r.type_));
+            return r;
+        }
+
+        constexpr value_type::type_class get_type_class() const { return type_; }
+        size_t size() const { return times_.size(); }
+        bool empty() const { return times_.empty(); }
+        // whether the values are in a packed column
+        bool is_packed() const { return packed_; }
+
+        const std::vector<int64_t>& times() const { return times_; }
+        int64_t micros(size_t i) const { return times_[i]; }
+        time_point time(size_t i) const {
+            return time_point{std::chrono::microseconds{times_[i]}};
+        }
+        value value_at(size_t i) const {
+            if (!packed_) return boxed_[i];
+            value::box b;
+            std::memset(&b, 0, sizeof(b));
+            size_t s = block::sample_size(type_);
+            std::memcpy(&b, data_.data() + i*s, s);
+            return value{type_, b};
+        }
+        datapoint operator[](size_t i) const { return datapoint{time(i), value_at(i)}; }
+
+        // the packed values, null unless they are packed as T
+        template<typename T>
+            const T* column() const {
+                if (!packed_ || block::sample_size(type_) != sizeof(T)) return nullptr;
+                return reinterpret_cast<const T*>(data_.data());
+            }
+
+        void reserve(size_t n) {
+            times_.reserve(n);
+            if (packed_) data_.reserve(n*block::sample_size(type_));
+        }
+        void clear() {
+            times_.clear();
+            data_.clear();
+            boxed_.clear();
+        }
+
+        void push_back(int64_t micros, const value& v) {
+            auto t = v.get_type_class();
+            if (empty() && t != type_) {
+                // an empty batch takes the type of its first value
+                type_ = t;
+                packed_ = block::sample_size(t) > 0;
+            }
+            if (t != type_) {
+                box_all();
+                type_ = value_type::Invalid;
+            }
+            times_.push_back(micros);
+            if (packed_) {
+                size_t s = block::sample_size(type_);
+                data_.resize(data_.size() + s);
+                std::memcpy(data_.data() + data_.size() - s, &v.get_box(), s);
+            } else {
+                boxed_.push_back(v);
+            }
+        }
+        void push_back(time_point t, const value& v) {
+            push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                        t.time_since_epoch()).count(), v);
+        }
+        void push_back(const datapoint& d) { push_back(d.get_time(), d.get_value()); }
+
+        void append(const datapoint_batch& o) {
+            if (o.empty()) return;
+            if (empty()) {
+                *this = o;
+                return;
+            }
+            if (packed_ && o.packed_ && type_ == o.type_) {
+                times_.insert(times_.end(), o.times_.begin(), o.times_.end());
+                data_.insert(data_.end(), o.data_.begin(), o.data_.end());
+                return;
+            }
+            for (size_t i = 0; i < o.size(); i++) push_back(o.times_[i], o.value_at(i));
+        }
+
+        // n datapoints starting at from
+        datapoint_batch slice(size_t from, size_t n) const {
+            datapoint_batch r{type_};
+            n = from < size() ? std::min(n, size() - from) : 0;
+            r.packed_ = packed_;
+            r.times_.assign(times_.begin() + from, times_.begin() + from + n);
+            if (packed_) {
+                size_t s = block::sample_size(type_);
+                r.data_.assign(data_.begin() + from*s, data_.begin() + (from + n)*s);
+            } else {
+                r.boxed_.assign(boxed_.begin() + from, boxed_.begin() + from + n);
+            }
+            return r;
+        }
+
+        std::vector<datapoint> to_vector() const {
+            std::vector<datapoint> v;
+            v.reserve(size());
+            for (size_t i = 0; i < size(); i++) v.push_back((*this)[i]);
+            return v;
+        }
+
+        // without timestamps the batch can only be unpacked
+        // given them (see unpack_values)
+        void pack(DatapointBatch* b, bool with_times=true) const {
+            b->set_type(value_type::pack(type_));
+            if (with_times) {
+                auto* ts = b->mutable_timestamps();
+                ts->Reserve((int) times_.size());
+                int64_t last = 0;
+                for (int64_t t : times_) {
+                    ts->AddAlreadyReserved(t - last);
+                    last = t;
+                }
+            }
+            if (packed_) {
+                b->set_data(data_.data(), data_.size());
+            } else {
+                for (value v : boxed_) v.pack(b->add_values());
+            }
+        }
+        static datapoint_batch unpack(const DatapointBatch& b) {
+            std::vector<int64_t> times;
+            times.reserve((size_t) b.timestamps_size());
+            int64_t last = 0;
+            for (int64_t d : b.timestamps()) {
+                last += d;
+                times.push_back(last);
+            }
+            return unpack_values(b, times.data(), times.size());
+        }
+        // a batch packed without timestamps, taking
+        // the given ones (up to n values are read)
+        static datapoint_batch unpack_values(const DatapointBatch& b,
+                                    const int64_t* times, size_t n) {
+            datapoint_batch r{value_type::unpack(b.type())};
+            size_t count = n;
+            if (b.values_size() > 0) {
+                r.packed_ = false;
+                count = std::min(count, (size_t) b.values_size());
+            } else {
+                size_t s = block::sample_size(r.type_);
+                // drop truncated columns rather than reading past the data
+                count = s ? std::min(count, b.data().size() / s) : 0;
+                r.data_.assign(b.data().begin(), b.data().begin() + count*s);
+            }
+            r.times_.assign(times, times + count);
+            if (!r.packed_) {
+                r.boxed_.reserve(count);
+                for (size_t i = 0; i < count; i++) r.boxed_.push_back(value{b.values((int) i)});
+            }
+            return r;
+        }
+    private:
+        void box_all() {
+            if (!packed_) return;
+            boxed_.reserve(size());
+            for (size_t i = 0; i < size(); i++) boxed_.push_back(value_at(i));
+            data_.clear();
+            packed_ = false;
+        }
+    };
+
+    // reads a store in order, a bounded batch at a time
+    class data_cursor {
+    public:
+        virtual ~data_cursor() {}
+        // replaces out with the next (up to) n datapoints, all of one
+        // type. out is left empty once everything stored so far is read
+        virtual void next(size_t n, datapoint_batch& out) = 0;
+    };
+
+    // a cursor over a batch it holds, followed by whatever
+    // is appended to the store while it is being read
+    class batch_cursor : public data_cursor {
+    private:
+        datapoint_batch batch_;
+        size_t pos_;
+        std::deque<datapoint_batch> appended_;
+        signal<const datapoint_batch&>* source_;
+    public:
+        batch_cursor(datapoint_batch&& b, signal<const datapoint_batch&>& appended)
+                : batch_(std::move(b)), pos_(0), appended_(), source_(&appended) {
+            source_->add(this, [this] (const datapoint_batch& d) {
+                if (!d.empty()) appended_.push_back(d);
+            });
+        }
+        ~batch_cursor() { source_->remove(this); }
+
+        batch_cursor(const batch_cursor&) = delete;
+        batch_cursor& operator=(const batch_cursor&) = delete;
+
+        void next(size_t n, datapoint_batch& out) override {
+            if (pos_ >= batch_.size() && !appended_.empty()) {
+                batch_ = std::move(appended_.front());
+                appended_.pop_front();
+                pos_ = 0;
+            }
+            out = batch_.slice(pos_, n);
+            pos_ += out.size();
+        }
+    };
+
     class data_query {
     public:
-        virtual const std::vector<datapoint>& get_current() const = 0;
-        signal<const std::vector<datapoint>&> data;
+        // hands over everything stored so far, oldest first, in one or
+        // more batches. stores which decode on the fly do so batch by batch
+        virtual void scan(const std::function<void(const datapoint_batch&)>& f) const = 0;
+
+        // stores which keep their data encoded should read it lazily,
+        // the default copies everything stored so far and buffers what
+        // is appended after that. the cursor must not outlive the query
+        virtual std::unique_ptr<data_cursor> cursor() const {
+            return std::make_unique<batch_cursor>(get_current(), data);
+        }
+
+        // everything stored so far, in a single batch
+        datapoint_batch get_current() const {
+            datapoint_batch all;
+            scan([&all] (const datapoint_batch& b) { all.append(b); });
+            return all;
+        }
+
+        // mutable, listening doesn't change what is stored
+        mutable signal<const datapoint_batch&> data;
     };
     using data_query_ptr = std::shared_ptr<data_query>;
+
+    // every update of a variable, stamped when it was received and
+    // handed over in batches. unlike a subscription, nothing is
+    // debounced or dropped. the tap stops once it is destroyed
+    class recording_tap {
+    public:
+        virtual ~recording_tap() {}
+        // hands over whatever is still buffered
+        virtual void flush() = 0;
+        signal<const datapoint_batch&> data;
+    };
+    using recording_tap_ptr = std::shared_ptr<recording_tap>;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include "join.hpp"
+
+#include "api.pb.h"
+#include "../utils/errors.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <string>
+
+namespace telegraph {
+    void
+    joined_table::pack(api::JoinChunk* c) const {
+        auto* ts = c->mutable_timestamps();
+        ts->Reserve((int) times.size());
+        int64_t last = 0;
+        for (int64_t t : times) {
+            ts->AddAlreadyReserved(t - last);
+            last = t;
+        }
+        for (const column& col : columns) {
+            api::JoinChunk::Column* cc = c->add_columns();
+            cc->set_first_row((uint32_t) col.first_row);
+            col.values.pack(cc->mutable_values(), false);
+        }
+    }
+
+    joined_table
+    joined_table::unpack(const api::JoinChunk& c) {
+        joined_table t;
+        t.times.reserve((size_t) c.timestamps_size());
+        int64_t last = 0;
+        for (int64_t d : c.timestamps()) {
+            last += d;
+            t.times.push_back(last);
+        }
+        for (const auto& cc : c.columns()) {
+            size_t first = std::min((size_t) cc.first_row(), t.times.size());
+            t.columns.push_back(column{first, datapoint_batch::unpack_values(cc.values(),
+                            t.times.data() + first, t.times.size() - first)});
+        }
+        return t;
+    }
+
+    join_cursor::join_cursor(std::vector<data_query_ptr> queries, const join_options& opts)
+            : cols_(), opts_(opts), started_(false), finished_(false),
+              lo_(0), hi_(0), bounded_(false), next_t_(0), last_row_(0),
+              any_rows_(false), rows_(0), seen_max_(std::numeric_limits<int64_t>::min()) {
+        opts_.chunk_rows = std::max<size_t>(opts_.chunk_rows, 1);
+        cols_.reserve(queries.size());
+        for (auto& q : queries) {
+            column c;
+            c.cursor = q->cursor();
+            c.query = std::move(q);
+            cols_.push_back(std::move(c));
+        }
+    }
+
+    bool
+    join_cursor::peek(column& c) {
+        while (c.pos >= c.buf.size()) {
+            if (c.done) return false;
+            c.cursor->next(read_size, c.buf);
+            c.pos = 0;
+            // the rest is left for later queries
+            if (c.buf.empty()) c.done = true;
+        }
+        return true;
+    }
+
+    void
+    join_cursor::advance(column& c, int64_t t) {
+        while (peek(c) && c.buf.micros(c.pos) <= t) {
+            int64_t pt = c.buf.micros(c.pos);
+            // one going back in time doesn't replace a later one
+            if (!c.started || pt >= c.last_time) {
+                c.last = c.buf.value_at(c.pos);
+                c.last_time = pt;
+                c.started = true;
+            }
+            seen_max_ = std::max(seen_max_, pt);
+            c.pos++;
+        }
+    }
+
+    void
+    join_cursor::row(joined_table& table, int64_t t) {
+        size_t r = table.times.size();
+        table.times.push_back(t);
+        for (size_t i = 0; i < cols_.size(); i++) {
+            column& c = cols_[i];
+            auto& col = table.columns[i];
+            if (!c.started) {
+                // not started yet
+                col.first_row = r + 1;
+                continue;
+            }
+            value v = c.last;
+            if (opts_.interpolate) {
+                // every number becomes a double, not just the interpolated
+                // ones, so the column keeps a single type
+                auto a = to_double(v);
+                if (a) {
+                    std::optional<double> b;
+                    if (c.last_time != t && peek(c)) b = to_double(c.buf.value_at(c.pos));
+                    if (b) {
+                        int64_t next = c.buf.micros(c.pos);
+                        double f = (double) (t - c.last_time) / (double) (next - c.last_time);
+                        v = value{*a + (*b - *a)*f};
+                    } else {
+                        v = value{*a};
+                    }
+                }
+            }
+            col.values.push_back(t, v);
+        }
+        rows_++;
+    }
+
+    void
+    join_cursor::start() {
+        started_ = true;
+        bool any = false;
+        int64_t first = std::numeric_limits<int64_t>::max();
+        for (auto& c : cols_) {
+            if (!peek(c)) continue;
+            any = true;
+            first = std::min(first, c.buf.micros(c.pos));
+        }
+        if ((!opts_.start || !opts_.end) && !any) {
+            finished_ = true; // no data at all
+            return;
+        }
+        bounded_ = opts_.end != 0;
+        hi_ = opts_.end;
+        if (opts_.step > 0) {
+            lo_ = opts_.start ? opts_.start : first;
+            if (bounded_) {
+                if (lo_ > hi_) {
+                    finished_ = true;
+                    return;
+                }
+                // unsigned, the range may not fit in an int64
+                uint64_t span = (uint64_t) hi_ - (uint64_t) lo_;
+                if (span / (uint64_t) opts_.step >= opts_.max_rows) {
+                    throw parse_error("join would have more than " +
+                                        std::to_string(opts_.max_rows) + " rows");
+                }
+            }
+            next_t_ = lo_;
+        } else if (opts_.start) {
+            lo_ = opts_.start;
+            if (bounded_ && lo_ > hi_) {
+                finished_ = true;
+                return;
+            }
+            // what comes before still counts for the first row
+            for (auto& c : cols_) advance(c, lo_ - 1);
+        }
+    }
+
+    bool
+    join_cursor::next(joined_table& table) {
+        if (!started_) start();
+        table.times.clear();
+        table.columns.assign(cols_.size(), joined_table::column{0, datapoint_batch{}});
+        table.times.reserve(opts_.chunk_rows);
+        for (auto& col : table.columns) col.values.reserve(opts_.chunk_rows);
+
+        while (!finished_ && table.rows() < opts_.chunk_rows) {
+            if (opts_.step > 0) {
+                int64_t t = next_t_;
+                for (auto& c : cols_) advance(c, t);
+                if (!bounded_) {
+                    // up to the last datapoint, so while any is at or after t
+                    bool more = seen_max_ >= t;
+                    for (auto& c : cols_) more = more || peek(c);
+                    if (!more) {
+                        finished_ = true;
+                        break;
+                    }
+                    if (rows_ >= opts_.max_rows) {
+                        throw parse_error("join would have more than " +
+                                            std::to_string(opts_.max_rows) + " rows");
+                    }
+                }
+                row(table, t);
+                // stop before t + step passes the end, or overflows
+                uint64_t end = (uint64_t) (bounded_ ? hi_ : std::numeric_limits<int64_t>::max());
+                if (end - (uint64_t) t < (uint64_t) opts_.step) finished_ = true;
+                else next_t_ = t + opts_.step;
+            } else {
+                // a row at the earliest unread timestamp
+                bool any = false;
+                int64_t t = std::numeric_limits<int64_t>::max();
+                for (auto& c : cols_) {
+                    if (!peek(c)) continue;
+                    any = true;
+                    t = std::min(t, c.buf.micros(c.pos));
+                }
+                if (!any || (bounded_ && t > hi_)) {
+                    finished_ = true;
+                    break;
+                }
+                if (any_rows_ && t <= last_row_) {
+                    // out of order, already covered by the rows so far
+                    for (auto& c : cols_) advance(c, last_row_);
+                    continue;
+                }
+                for (auto& c : cols_) advance(c, t);
+                row(table, t);
+                any_rows_ = true;
+                last_row_ = t;
+            }
+        }
+        return table.rows() > 0;
+    }
+}
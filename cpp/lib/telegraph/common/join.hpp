@@ -0,0 +1,103 @@
+#ifndef __TELEGRAPH_JOIN_HPP__
+#define __TELEGRAPH_JOIN_HPP__
+
+#include "data.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace telegraph {
+    namespace api {
+        class JoinChunk;
+    }
+
+    struct join_options {
+        // the range of rows in microseconds since the
+        // epoch, 0 for the first/last datapoint
+        int64_t start = 0;
+        int64_t end = 0;
+        // a row every step microseconds, 0 for a row
+        // at every distinct timestamp of any variable
+        int64_t step = 0;
+        // linear between the datapoints around a row, instead of the
+        // latest one at or before it. numbers all come out as doubles,
+        // variables which are not numbers always take the latest one
+        bool interpolate = false;
+        // rows per chunk
+        size_t chunk_rows = 4096;
+        // a stepped join spanning more rows than this is refused
+        uint64_t max_rows = 1ull << 24;
+    };
+
+    // rows of several variables at common timestamps. a column has no
+    // value in the rows before its first_row, otherwise one per row
+    class joined_table {
+    public:
+        struct column {
+            size_t first_row;
+            datapoint_batch values; // stamped with the row times
+        };
+        std::vector<int64_t> times;
+        std::vector<column> columns;
+
+        size_t rows() const { return times.size(); }
+
+        void pack(api::JoinChunk* c) const;
+        static joined_table unpack(const api::JoinChunk& c);
+    };
+
+    using join_handler = std::function<void(const joined_table&)>;
+
+    // an as-of join of several stores, one per column, merged in time
+    // order a chunk at a time. the columns are read through their cursors,
+    // so only about a batch of each is held. datapoints are taken to be in
+    // time order, as stores keep them, one going back in time doesn't
+    // replace a later one
+    class join_cursor {
+    public:
+        // datapoints read from a column at once
+        static constexpr size_t read_size = 4096;
+
+        join_cursor(std::vector<data_query_ptr> queries, const join_options& opts);
+
+        // replaces out with the next (up to) chunk_rows rows, false once all
+        // rows are out. throws if a join would exceed max_rows
+        bool next(joined_table& out);
+    private:
+        struct column {
+            data_query_ptr query; // outlives the cursor
+            std::unique_ptr<data_cursor> cursor;
+            datapoint_batch buf;
+            size_t pos = 0; // the next unread datapoint in buf
+            bool done = false;
+            // the latest datapoint at or before the current row
+            bool started = false;
+            int64_t last_time = 0;
+            value last;
+        };
+
+        void start();
+        // whether the column has an unread datapoint, reading a batch if needed
+        bool peek(column& c);
+        // reads the datapoints at or before t
+        void advance(column& c, int64_t t);
+        void row(joined_table& table, int64_t t);
+
+        std::vector<column> cols_;
+        join_options opts_;
+        bool started_;
+        bool finished_;
+        int64_t lo_;
+        int64_t hi_;
+        bool bounded_; // an end was given
+        int64_t next_t_; // of a stepped join
+        int64_t last_row_;
+        bool any_rows_;
+        uint64_t rows_;
+        int64_t seen_max_; // the newest datapoint read
+    };
+}
+
+#endif
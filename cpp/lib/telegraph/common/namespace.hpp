@@ -4,6 +4,7 @@
 #include "collection.hpp"
 #include "value.hpp"
 #include "data.hpp"
+#include "join.hpp"
 #include "params.hpp"
 
 #include "../utils/uuid.hpp"
@@ -13,6 +14,8 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace telegraph {
     class namespace_;
@@ -82,18 +85,71 @@ namespace telegraph {
                                 const variable* v,
                                 float min_interval, float max_interval,
                                 float timeout) = 0;
+        // subscribes with a dead-band from the start, providers which
+        // filter at the source should override this to push it down
+        // with the subscription rather than in a second request
+        virtual subscription_ptr  subscribe(io::yield_ctx& ctx,
+                                const std::vector<std::string_view>& variable,
+                                float min_interval, float max_interval,
+                                const deadband& band, float timeout) {
+            auto s = subscribe(ctx, variable, min_interval, max_interval, timeout);
+            if (s && band.enabled()) s->set_deadband(ctx, band, timeout);
+            return s;
+        }
 
         virtual value call(io::yield_ctx& ctx, action* a, value v, float timeout) = 0;
         virtual value call(io::yield_ctx& ctx, const std::vector<std::string_view>& a, 
                                     value v, float timeout) = 0;
 
         virtual bool write_data(io::yield_ctx& yield, variable* v, 
-                                    const std::vector<datapoint>& data) = 0;
+                                    const datapoint_batch& data) = 0;
         virtual bool write_data(io::yield_ctx& yield, const std::vector<std::string_view>& var,
-                                    const std::vector<datapoint>& data) = 0;
+                                    const datapoint_batch& data) = 0;
+
+        virtual data_query_ptr query_data(io::yield_ctx& yield, const variable* v, float timeout) = 0;
+        virtual data_query_ptr query_data(io::yield_ctx& yield, const std::vector<std::string_view>& v, float timeout) = 0;
+
+        // the history of several variables at common timestamps (see
+        // join_options), read a chunk at a time. timeout applies to
+        // querying each variable. null if a variable has no history
+        virtual std::unique_ptr<join_cursor> open_join(io::yield_ctx& yield,
+                    const std::vector<std::vector<std::string_view>>& vars,
+                    const join_options& opts, float timeout) {
+            std::vector<data_query_ptr> queries;
+            queries.reserve(vars.size());
+            for (const auto& v : vars) {
+                auto q = query_data(yield, v, timeout);
+                if (!q) return nullptr;
+                queries.push_back(std::move(q));
+            }
+            return std::make_unique<join_cursor>(std::move(queries), opts);
+        }
 
-        virtual data_query_ptr query_data(io::yield_ctx& yield, const variable* v) = 0;
-        virtual data_query_ptr query_data(io::yield_ctx& yield, const std::vector<std::string_view>& v) = 0;
+        // as open_join, handing over the chunks as they are read. timeout
+        // is the longest wait for the next chunk. false if a variable
+        // has no history
+        virtual bool query_join(io::yield_ctx& yield,
+                    const std::vector<std::vector<std::string_view>>& vars,
+                    const join_options& opts, const join_handler& h, float timeout) {
+            auto j = open_join(yield, vars, opts, timeout);
+            if (!j) return false;
+            joined_table t;
+            while (j->next(t)) h(t);
+            return true;
+        }
+
+        // every update of a variable as it is received, bypassing the rate
+        // limiting of subscriptions (for recording). null if not supported
+        virtual recording_tap_ptr tap(io::yield_ctx& yield, const variable* v, float timeout) {
+            return nullptr;
+        }
+
+        // the latest cached value of every variable under the given path,
+        // variables without a cached value are left out
+        virtual std::vector<std::pair<const variable*, datapoint>>
+            snapshot(io::yield_ctx& yield, const std::vector<std::string_view>& path) {
+            return {};
+        }
 
         virtual void destroy(io::yield_ctx& yield) = 0;
         signal<io::yield_ctx&> destroyed;
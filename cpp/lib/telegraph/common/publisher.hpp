@@ -2,11 +2,12 @@
 #define __TELEGRAPH_COMMON_PUBLISHER_HPP__
 
 #include <memory>
-#include <unordered_set>
-#include <boost/asio/deadline_timer.hpp>
-#include <boost/asio/error.hpp>
+#include <optional>
+#include <unordered_map>
 
 #include "data.hpp"
+#include "tap_buffer.hpp"
+#include "timer_wheel.hpp"
 
 namespace telegraph {
     class publisher : public std::enable_shared_from_this<publisher> {
@@ -15,50 +16,67 @@ namespace telegraph {
             friend class publisher;
         private:
             std::weak_ptr<publisher> publisher_;
-            io::deadline_timer refresh_timer_;
+            // drives both the trailing-edge debounce
+            // and the refresh of this subscription
+            timer_wheel::timer timer_;
             time_point last_update_;
-            value last_value_;
+            bool sent_; // whether anything has been sent
+            bool pending_; // a debounced value is waiting for the timer
+            value pending_value_;
 
-            void reset_refresh_timer() {
-                refresh_timer_.cancel();
-                if (refresh_ != subscription::DISABLED) {
-                    refresh_timer_.expires_from_now(
-                        boost::posix_time::milliseconds(
-                            std::max(1, (int) (1000*refresh_))));
-                    refresh_timer_.async_wait([this](const boost::system::error_code& ec) {
-                        resend(ec);
-                    });
+            static std::chrono::milliseconds to_millis(float secs) {
+                return std::chrono::milliseconds(std::max(1, (int) (1000*secs)));
+            }
+
+            void reset_timer() {
+                if (pending_) {
+                    auto since = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::system_clock::now() - last_update_);
+                    timer_.expires_from_now(std::max(std::chrono::milliseconds(0),
+                                                to_millis(debounce_) - since));
+                } else if (refresh_ != subscription::DISABLED && sent_) {
+                    timer_.expires_from_now(to_millis(refresh_));
+                } else {
+                    timer_.cancel();
                 }
             }
         public:
-            sub(io::io_context& ioc, const std::weak_ptr<publisher> pub,
+            sub(const timer_wheel_ptr& wheel, const std::weak_ptr<publisher> pub,
                 value_type t, float debounce, float refresh)
                     : subscription(t, debounce, refresh),
                         publisher_(pub),
-                        refresh_timer_(ioc), last_update_(),
-                        last_value_(value::none()) {}
+                        timer_(wheel, [this]() { on_timer(); }),
+                        last_update_(), sent_(false), pending_(false),
+                        pending_value_(value::none()) {}
             ~sub() {
                 cancel();
             }
-            void poll() {
+            void poll() override {
                 auto p = publisher_.lock();
                 if (!p) return;
-                last_value_ = value::invalid();
-                update(std::chrono::system_clock::now(), p->value_);
+                delivered_.reset();
+                send(std::chrono::system_clock::now(), p->value_);
             }
             void change(io::yield_ctx& yield,
                         float debounce, float refresh,
                         float timeout) override {
                 debounce_ = debounce;
                 refresh_ = refresh;
-                reset_refresh_timer();
+                reset_timer();
             }
-            void cancel(io::yield_ctx& yield, 
+            // deliver a cached value shortly after subscribing,
+            // once the data handlers have been attached
+            void prime(value v) {
+                pending_ = true;
+                pending_value_ = v;
+                timer_.expires_from_now(std::chrono::milliseconds(0));
+            }
+            void cancel(io::yield_ctx& yield,
                         float timeout) override {
                 cancel();
             }
             void cancel() override {
-                refresh_timer_.cancel();
+                timer_.cancel();
                 if (!cancelled_) {
                     cancelled_ = true;
                     // remove from publisher
@@ -66,38 +84,64 @@ namespace telegraph {
                     if(p) {
                         p->subs_.erase(this);
                     }
-                    refresh_timer_.cancel();
                 }
             }
         private:
-            void resend(const boost::system::error_code& ec) {
-                if (ec != boost::asio::error::operation_aborted &&
-                        last_value_.is_valid()) {
+            void send(time_point tp, value v) {
+                last_update_ = tp;
+                sent_ = true;
+                pending_ = false;
+                reset_timer();
+                delivered(v);
+                data(v);
+            }
+
+            void on_timer() {
+                if (pending_) {
+                    // trailing edge of the debounce window,
+                    // deliver the latest value
+                    send(std::chrono::system_clock::now(), pending_value_);
+                } else if (sent_) {
                     auto p = publisher_.lock();
-                    if (p) {
-                        data(p->value_);
-                    }
+                    if (p) send(std::chrono::system_clock::now(), p->value_);
                 }
             }
 
             void update(time_point tp, value v) {
+                // back within the dead-band, anything
+                // still held back is stale as well
+                if (within_deadband(v)) {
+                    if (pending_) {
+                        pending_ = false;
+                        reset_timer();
+                    }
+                    return;
+                }
                 auto d = std::chrono::duration_cast<
                     std::chrono::milliseconds>(tp - last_update_);
-                if (d.count() > 1000*debounce_ || !last_value_.is_valid()) {
-                    last_update_ = tp;
-                    last_value_ = v;
-                    reset_refresh_timer();
-                    data(v);
+                if (!sent_ || d.count() >= 1000*debounce_) {
+                    send(tp, v);
+                } else {
+                    pending_value_ = v;
+                    if (!pending_) {
+                        pending_ = true;
+                        reset_timer();
+                    }
                 }
             }
         };
 
         std::unordered_map<sub*, std::weak_ptr<sub>> subs_;
-        io::io_context& ioc_;
+        std::vector<std::weak_ptr<tap_buffer>> taps_;
+        timer_wheel_ptr wheel_;
         value_type type_;
         value value_;
+        time_point updated_; // epoch if nothing was published yet
     public:
-        publisher(io::io_context& ioc, value_type t) : subs_(), ioc_(ioc), type_(t) {}
+        // subscriptions of all publishers sharing a wheel
+        // are driven off of a single timer
+        publisher(const timer_wheel_ptr& wheel, value_type t)
+            : subs_(), taps_(), wheel_(wheel), type_(t), value_(), updated_() {}
         ~publisher() {
             // copy since cancel() will remove from subs_
             std::unordered_map<sub*, std::weak_ptr<sub>> subs = subs_;
@@ -108,15 +152,30 @@ namespace telegraph {
         }
 
         subscription_ptr subscribe(float min_interval, float max_interval) {
-            auto s = std::make_shared<sub>(ioc_, weak_from_this(), 
+            auto s = std::make_shared<sub>(wheel_, weak_from_this(),
                             type_, min_interval, max_interval);
             subs_.emplace(s.get(), s);
+            if (updated_ != time_point()) s->prime(value_);
             return s;
         }
 
+        // every update, regardless of the subscription rates
+        recording_tap_ptr tap() {
+            auto t = std::make_shared<tap_buffer>(wheel_, type_.get_class());
+            taps_.push_back(t);
+            return t;
+        }
+
+        std::optional<datapoint> last() const {
+            if (updated_ == time_point()) return std::nullopt;
+            return datapoint{updated_, value_};
+        }
+
         void update(value v) {
             value_ = v;
             auto tp = std::chrono::system_clock::now();
+            updated_ = tp;
+            if (!taps_.empty()) feed_taps(taps_, tp, v);
             for (auto ws : subs_) {
                 auto s = ws.second.lock();
                 if (s) s->update(tp, v);
@@ -130,4 +189,4 @@ namespace telegraph {
     using publisher_ptr = std::shared_ptr<publisher>;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,195 @@
+#ifndef __TELEGRAPH_COMMON_SHM_RING_HPP__
+#define __TELEGRAPH_COMMON_SHM_RING_HPP__
+
+#include "value.hpp"
+#include "data.hpp"
+#include "../utils/errors.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace telegraph {
+    // fixed-size update record, copied into the ring as is
+    struct shm_record {
+        int32_t handle; // req_id of the subscription
+        uint8_t type; // value_type::type_class
+        uint8_t reserved[3];
+        int64_t timestamp; // microseconds since epoch
+        value::box v;
+
+        value get_value() const {
+            return value{(value_type::type_class) type, v};
+        }
+        time_point get_time() const {
+            return time_point{std::chrono::microseconds{timestamp}};
+        }
+    };
+    static_assert(sizeof(shm_record) == 24, "shm_record layout changed");
+
+    // A single-producer/single-consumer ring of shm_records in
+    // POSIX shared memory. The server creates one per connection
+    // and pushes subscription updates into it, a process on the
+    // same host maps it by name with open() and pops them, so
+    // the data never gets serialized or goes through a socket.
+    class shm_ring {
+    private:
+        static constexpr uint32_t magic = 0x74677273; // "tgrs"
+        static constexpr uint32_t version = 1;
+
+        struct header {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t capacity; // power of two
+            uint32_t record_size;
+            // on separate cache lines so the two
+            // sides don't invalidate each other
+            alignas(64) std::atomic<uint64_t> head; // next record to write
+            alignas(64) std::atomic<uint64_t> tail; // next record to read
+            std::atomic<uint64_t> dropped; // records lost to a full ring
+        };
+
+        std::string name_;
+        bool owner_; // unlinks the name on destruction
+        void* mem_;
+        size_t size_;
+        header* header_;
+        shm_record* records_;
+        uint32_t mask_;
+
+        // the last seen position of the other side,
+        // only reloaded when it looks like we have caught up
+        uint64_t cached_head_;
+        uint64_t cached_tail_;
+
+        shm_ring(const std::string& name, bool owner, void* mem, size_t size)
+            : name_(name), owner_(owner), mem_(mem), size_(size),
+              header_(static_cast<header*>(mem)),
+              records_(reinterpret_cast<shm_record*>(static_cast<char*>(mem) + sizeof(header))),
+              mask_(header_->capacity - 1), cached_head_(0), cached_tail_(0) {}
+
+        static size_t bytes(uint32_t capacity) {
+            return sizeof(header) + (size_t) capacity * sizeof(shm_record);
+        }
+    public:
+        ~shm_ring() {
+            munmap(mem_, size_);
+            if (owner_) shm_unlink(name_.c_str());
+        }
+
+        shm_ring(const shm_ring&) = delete;
+        shm_ring& operator=(const shm_ring&) = delete;
+
+        const std::string& get_name() const { return name_; }
+        uint32_t capacity() const { return header_->capacity; }
+        uint64_t dropped() const { return header_->dropped.load(std::memory_order_relaxed); }
+
+        // capacity is in records and rounded up to a power of two
+        static std::unique_ptr<shm_ring> create(const std::string& name, uint32_t capacity) {
+            uint32_t cap = 1;
+            while (cap < capacity && cap < (1u << 30)) cap <<= 1;
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0) throw io_error("failed to create shared memory " + name);
+            size_t size = bytes(cap);
+            if (ftruncate(fd, (off_t) size) != 0) {
+                close(fd);
+                shm_unlink(name.c_str());
+                throw io_error("failed to size shared memory " + name);
+            }
+            void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mem == MAP_FAILED) {
+                shm_unlink(name.c_str());
+                throw io_error("failed to map shared memory " + name);
+            }
+            header* h = new (mem) header();
+            h->magic = magic;
+            h->version = version;
+            h->capacity = cap;
+            h->record_size = sizeof(shm_record);
+            return std::unique_ptr<shm_ring>(new shm_ring(name, true, mem, size));
+        }
+
+        static std::unique_ptr<shm_ring> open(const std::string& name) {
+            int fd = shm_open(name.c_str(), O_RDWR, 0);
+            if (fd < 0) throw io_error("failed to open shared memory " + name);
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(header)) {
+                close(fd);
+                throw io_error("bad shared memory " + name);
+            }
+            size_t size = (size_t) st.st_size;
+            void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mem == MAP_FAILED) throw io_error("failed to map shared memory " + name);
+            const header* h = static_cast<const header*>(mem);
+            if (h->magic != magic || h->version != version ||
+                    h->record_size != sizeof(shm_record) || size < bytes(h->capacity)) {
+                munmap(mem, size);
+                throw io_error("incompatible shared memory ring " + name);
+            }
+            return std::unique_ptr<shm_ring>(new shm_ring(name, false, mem, size));
+        }
+
+        // producer side, never blocks. false if the ring was full
+        bool push(const shm_record& r) {
+            uint64_t head = header_->head.load(std::memory_order_relaxed);
+            if (head - cached_tail_ > mask_) {
+                cached_tail_ = header_->tail.load(std::memory_order_acquire);
+                if (head - cached_tail_ > mask_) {
+                    header_->dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            records_[head & mask_] = r;
+            header_->head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // blocks don't fit a fixed-size record and are rejected
+        bool push(int32_t handle, time_point t, const value& v) {
+            if (v.get_type_class() == value_type::Block) return false;
+            shm_record r{};
+            r.handle = handle;
+            r.type = (uint8_t) v.get_type_class();
+            r.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                                t.time_since_epoch()).count();
+            r.v = v.get_box();
+            return push(r);
+        }
+
+        // consumer side
+        bool pop(shm_record& r) {
+            uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+            if (tail == cached_head_) {
+                cached_head_ = header_->head.load(std::memory_order_acquire);
+                if (tail == cached_head_) return false;
+            }
+            r = records_[tail & mask_];
+            header_->tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // hands everything currently in the ring to f(const shm_record&),
+        // releasing the slots once at the end. returns the number of records
+        template<typename F>
+            size_t drain(F&& f) {
+                uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+                cached_head_ = header_->head.load(std::memory_order_acquire);
+                for (uint64_t i = tail; i != cached_head_; i++) f(records_[i & mask_]);
+                header_->tail.store(cached_head_, std::memory_order_release);
+                return (size_t) (cached_head_ - tail);
+            }
+    };
+    using shm_ring_ptr = std::unique_ptr<shm_ring>;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __TELEGRAPH_COMMON_TAP_BUFFER_HPP__
+#define __TELEGRAPH_COMMON_TAP_BUFFER_HPP__
+
+#include "data.hpp"
+#include "timer_wheel.hpp"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace telegraph {
+    // the recording_tap of adapters and publishers, which collects the
+    // updates into a batch handed over once it is full or old enough
+    class tap_buffer : public recording_tap {
+    public:
+        static constexpr size_t max_points = 512;
+        static constexpr std::chrono::milliseconds max_delay{50};
+    private:
+        timer_wheel::timer timer_;
+        // keeps the source sending every update, if it needs one
+        subscription_ptr keepalive_;
+        datapoint_batch pending_;
+    public:
+        tap_buffer(const timer_wheel_ptr& wheel, value_type::type_class t,
+                    subscription_ptr&& keepalive = nullptr)
+            : timer_(wheel, [this]() { flush(); }),
+              keepalive_(std::move(keepalive)), pending_(t) {}
+
+        void push(time_point tp, const value& v) {
+            pending_.push_back(tp, v);
+            if (pending_.size() >= max_points) flush();
+            else if (!timer_.is_armed()) timer_.expires_from_now(max_delay);
+        }
+
+        // datapoints from earlier, handed over
+        // right after whatever is still buffered
+        void push(const datapoint_batch& b) {
+            flush();
+            if (!b.empty()) data(b);
+        }
+
+        void flush() override {
+            timer_.cancel();
+            if (pending_.empty()) return;
+            datapoint_batch b{pending_.get_type_class()};
+            std::swap(b, pending_);
+            data(b);
+        }
+    };
+
+    // feeds an update (or a batch of earlier ones) to
+    // every live tap, dropping the destroyed ones
+    template<typename... Args>
+        inline void feed_taps(std::vector<std::weak_ptr<tap_buffer>>& taps,
+                                const Args&... args) {
+            for (auto it = taps.begin(); it != taps.end();) {
+                auto t = it->lock();
+                if (!t) {
+                    it = taps.erase(it);
+                    continue;
+                }
+                t->push(args...);
+                ++it;
+            }
+        }
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef __TELEGRAPH_COMMON_TIMER_WHEEL_HPP__
+#define __TELEGRAPH_COMMON_TIMER_WHEEL_HPP__
+
+#include "../utils/io.hpp"
+
+#include <boost/asio/deadline_timer.hpp>
+
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace telegraph {
+    // A hashed timer wheel which drives many short-lived timers
+    // (subscription debounce/refresh) off a single deadline_timer.
+    // Arming, re-arming and cancelling a timer are O(1) list operations
+    // and never touch the asio timer queue unless the new expiry is
+    // earlier than the next scheduled wakeup.
+    class timer_wheel : public std::enable_shared_from_this<timer_wheel> {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        // intrusive, circular list link
+        struct link {
+            link* prev;
+            link* next;
+            link() : prev(this), next(this) {}
+            bool linked() const { return next != this; }
+            void unlink() {
+                prev->next = next;
+                next->prev = prev;
+                prev = next = this;
+            }
+            void push_back(link* l) {
+                l->prev = prev;
+                l->next = this;
+                prev->next = l;
+                prev = l;
+            }
+        };
+
+        class timer : private link {
+            friend class timer_wheel;
+        private:
+            std::shared_ptr<timer_wheel> wheel_;
+            uint64_t expiry_; // in ticks
+            std::function<void()> cb_;
+        public:
+            timer(const std::shared_ptr<timer_wheel>& w,
+                    const std::function<void()>& cb)
+                : link(), wheel_(w), expiry_(0), cb_(cb) {}
+            ~timer() { cancel(); }
+
+            timer(const timer&) = delete;
+            timer& operator=(const timer&) = delete;
+
+            bool is_armed() const { return linked(); }
+
+            // (re)arms the timer, replacing any previous expiry
+            void expires_from_now(std::chrono::milliseconds d) {
+                wheel_->arm(this, d);
+            }
+            void cancel() {
+                if (linked()) {
+                    unlink();
+                    wheel_->armed_--;
+                }
+            }
+        };
+
+        timer_wheel(io::io_context& ioc,
+                std::chrono::milliseconds tick = std::chrono::milliseconds(1),
+                size_t slots = 1024)
+            : timer_(ioc), tick_(tick), slots_(slots), start_(clock::now()),
+              cursor_(0), wakeup_(0), waiting_(false),
+              advancing_(false), armed_(0) {}
+        // timers keep the wheel alive, so nothing
+        // can still be linked at this point
+        ~timer_wheel() {
+            timer_.cancel();
+        }
+
+        constexpr size_t armed() const { return armed_; }
+    private:
+        io::deadline_timer timer_;
+        const std::chrono::milliseconds tick_;
+        std::vector<link> slots_;
+        const clock::time_point start_;
+
+        uint64_t cursor_; // next tick to be processed
+        uint64_t wakeup_; // tick of the pending wakeup (if waiting_)
+        bool waiting_;
+        bool advancing_; // firing callbacks, wakeup is scheduled afterwards
+        size_t armed_;
+
+        uint64_t now_tick() const {
+            return (uint64_t) ((clock::now() - start_) / tick_);
+        }
+
+        void arm(timer* t, std::chrono::milliseconds d) {
+            if (t->linked()) {
+                t->unlink();
+            } else if (armed_++ == 0) {
+                // the wheel was idle, skip the cursor ahead
+                cursor_ = std::max(cursor_, now_tick());
+            }
+            // round up so we never fire early
+            uint64_t ticks = (uint64_t) ((d + tick_ - std::chrono::milliseconds(1)) / tick_);
+            t->expiry_ = std::max(now_tick() + std::max<uint64_t>(ticks, 1), cursor_);
+            slots_[t->expiry_ % slots_.size()].push_back(t);
+            if (!advancing_ && (!waiting_ || t->expiry_ < wakeup_))
+                schedule(t->expiry_);
+        }
+
+        void schedule(uint64_t tick) {
+            wakeup_ = tick;
+            waiting_ = true;
+            auto at = start_ + tick * tick_;
+            auto wait = std::chrono::duration_cast<std::chrono::microseconds>(at - clock::now());
+            timer_.expires_from_now(boost::posix_time::microseconds(
+                        std::max<int64_t>(0, wait.count())));
+            std::weak_ptr<timer_wheel> wp = weak_from_this();
+            timer_.async_wait([wp, tick] (const boost::system::error_code& ec) {
+                if (ec) return;
+                auto w = wp.lock();
+                // a newer wakeup has replaced this one
+                if (!w || !w->waiting_ || w->wakeup_ != tick) return;
+                w->waiting_ = false;
+                w->advance();
+            });
+        }
+
+        void advance() {
+            uint64_t now = now_tick();
+            if (now < cursor_) {
+                // woke up early
+                schedule(cursor_);
+                return;
+            }
+            // collect everything which expired, unlinking
+            // as we go so callbacks can safely re-arm/cancel
+            link firing;
+            uint64_t end = std::min(now + 1, cursor_ + slots_.size());
+            for (uint64_t t = cursor_; t < end; t++) {
+                link& s = slots_[t % slots_.size()];
+                link* l = s.next;
+                while (l != &s) {
+                    link* next = l->next;
+                    if (static_cast<timer*>(l)->expiry_ <= now) {
+                        l->unlink();
+                        firing.push_back(l);
+                    }
+                    l = next;
+                }
+            }
+            cursor_ = now + 1;
+            advancing_ = true;
+            while (firing.linked()) {
+                timer* t = static_cast<timer*>(firing.next);
+                t->unlink();
+                armed_--;
+                // a copy, the callback may destroy the timer
+                std::function<void()> cb = t->cb_;
+                cb();
+            }
+            advancing_ = false;
+            if (armed_ > 0) schedule(next_expiry());
+        }
+
+        // earliest non-empty slot in the next revolution
+        uint64_t next_expiry() const {
+            for (uint64_t t = cursor_; t < cursor_ + slots_.size(); t++) {
+                const link& s = slots_[t % slots_.size()];
+                // entries further than one revolution out are revisited
+                // when the cursor wraps back around to their slot
+                if (s.linked()) return t;
+            }
+            return cursor_ + slots_.size();
+        }
+    };
+    using timer_wheel_ptr = std::shared_ptr<timer_wheel>;
+}
+
+#endif
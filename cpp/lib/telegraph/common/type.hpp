@@ -15,16 +15,25 @@ namespace telegraph {
             Bool,
             Uint8, Uint16, Uint32, Uint64,
             Int8, Int16, Int32, Int64,
-            Float, Double
+            Float, Double,
+            Block
         };
-        value_type() : class_(Invalid), name_(), labels_() {}
-        value_type(type_class c) : class_(c), name_(), labels_() {}
+        value_type() : class_(Invalid), element_(Invalid), name_(), labels_() {}
+        value_type(type_class c) : class_(c), element_(Invalid), name_(), labels_() {}
         value_type(const std::string_view& name, const std::vector<std::string>& labels)
-            : class_(Enum), name_(name), labels_(labels) {}
+            : class_(Enum), element_(Invalid), name_(name), labels_(labels) {}
         value_type(const std::string_view& name, std::vector<std::string>&& labels)
-            : class_(Enum), name_(name), labels_(std::move(labels)) {}
+            : class_(Enum), element_(Invalid), name_(name), labels_(std::move(labels)) {}
+
+        // a block of samples of the given type
+        static value_type block_of(type_class element) {
+            value_type t{Block};
+            t.set_element(element);
+            return t;
+        }
 
         constexpr type_class get_class() const { return class_; }
+        constexpr type_class get_element() const { return element_; }
         constexpr const std::string& get_name() const { return name_; }
         constexpr const std::vector<std::string>& get_labels() const { return labels_; }
 
@@ -32,10 +41,12 @@ namespace telegraph {
         void add_label(const std::string& label) { labels_.push_back(label); }
 
         void set_class(type_class tc) { class_ = tc; }
+        void set_element(type_class tc) { element_ = tc; }
         void set_labels(std::vector<std::string>&& labels) { labels_ = labels; }
         void set_name(const std::string& name) { name_ = name; }
 
         inline std::string to_str() const {
+            if (class_ == Block) return "block<" + value_type{element_}.to_str() + ">";
             switch (class_) {
                 case Invalid: return "invalid";
                 case None: return "none";
@@ -48,6 +59,8 @@ namespace telegraph {
                 case Int16: return "int16";
                 case Int32: return "int32";
                 case Int64: return "int64";
+                case Float: return "float";
+                case Double: return "double";
                 case Enum: {
                     std::string s = "enum";
                     if (name_.size() > 0) {
@@ -79,7 +92,7 @@ namespace telegraph {
             case Bool: return PClass::Type_Class_BOOL;
             case Uint8: return PClass::Type_Class_UINT8;
             case Uint16: return PClass::Type_Class_UINT16;
-            case Uint32: return PClass::Type_Class_INT32;
+            case Uint32: return PClass::Type_Class_UINT32;
             case Uint64: return PClass::Type_Class_UINT64;
             case Int8: return PClass::Type_Class_INT8;
             case Int16: return PClass::Type_Class_INT16;
@@ -87,6 +100,7 @@ namespace telegraph {
             case Int64: return PClass::Type_Class_INT64;
             case Float: return PClass::Type_Class_FLOAT;
             case Double: return PClass::Type_Class_DOUBLE;
+            case Block: return PClass::Type_Class_BLOCK;
             default: return PClass::Type_Class_INVALID;
             }
         }
@@ -104,6 +118,9 @@ namespace telegraph {
             case Type_Class_INT16: return type_class::Int16;
             case Type_Class_INT32: return type_class::Int32;
             case Type_Class_INT64: return type_class::Int64;
+            case Type_Class_FLOAT: return type_class::Float;
+            case Type_Class_DOUBLE: return type_class::Double;
+            case Type_Class_BLOCK: return type_class::Block;
             default: return type_class::Invalid;
             }
         }
@@ -115,10 +132,12 @@ namespace telegraph {
             }
             tc->set_name(name_);
             tc->set_type(pack(class_));
+            if (class_ == Block) tc->set_element(pack(element_));
         }
         inline static value_type unpack(const Type& tc) {
             value_type t;
             t.set_class(unpack(tc.type()));
+            if (t.get_class() == Block) t.set_element(unpack(tc.element()));
             t.set_name(tc.name());
             std::vector<std::string> labels;
             for (int i = 0; i < tc.labels_size(); i++) {
@@ -129,11 +148,13 @@ namespace telegraph {
         }
 
         bool operator==(const value_type& other) const {{
-            return class_ == other.class_ && name_ == other.name_
+            return class_ == other.class_ && element_ == other.element_
+                && name_ == other.name_
                 && labels_ == other.labels_;
         }}
     private:
         type_class class_;
+        type_class element_; // only set for block types
         std::string name_; // only set for enum types
         // contains the unit for this value_type
         // for for an enum the labels per value
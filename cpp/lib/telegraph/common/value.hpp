@@ -3,6 +3,9 @@
 
 #include <string>
 #include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <optional>
 #include <ostream>
 
 #include "type.hpp"
@@ -15,6 +18,74 @@ namespace telegraph {
     template<typename T>
         T unwrap(const value& v) {}
 
+    // evenly spaced samples of a single type. the samples
+    // stay packed as they came off the wire (little-endian,
+    // back to back) so they are never boxed one by one
+    class block {
+    public:
+        block(value_type::type_class t, uint64_t start, uint32_t period,
+                uint32_t count, std::string&& data)
+            : type_(t), start_(start), period_(period),
+              count_(count), data_(std::move(data)) {}
+
+        constexpr value_type::type_class get_type_class() const { return type_; }
+        // microseconds since epoch of the first sample
+        constexpr uint64_t get_start() const { return start_; }
+        // microseconds between samples
+        constexpr uint32_t get_period() const { return period_; }
+        constexpr uint32_t size() const { return count_; }
+        const std::string& data() const { return data_; }
+
+        // typed access to the packed samples
+        template<typename T>
+            T at(size_t i) const {
+                T v;
+                std::memcpy(&v, data_.data() + i*sizeof(T), sizeof(T));
+                return v;
+            }
+
+        static constexpr size_t sample_size(value_type::type_class t) {
+            switch (t) {
+            case value_type::Bool:
+            case value_type::Enum:
+            case value_type::Uint8:
+            case value_type::Int8: return 1;
+            case value_type::Uint16:
+            case value_type::Int16: return 2;
+            case value_type::Uint32:
+            case value_type::Int32:
+            case value_type::Float: return 4;
+            case value_type::Uint64:
+            case value_type::Int64:
+            case value_type::Double: return 8;
+            default: return 0;
+            }
+        }
+
+        void pack(Block* b) const {
+            b->set_type(value_type::pack(type_));
+            b->set_start(start_);
+            b->set_period(period_);
+            b->set_count(count_);
+            b->set_data(data_);
+        }
+        static std::shared_ptr<const block> unpack(const Block& b) {
+            value_type::type_class t = value_type::unpack(b.type());
+            // drop truncated blocks rather than reading past the data
+            uint32_t count = (uint32_t) std::min<size_t>(b.count(),
+                        sample_size(t) ? b.data().size() / sample_size(t) : 0);
+            return std::make_shared<block>(t, b.start(), b.period(),
+                                        count, std::string{b.data()});
+        }
+    private:
+        value_type::type_class type_;
+        uint64_t start_;
+        uint32_t period_;
+        uint32_t count_;
+        std::string data_;
+    };
+    using block_ptr = std::shared_ptr<const block>;
+
     class value {
     public:
         union box {
@@ -47,6 +118,10 @@ namespace telegraph {
         constexpr value(double v) : type_(value_type::Double), value_() { value_.d = v; }
 
         constexpr value(value_type::type_class t, uint8_t v) : type_(t), value_() { value_.uint8 = v; }
+        constexpr value(value_type::type_class t, const box& b) : type_(t), value_(b) {}
+
+        // blocks are shared, copying a value never copies the samples
+        value(const block_ptr& b) : type_(value_type::Block), value_(), block_(b) {}
 
         value(const Value& v) :type_(value_type::Invalid), value_() {
             switch(v.type_case()) {
@@ -59,14 +134,15 @@ namespace telegraph {
             case Value::kU8: type_ = value_type::Uint8; value_.uint8 = (uint8_t) v.u8(); break;
             case Value::kU16: type_ = value_type::Uint16; value_.uint16 = (uint16_t) v.u16(); break;
             case Value::kU32: type_ = value_type::Uint32; value_.uint32 = v.u32(); break;
-            case Value::kU64: type_ = value_type::Uint64; value_.uint64 = v.u32(); break;
+            case Value::kU64: type_ = value_type::Uint64; value_.uint64 = v.u64(); break;
 
             case Value::kI8: type_ = value_type::Int8; value_.int8 = (int8_t) v.i8(); break;
             case Value::kI16: type_ = value_type::Int16; value_.int16 = (int16_t) v.i16(); break;
             case Value::kI32: type_ = value_type::Int32; value_.int32 = v.i32(); break;
-            case Value::kI64: type_ = value_type::Int64; value_.int64 = v.i32(); break;
+            case Value::kI64: type_ = value_type::Int64; value_.int64 = v.i64(); break;
             case Value::kF: type_ = value_type::Float; value_.f = v.f(); break;
             case Value::kD: type_ = value_type::Double; value_.d = v.d(); break;
+            case Value::kBlock: type_ = value_type::Block; block_ = block::unpack(v.block()); break;
             }
         }
         static value invalid() { return value{value_type::Invalid, 0}; }
@@ -74,6 +150,8 @@ namespace telegraph {
 
         constexpr value_type::type_class get_type_class() const { return type_; }
         constexpr const box& get_box() const { return value_; }
+        // null unless this is a block value
+        const block_ptr& get_block() const { return block_; }
 
         constexpr bool is_valid() { return type_ != value_type::Invalid; }
 
@@ -98,6 +176,7 @@ namespace telegraph {
             case value_type::Int64: v->set_i64(value_.int64); break;
             case value_type::Float: v->set_f(value_.f); break;
             case value_type::Double: v->set_d(value_.d); break;
+            case value_type::Block: if (block_) block_->pack(v->mutable_block()); break;
             }
         }
         static value unpack(const Value& v) {
@@ -106,6 +185,7 @@ namespace telegraph {
     private:
         value_type::type_class type_;
         box value_;
+        block_ptr block_;
     };
 
     template<>
@@ -153,6 +233,25 @@ namespace telegraph {
             return v.get_box().d;
         }
 
+    // numeric value of a scalar, none for non-numeric types
+    inline std::optional<double> to_double(const value& v) {
+        switch (v.get_type_class()) {
+        case value_type::Bool: return v.get<bool>() ? 1 : 0;
+        case value_type::Enum:
+        case value_type::Uint8: return v.get<uint8_t>();
+        case value_type::Uint16: return v.get<uint16_t>();
+        case value_type::Uint32: return v.get<uint32_t>();
+        case value_type::Uint64: return (double) v.get<uint64_t>();
+        case value_type::Int8: return v.get<int8_t>();
+        case value_type::Int16: return v.get<int16_t>();
+        case value_type::Int32: return v.get<int32_t>();
+        case value_type::Int64: return (double) v.get<int64_t>();
+        case value_type::Float: return v.get<float>();
+        case value_type::Double: return v.get<double>();
+        default: return std::nullopt;
+        }
+    }
+
     inline std::ostream& operator<<(std::ostream& o, const value& v) {
         switch (v.get_type_class()) {
         case value_type::Invalid: o << "invalid"; break;
@@ -169,6 +268,11 @@ namespace telegraph {
         case value_type::Int64: o << v.get<int64_t>(); break;
         case value_type::Float: o << v.get<float>(); break;
         case value_type::Double: o << v.get<double>(); break;
+        case value_type::Block: {
+            const auto& b = v.get_block();
+            o << "block(" << (b ? b->size() : 0) << ")";
+        } break;
+        default: break;
         }
         return o;
     }
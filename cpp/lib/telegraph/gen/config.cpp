@@ -59,7 +59,8 @@ namespace telegraph {
         {"int32", value_type::Int32},
         {"int64", value_type::Int64},
         {"float", value_type::Float},
-        {"double", value_type::Double}
+        {"double", value_type::Double},
+        {"block", value_type::Block}
     };
     static
     value_type::type_class unpack_type_class(const std::string& tc) {
@@ -87,6 +88,11 @@ namespace telegraph {
                 if (json.find("type_name") == json.end())
                     throw parse_error("enum type expects type_name: " + json.dump());
             }
+            if (t.get_class() == value_type::Block) {
+                if (json.find("element") == json.end())
+                    throw parse_error("block type expects element: " + json.dump());
+                t.set_element(unpack_type_class(json["element"]));
+            }
         } else if (json.is_string()) {
             t = value_type(unpack_type_class(json.get<std::string>()));
         } else throw parse_error("unable to parse type: " + json.dump());
@@ -68,6 +68,7 @@ namespace telegraph {
             case value_type::Int64:   return "int64_t";
             case value_type::Float:   return "float";
             case value_type::Double:  return "double";
+            case value_type::Block:   return "wire::block";
             default: throw missing_error("Not a builtin, must have name!");
         }
     }
@@ -107,6 +108,7 @@ namespace telegraph {
             case value_type::Int64:   return "int64";
             case value_type::Float:   return "float";
             case value_type::Double:  return "double";
+            case value_type::Block:   return type_to_name(value_type{t.get_element()}) + "_block";
             default: throw missing_error("Not a builtin, enum must have name!");
         }
     }
@@ -179,9 +181,17 @@ namespace telegraph {
             }
             code += "};\n";
 
+            std::string element = "";
+            if (tp->get_class() == value_type::Block) {
+                // wire::type_class names are the capitalized type names
+                std::string e = value_type{tp->get_element()}.to_str();
+                e[0] = std::toupper(e[0]);
+                element = ", wire::type_class::" + e;
+            }
             code += "wire::type_info<" + type_to_cpp_ident(*tp) + "> " + type_to_name(*tp) + "_type " +
                         "= wire::type_info<" + type_to_cpp_ident(*tp) + ">(\"" +  
-                        tp->get_name() + "\", " + std::to_string(tp->get_labels().size()) + ", " + type_to_name(*tp) + "_labels_);";
+                        tp->get_name() + "\", " + std::to_string(tp->get_labels().size()) + ", " + 
+                        type_to_name(*tp) + "_labels_" + element + ");";
 
             code += "\n\n";
         }
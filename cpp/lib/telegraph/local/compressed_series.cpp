@@ -0,0 +1,332 @@
+#include "compressed_series.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace telegraph {
+    static int clz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return x ? __builtin_clzll(x) : 64;
+#else
+        int n = 0;
+        for (uint64_t m = 1ull << 63; m && !(x & m); m >>= 1) n++;
+        return n;
+#endif
+    }
+    static int ctz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return x ? __builtin_ctzll(x) : 64;
+#else
+        int n = 0;
+        for (uint64_t m = 1; m && !(x & m); m <<= 1) n++;
+        return n;
+#endif
+    }
+
+    static uint64_t zigzag(int64_t x) {
+        return ((uint64_t) x << 1) ^ (uint64_t) (x >> 63);
+    }
+    static int64_t unzigzag(uint64_t z) {
+        return (int64_t) ((z >> 1) ^ (~(z & 1) + 1));
+    }
+
+    static bool is_float(value_type::type_class t) {
+        return t == value_type::Float || t == value_type::Double;
+    }
+
+    // the value as raw bits, integers sign-extended to 64 bits
+    static uint64_t raw_bits(const value& v) {
+        const value::box& b = v.get_box();
+        switch (v.get_type_class()) {
+        case value_type::Bool: return b.b ? 1 : 0;
+        case value_type::Enum:
+        case value_type::Uint8: return b.uint8;
+        case value_type::Uint16: return b.uint16;
+        case value_type::Uint32: return b.uint32;
+        case value_type::Uint64: return b.uint64;
+        case value_type::Int8: return (uint64_t) (int64_t) b.int8;
+        case value_type::Int16: return (uint64_t) (int64_t) b.int16;
+        case value_type::Int32: return (uint64_t) (int64_t) b.int32;
+        case value_type::Int64: return (uint64_t) b.int64;
+        case value_type::Float: {
+            uint32_t u;
+            std::memcpy(&u, &b.f, sizeof(u));
+            return u;
+        }
+        case value_type::Double: {
+            uint64_t u;
+            std::memcpy(&u, &b.d, sizeof(u));
+            return u;
+        }
+        default: return 0;
+        }
+    }
+
+    static value from_bits(value_type::type_class t, uint64_t r) {
+        value::box b;
+        std::memset(&b, 0, sizeof(b));
+        switch (t) {
+        case value_type::Bool: b.b = r != 0; break;
+        case value_type::Enum:
+        case value_type::Uint8: b.uint8 = (uint8_t) r; break;
+        case value_type::Uint16: b.uint16 = (uint16_t) r; break;
+        case value_type::Uint32: b.uint32 = (uint32_t) r; break;
+        case value_type::Uint64: b.uint64 = r; break;
+        case value_type::Int8: b.int8 = (int8_t) r; break;
+        case value_type::Int16: b.int16 = (int16_t) r; break;
+        case value_type::Int32: b.int32 = (int32_t) r; break;
+        case value_type::Int64: b.int64 = (int64_t) r; break;
+        case value_type::Float: {
+            uint32_t u = (uint32_t) r;
+            std::memcpy(&b.f, &u, sizeof(u));
+        } break;
+        case value_type::Double: std::memcpy(&b.d, &r, sizeof(r)); break;
+        default: break;
+        }
+        return value{t, b};
+    }
+
+    // most significant bit first
+    static void put(std::vector<uint64_t>& w, size_t& nbits, uint64_t v, int n) {
+        if (n == 0) return;
+        if (n < 64) v &= (1ull << n) - 1;
+        size_t off = nbits % 64;
+        if (off == 0) w.push_back(0);
+        int free = 64 - (int) off;
+        if (n <= free) {
+            w.back() |= v << (free - n);
+        } else {
+            w.back() |= v >> (n - free);
+            w.push_back(v << (64 - (n - free)));
+        }
+        nbits += n;
+    }
+
+    namespace {
+        struct bit_reader {
+            const uint64_t* w;
+            size_t pos;
+
+            uint64_t get(int n) {
+                if (n == 0) return 0;
+                size_t i = pos / 64;
+                int off = (int) (pos % 64);
+                int avail = 64 - off;
+                uint64_t r = (w[i] << off) >> (64 - n);
+                if (n > avail) r |= w[i + 1] >> (64 - (n - avail));
+                pos += n;
+                return r;
+            }
+            bool bit() { return get(1) != 0; }
+        };
+    }
+
+    size_t
+    compressed_series::bytes() const {
+        size_t b = chunks_.capacity()*sizeof(chunk);
+        for (const chunk& c : chunks_) {
+            b += c.bits.capacity()*sizeof(uint64_t) + c.boxed.capacity()*sizeof(value);
+        }
+        return b;
+    }
+
+    void
+    compressed_series::append(int64_t micros, const value& v) {
+        auto t = v.get_type_class();
+        if (chunks_.empty() || chunks_.back().count >= chunk_points ||
+                chunks_.back().type != t) {
+            // the full chunk won't grow anymore
+            if (!chunks_.empty()) chunks_.back().bits.shrink_to_fit();
+            chunks_.emplace_back(t);
+        }
+        chunk& c = chunks_.back();
+        encode_time(c, micros);
+        encode_value(c, v);
+        c.max_time = std::max(c.max_time, micros);
+        c.count++;
+        size_++;
+    }
+
+    void
+    compressed_series::drop_before(int64_t micros) {
+        size_t n = 0;
+        while (n < chunks_.size() && chunks_[n].max_time < micros) {
+            size_ -= chunks_[n].count;
+            n++;
+        }
+        if (n) chunks_.erase(chunks_.begin(), chunks_.begin() + n);
+        dropped_ += n;
+    }
+
+    void
+    compressed_series::encode_time(chunk& c, int64_t t) {
+        if (c.count == 0) {
+            put(c.bits, c.nbits, (uint64_t) t, 64);
+            c.last_time = t;
+            c.last_delta = 0;
+            return;
+        }
+        int64_t delta = (int64_t) ((uint64_t) t - (uint64_t) c.last_time);
+        uint64_t z = zigzag((int64_t) ((uint64_t) delta - (uint64_t) c.last_delta));
+        if (z == 0) {
+            put(c.bits, c.nbits, 0, 1);
+        } else if (z < (1ull << 7)) {
+            put(c.bits, c.nbits, 0b10, 2);
+            put(c.bits, c.nbits, z, 7);
+        } else if (z < (1ull << 12)) {
+            put(c.bits, c.nbits, 0b110, 3);
+            put(c.bits, c.nbits, z, 12);
+        } else if (z < (1ull << 20)) {
+            put(c.bits, c.nbits, 0b1110, 4);
+            put(c.bits, c.nbits, z, 20);
+        } else {
+            put(c.bits, c.nbits, 0b1111, 4);
+            put(c.bits, c.nbits, z, 64);
+        }
+        c.last_time = t;
+        c.last_delta = delta;
+    }
+
+    void
+    compressed_series::encode_value(chunk& c, const value& v) {
+        size_t size = block::sample_size(c.type);
+        if (size == 0) {
+            c.boxed.push_back(v);
+            return;
+        }
+        uint64_t raw = raw_bits(v);
+        if (is_float(c.type)) {
+            int width = (int) size*8;
+            if (c.count == 0) {
+                put(c.bits, c.nbits, raw, width);
+                c.last_value = raw;
+                return;
+            }
+            uint64_t x = raw ^ c.last_value;
+            c.last_value = raw;
+            if (x == 0) {
+                put(c.bits, c.nbits, 0, 1);
+                return;
+            }
+            int lead = clz64(x) - (64 - width);
+            int trail = ctz64(x);
+            if (c.leading >= 0 && lead >= c.leading && trail >= c.trailing) {
+                // fits in the previous window
+                put(c.bits, c.nbits, 0b10, 2);
+                put(c.bits, c.nbits, x >> c.trailing, width - c.leading - c.trailing);
+            } else {
+                int len = width - lead - trail;
+                put(c.bits, c.nbits, 0b11, 2);
+                put(c.bits, c.nbits, (uint64_t) lead, 6);
+                put(c.bits, c.nbits, (uint64_t) (len - 1), 6);
+                put(c.bits, c.nbits, x >> trail, len);
+                c.leading = lead;
+                c.trailing = trail;
+            }
+        } else {
+            if (c.count == 0) {
+                put(c.bits, c.nbits, raw, 64);
+                c.last_value = raw;
+                return;
+            }
+            uint64_t z = zigzag((int64_t) (raw - c.last_value));
+            c.last_value = raw;
+            if (z == 0) {
+                put(c.bits, c.nbits, 0, 1);
+                return;
+            }
+            int n = 64 - clz64(z);
+            put(c.bits, c.nbits, 1, 1);
+            put(c.bits, c.nbits, (uint64_t) (n - 1), 6);
+            put(c.bits, c.nbits, z, n);
+        }
+    }
+
+    void
+    compressed_series::decode(const chunk& c, datapoint_batch& out) {
+        bit_reader r{c.bits.data(), 0};
+        size_t size = block::sample_size(c.type);
+        int width = (int) size*8;
+        bool fl = is_float(c.type);
+        int64_t time = 0, delta = 0;
+        uint64_t last = 0;
+        int leading = 0, trailing = 0;
+        for (size_t i = 0; i < c.count; i++) {
+            if (i == 0) {
+                time = (int64_t) r.get(64);
+            } else {
+                uint64_t z = 0;
+                if (!r.bit()) z = 0;
+                else if (!r.bit()) z = r.get(7);
+                else if (!r.bit()) z = r.get(12);
+                else if (!r.bit()) z = r.get(20);
+                else z = r.get(64);
+                delta = (int64_t) ((uint64_t) delta + (uint64_t) unzigzag(z));
+                time = (int64_t) ((uint64_t) time + (uint64_t) delta);
+            }
+            if (size == 0) {
+                out.push_back(time, c.boxed[i]);
+                continue;
+            }
+            if (i == 0) {
+                last = r.get(fl ? width : 64);
+            } else if (fl) {
+                if (r.bit()) {
+                    if (r.bit()) {
+                        leading = (int) r.get(6);
+                        int len = (int) r.get(6) + 1;
+                        trailing = width - leading - len;
+                    }
+                    last ^= r.get(width - leading - trailing) << trailing;
+                }
+            } else if (r.bit()) {
+                int n = (int) r.get(6) + 1;
+                last += (uint64_t) unzigzag(r.get(n));
+            }
+            out.push_back(time, from_bits(c.type, last));
+        }
+    }
+
+    void
+    compressed_series::reader::next(size_t n, datapoint_batch& out) {
+        out.clear();
+        while (out.size() < n) {
+            if (chunk_ < series_.dropped_) {
+                chunk_ = series_.dropped_;
+                offset_ = 0;
+            }
+            size_t i = (size_t) (chunk_ - series_.dropped_);
+            if (i >= series_.chunks_.size()) break;
+            const chunk& c = series_.chunks_[i];
+            if (offset_ >= c.count) {
+                // the last chunk may still grow
+                if (i + 1 == series_.chunks_.size()) break;
+                chunk_++;
+                offset_ = 0;
+                continue;
+            }
+            if (out.empty()) out = datapoint_batch{c.type};
+            else if (c.type != out.get_type_class()) break;
+            if (decoded_chunk_ != chunk_ || decoded_count_ != c.count) {
+                decoded_ = datapoint_batch{c.type};
+                decoded_.reserve(c.count);
+                decode(c, decoded_);
+                decoded_chunk_ = chunk_;
+                decoded_count_ = c.count;
+            }
+            size_t take = std::min(n - out.size(), c.count - offset_);
+            out.append(decoded_.slice(offset_, take));
+            offset_ += take;
+        }
+    }
+
+    void
+    compressed_series::scan(const std::function<void(const datapoint_batch&)>& f) const {
+        for (const chunk& c : chunks_) {
+            datapoint_batch b{c.type};
+            b.reserve(c.count);
+            decode(c, b);
+            f(b);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef __TELEGRAPH_LOCAL_COMPRESSED_SERIES_HPP__
+#define __TELEGRAPH_LOCAL_COMPRESSED_SERIES_HPP__
+
+#include "../common/data.hpp"
+#include "../common/value.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace telegraph {
+
+    // An append-only series of datapoints kept compressed in memory, in
+    // chunks of up to chunk_points datapoints of a single type. As in
+    // Gorilla, timestamps are stored as bit-packed delta-of-deltas and
+    // floats as the XOR with the previous value. Integers (and bools, enums)
+    // are stored as bit-packed zigzag deltas. Values which have no fixed size
+    // (blocks, none) are kept boxed, only their timestamps are compressed.
+    // Every chunk keeps its encoder state, so appending never re-encodes.
+    class compressed_series {
+    public:
+        static constexpr size_t chunk_points = 1024;
+    private:
+        struct chunk {
+            value_type::type_class type;
+            size_t count;
+            std::vector<uint64_t> bits;
+            size_t nbits;
+            std::vector<value> boxed;
+            int64_t max_time; // the newest datapoint
+
+            // encoder state
+            int64_t last_time;
+            int64_t last_delta;
+            uint64_t last_value; // raw bits, integers sign-extended
+            int leading; // of the last stored XOR, -1 if none
+            int trailing;
+
+            chunk(value_type::type_class t)
+                : type(t), count(0), bits(), nbits(0), boxed(),
+                  max_time(std::numeric_limits<int64_t>::min()),
+                  last_time(0), last_delta(0), last_value(0),
+                  leading(-1), trailing(0) {}
+        };
+        std::vector<chunk> chunks_;
+        size_t size_;
+        uint64_t dropped_; // chunks released by drop_before
+    public:
+        // decodes a chunk at a time, reading what is appended meanwhile.
+        // chunks dropped before they are read are skipped
+        class reader : public data_cursor {
+        private:
+            const compressed_series& series_;
+            uint64_t chunk_; // counting the dropped ones
+            size_t offset_;
+            // the last chunk decoded, as of count datapoints
+            datapoint_batch decoded_;
+            uint64_t decoded_chunk_;
+            size_t decoded_count_;
+        public:
+            reader(const compressed_series& s)
+                : series_(s), chunk_(s.dropped_), offset_(0), decoded_(),
+                  decoded_chunk_(std::numeric_limits<uint64_t>::max()),
+                  decoded_count_(0) {}
+
+            void next(size_t n, datapoint_batch& out) override;
+        };
+
+        compressed_series() : chunks_(), size_(0), dropped_(0) {}
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        // memory held by the encoded data
+        size_t bytes() const;
+
+        void append(int64_t micros, const value& v);
+        void append(const datapoint_batch& b) {
+            for (size_t i = 0; i < b.size(); i++) append(b.micros(i), b.value_at(i));
+        }
+
+        // drops the chunks which only hold datapoints from before the
+        // given time, so the data is released a whole chunk at a time
+        void drop_before(int64_t micros);
+
+        // the series must outlive the cursor
+        std::unique_ptr<data_cursor> cursor() const {
+            return std::make_unique<reader>(*this);
+        }
+
+        // decodes the series, one chunk at a time, oldest first
+        void scan(const std::function<void(const datapoint_batch&)>& f) const;
+    private:
+        static void encode_time(chunk& c, int64_t t);
+        static void encode_value(chunk& c, const value& v);
+        static void decode(const chunk& c, datapoint_batch& out);
+    };
+}
+
+#endif
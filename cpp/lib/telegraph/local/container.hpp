@@ -49,21 +49,21 @@ namespace telegraph {
 
         bool write_data(io::yield_ctx& yield, 
                 variable* v, 
-                const std::vector<datapoint>& data) override {
+                const datapoint_batch& data) override {
             return false;
         }
         bool write_data(io::yield_ctx& yield, 
                 const std::vector<std::string_view>&, 
-                const std::vector<datapoint>& data) override {
+                const datapoint_batch& data) override {
             return false;
         }
 
         data_query_ptr query_data(io::yield_ctx& yield, 
-                                    const variable* v) override {
+                                    const variable* v, float timeout) override {
             return nullptr;
         }
         data_query_ptr query_data(io::yield_ctx& yield, 
-                const std::vector<std::string_view>& v) override {
+                const std::vector<std::string_view>& v, float timeout) override {
             return nullptr;
         }
 
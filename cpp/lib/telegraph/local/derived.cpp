@@ -0,0 +1,235 @@
+#include "derived.hpp"
+
+#include "../utils/errors.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+
+namespace telegraph {
+    static bool is_numeric(value_type::type_class t) {
+        return t != value_type::None && t != value_type::Invalid &&
+               t != value_type::Block;
+    }
+
+    static derived::operation parse_operation(const std::string& s) {
+        if (s == "ewma") return derived::Ewma;
+        if (s == "mean") return derived::Mean;
+        if (s == "min") return derived::Min;
+        if (s == "max") return derived::Max;
+        if (s == "rate") return derived::Rate;
+        if (s == "decimate") return derived::Decimate;
+        if (s == "scale") return derived::Scale;
+        throw parse_error("unknown derived operation: " + s);
+    }
+
+    static float num_or(const params& p, const std::string_view& key, float def) {
+        const auto& m = p.to_map();
+        auto it = m.find(key);
+        if (it == m.end() || !it->second.is_num()) return def;
+        return it->second.get<float>();
+    }
+
+    static const std::string& str(const params& p, const std::string_view& key) {
+        const auto& m = p.to_map();
+        auto it = m.find(key);
+        if (it == m.end() || !it->second.is_str())
+            throw parse_error("derived variable is missing " + std::string{key});
+        return it->second.get<std::string>();
+    }
+
+    // splits a /-separated path, ignoring empty components
+    static std::vector<std::string_view> split_path(const std::string& s) {
+        std::vector<std::string_view> p;
+        size_t i = 0;
+        while (i < s.size()) {
+            size_t j = s.find('/', i);
+            if (j == std::string::npos) j = s.size();
+            if (j > i) p.push_back(std::string_view{s}.substr(i, j - i));
+            i = j + 1;
+        }
+        return p;
+    }
+
+    derived::derived(io::io_context& ioc, const std::string_view& name,
+                        const params& p, std::unique_ptr<node>&& tree,
+                        const context_ptr& src)
+            : local_context(ioc, name, "derived", p, std::move(tree)),
+              src_(src), channels_() {
+        src_->destroyed.add(this, [this](io::yield_ctx& y) {
+            destroy(y);
+        });
+    }
+
+    derived::~derived() {
+        src_->destroyed.remove(this);
+        for (auto& c : channels_) {
+            if (!c.src) continue;
+            c.src->data.remove(this);
+            c.src->cancel();
+        }
+    }
+
+    void
+    derived::add_channel(channel&& c) {
+        channels_.emplace_back(std::move(c));
+        size_t i = channels_.size() - 1;
+        channels_[i].src->data.add(this, [this, i] (value v) {
+            on_sample(channels_[i], v);
+        });
+    }
+
+    void
+    derived::on_sample(channel& c, value v) {
+        if (c.op == Decimate) {
+            if (c.seen++ % c.window == 0) c.pub->update(v);
+            return;
+        }
+        auto x = to_double(v);
+        if (!x) return;
+        auto now = std::chrono::system_clock::now();
+
+        std::optional<double> y;
+        switch (c.op) {
+        case Ewma:
+            c.acc = c.primed ? c.acc + c.alpha*(*x - c.acc) : *x;
+            y = c.acc;
+            break;
+        case Mean:
+            c.samples.push_back(*x);
+            c.acc += *x;
+            if (c.samples.size() > c.window) {
+                c.acc -= c.samples.front();
+                c.samples.pop_front();
+            }
+            y = c.acc / c.samples.size();
+            break;
+        case Min:
+        case Max: {
+            // monotonic queue, the front is the extremum of the window
+            bool is_min = c.op == Min;
+            while (!c.extrema.empty() && (is_min ?
+                        c.extrema.back().second >= *x : c.extrema.back().second <= *x))
+                c.extrema.pop_back();
+            c.extrema.emplace_back(c.seen, *x);
+            if (c.extrema.front().first + c.window <= c.seen)
+                c.extrema.pop_front();
+            y = c.extrema.front().second;
+        } break;
+        case Rate:
+            if (c.primed) {
+                double dt = std::chrono::duration<double>(now - c.last_time).count();
+                if (dt > 0) y = (*x - c.last) / dt;
+            }
+            break;
+        case Scale:
+            y = *x;
+            break;
+        default: break;
+        }
+        c.primed = true;
+        c.seen++;
+        c.last = *x;
+        c.last_time = now;
+        if (y) c.pub->update(value{c.scale * *y + c.offset});
+    }
+
+    std::optional<datapoint>
+    derived::last_value(const variable* v) {
+        for (auto& c : channels_) {
+            if (c.var == v) return c.pub->last();
+        }
+        return std::nullopt;
+    }
+
+    subscription_ptr
+    derived::subscribe(io::yield_ctx&, const variable* v,
+                        float min_interval, float max_interval,
+                        float timeout) {
+        for (auto& c : channels_) {
+            if (c.var == v) return c.pub->subscribe(min_interval, max_interval);
+        }
+        return nullptr;
+    }
+
+    recording_tap_ptr
+    derived::tap(io::yield_ctx&, const variable* v, float timeout) {
+        for (auto& c : channels_) {
+            if (c.var == v) return c.pub->tap();
+        }
+        return nullptr;
+    }
+
+    local_context_ptr
+    derived::create(io::yield_ctx& yield, io::io_context& ioc,
+            const std::string_view& name, const std::string_view& type,
+            const params& p) {
+        if (!p.is_object()) throw parse_error("derived expects an object");
+        const auto& m = p.to_map();
+        auto sit = m.find("src");
+        if (sit == m.end() || !sit->second.is_ctx())
+            throw parse_error("derived needs a src context");
+        auto vit = m.find("vars");
+        if (vit == m.end() || !vit->second.is_array())
+            throw parse_error("derived needs a list of vars");
+        context_ptr src = sit->second.to_ctx();
+        float interval = num_or(p, "interval", 0);
+
+        auto src_tree = src->fetch(yield);
+        if (!src_tree) throw missing_error("derived src has no tree");
+
+        struct spec {
+            const variable* src_var;
+            operation op;
+            const params* conf;
+        };
+        std::vector<spec> specs;
+        std::vector<node*> children;
+        node::id id = 1;
+        for (const params& vp : vit->second.to_vector()) {
+            if (!vp.is_object()) throw parse_error("derived vars must be objects");
+            const std::string& n = str(vp, "name");
+            auto sv = dynamic_cast<const variable*>(
+                    src_tree->from_path(split_path(str(vp, "var"))));
+            if (!sv) throw missing_error("no such variable: " + str(vp, "var"));
+            operation op = parse_operation(str(vp, "op"));
+
+            auto tc = sv->get_type().get_class();
+            if (op != Decimate && !is_numeric(tc))
+                throw bad_type_error("derived " + str(vp, "op") +
+                        " needs a numeric variable: " + str(vp, "var"));
+            // decimation passes the samples through unchanged
+            value_type vt = op == Decimate ? sv->get_type() : value_type{value_type::Double};
+            children.push_back(new variable(id++, n, n, "", vt));
+            specs.push_back(spec{sv, op, &vp});
+        }
+        auto root = std::make_unique<group>(0, "derived", "Derived", "", "", 1,
+                                            std::vector<node*>{children});
+        auto d = std::make_shared<derived>(ioc, name, p, std::move(root), src);
+
+        auto wheel = std::make_shared<timer_wheel>(ioc);
+        for (size_t i = 0; i < specs.size(); i++) {
+            const spec& s = specs[i];
+            auto var = static_cast<const variable*>(children[i]);
+            channel c;
+            c.var = var;
+            c.pub = std::make_shared<publisher>(wheel, var->get_type());
+            c.op = s.op;
+            c.alpha = num_or(*s.conf, "alpha", 0.1f);
+            c.window = (size_t) std::max(1.0f, num_or(*s.conf,
+                            s.op == Decimate ? "every" : "window", 10));
+            c.scale = num_or(*s.conf, "scale", 1);
+            c.offset = num_or(*s.conf, "offset", 0);
+            c.primed = false;
+            c.acc = 0;
+            c.seen = 0;
+            c.last_time = time_point();
+            c.last = 0;
+            c.src = src->subscribe(yield, s.src_var, interval,
+                                    subscription::DISABLED, 1);
+            if (!c.src) throw missing_error("unable to subscribe to " + s.src_var->topic());
+            d->add_channel(std::move(c));
+        }
+        return d;
+    }
+}
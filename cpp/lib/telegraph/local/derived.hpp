@@ -0,0 +1,121 @@
+#ifndef __TELEGRAPH_LOCAL_DERIVED_HPP__
+#define __TELEGRAPH_LOCAL_DERIVED_HPP__
+
+#include "namespace.hpp"
+#include "../common/publisher.hpp"
+#include "../common/nodes.hpp"
+
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+
+namespace telegraph {
+    // virtual variables computed on the server from subscriptions
+    // to another context, so clients which only need a summary
+    // (an average, an envelope, a decimated view) don't have to
+    // subscribe at the full rate
+    class derived : public local_context {
+    public:
+        enum operation { Ewma, Mean, Min, Max, Rate, Decimate, Scale };
+
+        struct channel {
+            const variable* var;
+            publisher_ptr pub;
+            subscription_ptr src;
+            operation op;
+
+            double alpha; // ewma weight of a new sample
+            size_t window; // samples for mean/min/max, n for decimate
+            // applied to the output of every operation
+            double scale;
+            double offset;
+
+            bool primed;
+            double acc; // ewma value or windowed sum
+            size_t seen;
+            time_point last_time;
+            double last;
+            std::deque<double> samples;
+            // (sample number, value), monotonic for min/max
+            std::deque<std::pair<size_t, double>> extrema;
+        };
+    private:
+        context_ptr src_;
+        std::vector<channel> channels_;
+    public:
+        derived(io::io_context& ioc, const std::string_view& name,
+                    const params& p, std::unique_ptr<node>&& tree,
+                    const context_ptr& src);
+        ~derived();
+
+        void add_channel(channel&& c);
+
+        std::optional<datapoint> last_value(const variable* v) override;
+
+        subscription_ptr subscribe(io::yield_ctx& ctx,
+                const variable* v,
+                float min_interval, float max_interval,
+                float timeout) override;
+
+        recording_tap_ptr tap(io::yield_ctx& yield, const variable* v, float timeout) override;
+
+        subscription_ptr subscribe(io::yield_ctx& yield,
+                const std::vector<std::string_view>& path,
+                float min_interval, float max_interval,
+                float timeout) override {
+            auto v = dynamic_cast<variable*>(tree_->from_path(path));
+            if (!v) return nullptr;
+            return subscribe(yield, v, min_interval, max_interval, timeout);
+        }
+
+        value call(io::yield_ctx& yield, action* a, value v, float timeout) override {
+            return value::invalid();
+        }
+        value call(io::yield_ctx& yield,
+                    const std::vector<std::string_view>& path,
+                    value v, float timeout) override {
+            return value::invalid();
+        }
+
+        bool write_data(io::yield_ctx& yield,
+                variable* v,
+                const datapoint_batch& data) override {
+            return false;
+        }
+        bool write_data(io::yield_ctx& yield,
+                const std::vector<std::string_view>&,
+                const datapoint_batch& data) override {
+            return false;
+        }
+
+        data_query_ptr query_data(io::yield_ctx& yield,
+                                    const variable* v, float timeout) override {
+            return nullptr;
+        }
+        data_query_ptr query_data(io::yield_ctx& yield,
+                const std::vector<std::string_view>& v, float timeout) override {
+            return nullptr;
+        }
+
+        params_stream_ptr request(io::yield_ctx&, const params& p) override {
+            return nullptr;
+        }
+
+        // params:
+        //  src: the context to derive from
+        //  interval: debounce of the source subscriptions (default 0, full rate)
+        //  vars: list of {name, var, op, ...} where var is the /-separated
+        //        path below the source root and op is one of
+        //          ewma {alpha}, mean {window}, min {window}, max {window},
+        //          rate (per second), decimate {every}, scale
+        //        every op also takes {scale, offset} which are applied to its output
+        static local_context_ptr create(io::yield_ctx&, io::io_context& ioc,
+                const std::string_view& name, const std::string_view& type,
+                const params& p);
+    private:
+        void on_sample(channel& c, value v);
+    };
+}
+
+#endif
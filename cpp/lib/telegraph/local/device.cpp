@@ -4,6 +4,7 @@
 
 #include "crc.hpp"
 #include "stream.pb.h"
+#include "log.pb.h"
 
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
@@ -15,6 +16,20 @@
 #include <iomanip>
 #include <memory>
 #include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -89,6 +104,111 @@ namespace telegraph {
         }
     };
 
+    // backoff between attempts to reopen a lost port
+    static constexpr int reconnect_min_ms = 100;
+    static constexpr int reconnect_max_ms = 5000;
+    // missed pings before the link is considered lost
+    static constexpr int max_missed_pings = 3;
+    // calls outstanding on the link at once
+    static constexpr size_t default_call_window = 8;
+    // seconds, for calls made without a timeout
+    static constexpr float default_call_timeout = 1;
+
+    static stream::Packet make_change_sub(uint32_t req_id, node::id id,
+                        float debounce, float refresh, const deadband& band,
+                        float timeout) {
+        stream::Packet p;
+        p.set_req_id(req_id);
+        stream::Subscribe* s = p.mutable_change_sub();
+        s->set_var_id(id);
+        s->set_sub_timeout((uint32_t) (1000*timeout));
+        s->set_debounce((uint32_t) (1000*debounce));
+        s->set_refresh((uint32_t) (1000*refresh));
+        s->set_deadband(band.threshold);
+        s->set_relative(band.relative);
+        return p;
+    }
+
+    static stream::Packet make_call(uint32_t req_id, node::id id,
+                        value arg, float timeout) {
+        stream::Packet p;
+        p.set_req_id(req_id);
+        stream::Call* c = p.mutable_call_action();
+        c->set_action_id(id);
+        c->set_call_timeout((uint32_t) std::min(65535.0f, 1000*timeout));
+        arg.pack(c->mutable_arg());
+        return p;
+    }
+
+    // a fast check that the device still has the same tree,
+    // comparing only the root (with its children as placeholders)
+    static bool same_root(const node* current, const node* fetched) {
+        auto c = dynamic_cast<const group*>(current);
+        auto f = dynamic_cast<const group*>(fetched);
+        if (!c || !f) return false;
+        if (c->get_name() != f->get_name() || c->get_schema() != f->get_schema() ||
+                c->get_version() != f->get_version()) return false;
+        const auto& ids = f->placeholders();
+        if (ids.size() != c->num_children()) return false;
+        for (size_t i = 0; i < ids.size(); i++) {
+            if ((*c)[i]->get_id() != ids[i]) return false;
+        }
+        return true;
+    }
+
+    static float num_or(const params& p, const std::string_view& key, float def) {
+        if (!p.is_object()) return def;
+        const auto& m = p.to_map();
+        auto it = m.find(key);
+        if (it == m.end() || !it->second.is_num()) return def;
+        return it->second.get<float>();
+    }
+
+    static bool bool_or(const params& p, const std::string_view& key, bool def) {
+        if (!p.is_object()) return def;
+        const auto& m = p.to_map();
+        auto it = m.find(key);
+        if (it == m.end() || !it->second.is_bool()) return def;
+        return it->second.get<bool>();
+    }
+
+    serial_options
+    serial_options::parse(const params& p) {
+        serial_options o;
+        if (p.is_bool()) {
+            if (p.get<bool>()) {
+                o.low_latency = true;
+                o.read_chunk = 4096;
+            }
+            return o;
+        }
+        if (!p.is_object()) throw parse_error("low_latency should be a bool or an object");
+        o.low_latency = bool_or(p, "async_low_latency", true);
+        o.read_chunk = (size_t) std::max(1.0f, num_or(p, "read_chunk", 4096));
+        o.busy_poll = bool_or(p, "busy_poll", false);
+        o.reader_thread = bool_or(p, "thread", o.busy_poll) || o.busy_poll;
+        o.vmin = (int) num_or(p, "vmin", 1);
+        o.vtime = (int) num_or(p, "vtime", 0);
+        if (o.vmin < 0 || o.vmin > 255 || o.vtime < 0 || o.vtime > 255) {
+            throw parse_error("vmin and vtime should be between 0 and 255");
+        }
+        return o;
+    }
+
+    struct device::call_waiter {
+        io::deadline_timer timer;
+        bool granted;
+        call_waiter(io::io_context& ioc) : timer(ioc), granted(false) {}
+    };
+
+    struct device::reader_thread {
+        std::thread thread;
+        std::atomic<bool> stop;
+        int fd;
+        int stop_fd; // wakes a blocked reader
+        reader_thread() : thread(), stop(false), fd(-1), stop_fd(-1) {}
+    };
+
     static params make_device_params(const std::string& port, int baud) {
         std::map<std::string, params, std::less<>> i;
         i["port"] = port;
@@ -96,20 +216,50 @@ namespace telegraph {
         return params(std::move(i));
     }
 
-    device::device(io::io_context& ioc, const std::string& name, const std::string& port, int baud)
+    device::device(io::io_context& ioc, const std::string& name, const std::string& port, int baud,
+                    const serial_options& opts)
             : local_context(ioc, name, "device", make_device_params(port, baud), nullptr),
-              write_queue_(), write_buf_(), read_buf_(),
+              write_queue_(), write_buf_(), writing_(false), read_buf_(),
               one_start_(false), decoding_(false),
               decode_buf_(),
-              req_id_(0), reqs_(), adapters_(),
-              port_(ioc) {
+              req_id_(0), reqs_(), rtt_(),
+              call_window_(default_call_window), calls_in_flight_(0), call_waiters_(),
+              adapters_(),
+              wheel_(std::make_shared<timer_wheel>(ioc)),
+              port_name_(port), baud_(baud), port_(ioc),
+              ring_(uring::get(ioc)), ring_buf_(), ring_read_(0), ring_write_(0),
+              serial_(opts), reader_(), reader_gen_(0),
+              reconnecting_(false), closing_(false) {
         boost::system::error_code ec;
         port_.open(port, ec);
         if (ec) throw io_error("unable to open port: " + port);
         port_.set_option(io::serial_port::baud_rate(baud));
+        configure_port();
     }
 
+    device::device(io::io_context& ioc, const std::string& name,
+                    const std::string& type, const params& p)
+            : local_context(ioc, name, type, p, nullptr),
+              write_queue_(), write_buf_(), writing_(false), read_buf_(),
+              one_start_(false), decoding_(false),
+              decode_buf_(),
+              req_id_(0), reqs_(), rtt_(),
+              call_window_(default_call_window), calls_in_flight_(0), call_waiters_(),
+              adapters_(),
+              wheel_(std::make_shared<timer_wheel>(ioc)),
+              port_name_(), baud_(0), port_(ioc),
+              ring_(nullptr), ring_buf_(), ring_read_(0), ring_write_(0),
+              serial_(), reader_(), reader_gen_(0),
+              reconnecting_(false), closing_(false) {}
+
     device::~device() {
+        closing_ = true;
+        stop_reader();
+        if (ring_) {
+            // the ring holds on to the descriptor until cancelled
+            ring_->cancel(ring_read_);
+            ring_->cancel(ring_write_);
+        }
         port_.close();
     }
 
@@ -117,8 +267,7 @@ namespace telegraph {
     device::init(io::yield_ctx& yield, int timeout_millisec) {
         // start reading (we can't do this in the constructor
         // since there shared_from_this() doesn't work)
-        auto sthis = shared_device_this();
-        io::dispatch(port_.get_executor(), [sthis] () { sthis->do_reading(0); });
+        start_reading();
 
         // do a ping
         if (!ping(yield, true, 50)) {
@@ -179,19 +328,29 @@ namespace telegraph {
         if (!tree_) return;
         tree_->set_owner(shared_device_this());
 
-        // start a ping task
+        // start a ping task, which also detects
+        // a link that went silent without an error
         auto wp = weak_device_this();
         io::io_context& ioc = ioc_;
         io::spawn(ioc_, [&ioc, wp, timeout_millisec](io::yield_context yield) {
             io::deadline_timer timer{ioc};
             io::yield_ctx ctx{yield};
+            int missed = 0;
             while (true) {
                 timer.expires_from_now(boost::posix_time::milliseconds(timeout_millisec));
                 timer.async_wait(yield);
                 {
                     auto sp = wp.lock();
-                    if (!sp) break;
-                    sp->ping(ctx, false, 0);
+                    if (!sp || sp->closing_) break;
+                    if (sp->reconnecting_) {
+                        missed = 0;
+                        continue;
+                    }
+                    if (sp->ping(ctx, true, timeout_millisec)) missed = 0;
+                    else if (++missed >= max_missed_pings) {
+                        missed = 0;
+                        sp->link_lost();
+                    }
                 }
             }
         });
@@ -199,9 +358,36 @@ namespace telegraph {
 
     void
     device::destroy(io::yield_ctx& ctx) {
+        closing_ = true;
+        stop_reader();
         local_context::destroy(ctx);
         port_.close();
         adapters_.clear();
+        if (recorder_) recorder_->flush();
+    }
+
+    params_stream_ptr
+    device::request(io::yield_ctx&, const params& p) {
+        if (!p.is_object()) return nullptr;
+        const auto& m = p.to_map();
+        auto it = m.find("type");
+        if (it == m.end() || !it->second.is_str() ||
+                it->second.get<std::string>() != "latency") return nullptr;
+
+        // round trips in microseconds
+        params obj = params::object();
+        obj["count"] = params{(float) rtt_.count()};
+        obj["min"] = params{(float) rtt_.min()};
+        obj["mean"] = params{(float) rtt_.mean()};
+        obj["p50"] = params{(float) rtt_.percentile(0.5)};
+        obj["p99"] = params{(float) rtt_.percentile(0.99)};
+        obj["max"] = params{(float) rtt_.max()};
+        if (bool_or(p, "reset", false)) rtt_.reset();
+
+        params_stream_ptr s = std::make_shared<params_stream>();
+        s->write(std::move(obj));
+        s->close();
+        return s;
     }
 
     bool
@@ -278,16 +464,14 @@ namespace telegraph {
         return node::unpack(res.node());
     }
 
-    subscription_ptr
-    device::subscribe(io::yield_ctx& yield, const variable* v,
-                        float min_interval, float max_interval, float timeout) {
-        // get the adapter for the variable
+    std::shared_ptr<adapter_base>
+    device::adapter_for(const variable* v) {
         node::id id = v->get_id();
         auto it = adapters_.find(id);
         if (it == adapters_.end()) {
             auto wp = std::weak_ptr<device>(shared_device_this());
             auto change = [wp, id](io::yield_ctx& yield, float debounce,
-                            float refresh, float timeout) -> bool {
+                            float refresh, const deadband& band, float timeout) -> bool {
                 // get a shared pointer to the device
                 // will be invalid if the device
                 // has been destroyed
@@ -303,15 +487,9 @@ namespace telegraph {
 
                 // put in the request
                 io::dispatch(sthis->port_.get_executor(),
-                        [sthis, req_id, id, debounce, refresh, timeout] () {
-                            stream::Packet p;
-                            p.set_req_id(req_id);
-                            stream::Subscribe* s = p.mutable_change_sub();
-                            s->set_var_id(id);
-                            s->set_sub_timeout((uint32_t) (1000*timeout));
-                            s->set_debounce((uint32_t) (1000*debounce));
-                            s->set_refresh((uint32_t) (1000*refresh));
-                            sthis->write_packet(std::move(p));
+                        [sthis, req_id, id, debounce, refresh, band, timeout] () {
+                            sthis->write_packet(make_change_sub(req_id, id,
+                                                    debounce, refresh, band, timeout));
                         });
                 // wait for response
                 boost::system::error_code ec;
@@ -382,24 +560,56 @@ namespace telegraph {
                 return true;
             };
             auto a = std::make_shared<adapter<decltype(poll), decltype(change), decltype(cancel)>>(
-                                ioc_, v->get_type(), poll, change, cancel);
-            adapters_.emplace(id, a);
+                                ioc_, wheel_, v->get_type(), poll, change, cancel);
+            it = adapters_.emplace(id, a).first;
         }
-        return adapters_.at(id)->subscribe(yield,
-                    min_interval, max_interval, timeout);
+        return it->second;
+    }
+
+    subscription_ptr
+    device::subscribe(io::yield_ctx& yield, const variable* v,
+                        float min_interval, float max_interval, float timeout) {
+        return adapter_for(v)->subscribe(yield, min_interval, max_interval,
+                                            deadband{}, timeout);
+    }
+
+    subscription_ptr
+    device::subscribe(io::yield_ctx& yield, const std::vector<std::string_view>& path,
+                        float min_interval, float max_interval,
+                        const deadband& band, float timeout) {
+        auto v = dynamic_cast<variable*>(tree_->from_path(path));
+        if (!v) return nullptr;
+        return adapter_for(v)->subscribe(yield, min_interval, max_interval,
+                                            band, timeout);
+    }
+
+    recording_tap_ptr
+    device::tap(io::yield_ctx& yield, const variable* v, float timeout) {
+        return adapter_for(v)->tap(yield, timeout);
     }
 
     value
     device::call(io::yield_ctx& yield, action* a, value arg, float timeout) {
-        io::deadline_timer timer(ioc_,
-            boost::posix_time::milliseconds(1000));
+        if (!port_.is_open()) return value::invalid();
+        if (timeout <= 0) timeout = default_call_timeout;
+        auto deadline = boost::posix_time::microsec_clock::universal_time() +
+                        boost::posix_time::microseconds((int64_t) (timeout*1e6));
+        if (!acquire_call_slot(yield, deadline)) return value::invalid();
+
+        io::deadline_timer timer(ioc_, deadline);
         uint32_t req_id = req_id_++;
         stream::Packet res;
-        reqs_.emplace(req_id, req(&timer, &res));
+        reqs_.emplace(req_id, req(&timer, &res, true));
+
+        auto sthis = shared_device_this();
+        io::dispatch(port_.get_executor(),
+                [sthis, req_id, id = a->get_id(), arg, timeout] () {
+                    sthis->write_packet(make_call(req_id, id, arg, timeout));
+                });
 
         boost::system::error_code ec;
         timer.async_wait(yield.ctx[ec]);
-        reqs_.erase(req_id);
+        finish_call(req_id);
         if (ec != io::error::operation_aborted) {
             return value::invalid();
         }
@@ -409,11 +619,226 @@ namespace telegraph {
         return value::unpack(res.call_completed());
     }
 
+    std::vector<value>
+    device::call_many(io::yield_ctx& yield,
+            const std::vector<std::pair<action*, value>>& calls, float timeout) {
+        std::vector<value> results(calls.size(), value::invalid());
+        if (!port_.is_open() || calls.empty()) return results;
+        if (timeout <= 0) timeout = default_call_timeout;
+        auto deadline = boost::posix_time::microsec_clock::universal_time() +
+                        boost::posix_time::microseconds((int64_t) (timeout*1e6));
+
+        struct pending {
+            uint32_t req_id;
+            io::deadline_timer timer;
+            stream::Packet res;
+            pending(io::io_context& ioc, uint32_t id, const boost::posix_time::ptime& deadline)
+                : req_id(id), timer(ioc, deadline), res() {}
+        };
+        std::vector<std::unique_ptr<pending>> waiting;
+        waiting.reserve(calls.size());
+
+        auto sthis = shared_device_this();
+        size_t next = 0;
+        while (next < calls.size()) {
+            // everything the window has room for goes out in one write,
+            // the rest once earlier calls have been answered
+            if (!acquire_call_slot(yield, deadline)) break;
+            std::vector<stream::Packet> packets;
+            do {
+                auto r = std::make_unique<pending>(ioc_, req_id_++, deadline);
+                reqs_.emplace(r->req_id, req(&r->timer, &r->res, true));
+                const auto& c = calls[next++];
+                packets.push_back(make_call(r->req_id, c.first->get_id(), c.second, timeout));
+                waiting.push_back(std::move(r));
+            } while (next < calls.size() && try_acquire_call_slot());
+
+            io::dispatch(port_.get_executor(), [sthis, p = std::move(packets)] () mutable {
+                sthis->write_packets(std::move(p));
+            });
+        }
+
+        for (size_t i = 0; i < waiting.size(); i++) {
+            auto& r = waiting[i];
+            // the response may have already arrived
+            if (r->res.event_case() == stream::Packet::EVENT_NOT_SET) {
+                boost::system::error_code ec;
+                r->timer.async_wait(yield.ctx[ec]);
+            }
+            finish_call(r->req_id);
+            if (r->res.event_case() == stream::Packet::kCallCompleted) {
+                results[i] = value::unpack(r->res.call_completed());
+            }
+        }
+        return results;
+    }
+
+    bool
+    device::try_acquire_call_slot() {
+        if (calls_in_flight_ >= call_window_ || !call_waiters_.empty()) return false;
+        calls_in_flight_++;
+        return true;
+    }
+
+    bool
+    device::acquire_call_slot(io::yield_ctx& yield,
+                    const boost::posix_time::ptime& deadline) {
+        if (try_acquire_call_slot()) return true;
+        call_waiter w(ioc_);
+        w.timer.expires_at(deadline);
+        call_waiters_.push_back(&w);
+        boost::system::error_code ec;
+        w.timer.async_wait(yield.ctx[ec]);
+        if (w.granted) return true;
+        call_waiters_.erase(std::find(call_waiters_.begin(), call_waiters_.end(), &w));
+        return false;
+    }
+
+    void
+    device::release_call_slot() {
+        if (call_waiters_.empty()) {
+            if (calls_in_flight_ > 0) calls_in_flight_--;
+            return;
+        }
+        // the slot goes straight to the next call
+        call_waiter* w = call_waiters_.front();
+        call_waiters_.pop_front();
+        w->granted = true;
+        w->timer.cancel();
+    }
+
+    void
+    device::finish_call(uint32_t req_id) {
+        auto it = reqs_.find(req_id);
+        if (it == reqs_.end()) return;
+        bool unanswered = it->second.call;
+        reqs_.erase(it);
+        if (unanswered) release_call_slot();
+    }
+
+    data_query_ptr
+    device::query_data(io::yield_ctx& yield, const variable* v, float timeout) {
+        node::id id = v->get_id();
+        auto it = captures_.find(id);
+        if (it == captures_.end()) {
+            it = captures_.emplace(id, std::make_shared<capture_data>()).first;
+        }
+        return it->second;
+    }
+
+    void
+    device::configure_port() {
+#if defined(__linux__) && !defined(__ANDROID__)
+        int fd = port_.native_handle();
+        if (serial_.low_latency) {
+            // not every driver has it (ptys don't), that's fine
+            serial_struct ss;
+            if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+                ss.flags |= ASYNC_LOW_LATENCY;
+                ioctl(fd, TIOCSSERIAL, &ss);
+            }
+        }
+        if (serial_.reader_thread) {
+            termios t;
+            if (tcgetattr(fd, &t) == 0) {
+                t.c_cc[VMIN] = (cc_t) serial_.vmin;
+                t.c_cc[VTIME] = (cc_t) serial_.vtime;
+                tcsetattr(fd, TCSANOW, &t);
+            }
+        }
+#endif
+    }
+
+    void
+    device::start_reading() {
+        auto sthis = shared_device_this();
+#if defined(__linux__) && !defined(__ANDROID__)
+        if (serial_.reader_thread) {
+            // a descriptor of its own, so that it can block
+            // while the port stays non-blocking for the writes
+            int fd = ::open(port_name_.c_str(), O_RDONLY | O_NOCTTY |
+                                (serial_.busy_poll ? O_NONBLOCK : 0));
+            int stop_fd = fd >= 0 ? eventfd(0, EFD_CLOEXEC) : -1;
+            if (stop_fd >= 0) {
+                reader_ = std::make_unique<reader_thread>();
+                reader_->fd = fd;
+                reader_->stop_fd = stop_fd;
+                reader_thread* r = reader_.get();
+                std::weak_ptr<device> weak{sthis};
+                io::io_context& ioc = ioc_;
+                uint64_t gen = reader_gen_;
+                bool busy = serial_.busy_poll;
+                size_t chunk = serial_.read_chunk;
+                auto deliver = [weak, gen] (std::string&& data, boost::system::error_code ec) {
+                    auto s = weak.lock();
+                    if (!s || s->reader_gen_ != gen) return;
+                    s->read_buf_.sputn(data.data(), (std::streamsize) data.size());
+                    s->on_read(ec, data.size());
+                };
+                r->thread = std::thread([r, &ioc, deliver, busy, chunk] () {
+                    std::string buf(chunk, '\0');
+                    pollfd fds[2] = {{r->fd, POLLIN, 0}, {r->stop_fd, POLLIN, 0}};
+                    while (!r->stop.load(std::memory_order_relaxed)) {
+                        if (!busy && ::poll(fds, 2, -1) < 0 && errno != EINTR) break;
+                        if (fds[1].revents) break;
+                        ssize_t n = ::read(r->fd, &buf[0], buf.size());
+                        if (n > 0) {
+                            io::post(ioc, [deliver, d = std::string(buf.data(), (size_t) n)] () mutable {
+                                deliver(std::move(d), boost::system::error_code{});
+                            });
+                        } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                            boost::system::error_code ec{errno, boost::system::system_category()};
+                            io::post(ioc, [deliver, ec] () { deliver(std::string{}, ec); });
+                            break;
+                        }
+                    }
+                });
+                return;
+            }
+            if (fd >= 0) ::close(fd);
+            std::cerr << "unable to start a reader thread for " << port_name_ << std::endl;
+        }
+#endif
+        io::dispatch(port_.get_executor(), [sthis] () { sthis->do_reading(0); });
+    }
+
+    void
+    device::stop_reader() {
+#if defined(__linux__) && !defined(__ANDROID__)
+        if (!reader_) return;
+        reader_->stop = true;
+        uint64_t one = 1;
+        ssize_t w = ::write(reader_->stop_fd, &one, sizeof(one));
+        (void) w;
+        if (reader_->thread.joinable()) reader_->thread.join();
+        ::close(reader_->fd);
+        ::close(reader_->stop_fd);
+        reader_.reset();
+        reader_gen_++;
+#endif
+    }
+
     void
     device::do_reading(size_t requested) {
+        // the reader thread feeds on_read itself
+        if (reader_) return;
         auto shared = shared_device_this();
         std::weak_ptr<device> weak{shared};
-        if (requested > 0) {
+        if (ring_ && !ring_buf_) ring_buf_ = ring_->acquire_buffer();
+        if (ring_buf_) {
+            // the framing copes with partial reads, so the
+            // ring always reads whatever is available
+            auto b = ring_buf_;
+            ring_read_ = ring_->read_some(port_.native_handle(), b,
+                [weak, b] (const boost::system::error_code& ec, size_t transferred) {
+                    auto s = weak.lock();
+                    if (!s) return;
+                    s->read_buf_.sputn(reinterpret_cast<const char*>(b->data()),
+                                        (std::streamsize) transferred);
+                    // nothing read is the port going away
+                    s->on_read(ec || transferred ? ec : io::error::eof, transferred);
+                });
+        } else if (requested > 0) {
             io::async_read(port_, read_buf_, boost::asio::transfer_exactly(requested),
                     [weak] (const boost::system::error_code& ec, size_t transferred) {
                         auto s = weak.lock();
@@ -421,90 +846,107 @@ namespace telegraph {
                         s->on_read(ec, transferred);
                     });
         } else {
-            // if bytes is 0 we just try and read some
-            io::async_read(port_, read_buf_, boost::asio::transfer_at_least(1),
+            // if bytes is 0 we just read whatever is there, up to a chunk
+            port_.async_read_some(read_buf_.prepare(serial_.read_chunk),
                 [weak] (const boost::system::error_code& ec, size_t transferred) {
                     auto s = weak.lock();
                     if (!s) return;
+                    s->read_buf_.commit(transferred);
                     s->on_read(ec, transferred);
                 });
         }
     }
+
     void
     device::on_read(const boost::system::error_code& ec, size_t transferred) {
-        if (ec) return; // on error cancel the reading loop
-        if (!decoding_) {
-            // consume bytes from the input sequence until we hit two 'S's
-            int c = 0;
-            do {
-                c = read_buf_.sbumpc();
-                if (c == 'S' && !one_start_)  {
-                    one_start_ = true;
-                } else if (c == 'S' && one_start_) {
-                    one_start_ = false;
-                    decoding_ = true;
-                    break;
-                } else {
-                    one_start_ = false;
-                }
-            } while (c != EOF);
+        if (ec) {
+            // aborted reads come from closing the port ourselves
+            if (ec != io::error::operation_aborted) link_lost();
+            return;
         }
-        if (decoding_) {
+        // a read can hold several frames, handle all of them
+        while (true) {
+            if (!decoding_) {
+                // consume bytes from the input sequence until we hit two 'S's
+                int c = 0;
+                do {
+                    c = read_buf_.sbumpc();
+                    if (c == 'S' && !one_start_)  {
+                        one_start_ = true;
+                    } else if (c == 'S' && one_start_) {
+                        one_start_ = false;
+                        decoding_ = true;
+                        break;
+                    } else {
+                        one_start_ = false;
+                    }
+                } while (c != EOF);
+            }
+            if (!decoding_) break;
             // we hit a message and are decoding the payload
             decodebuf db(&read_buf_);
             // read from db into the write buffer
             std::ostream os(&decode_buf_);
             os << &db;
-            if (db.finished()) {
-                decoding_ = false;
-                if (decode_buf_.size() < 4) {
-                    std::cout << "bad length" << std::endl;
-                    decode_buf_.consume(decode_buf_.size());
-                    do_reading(0);
-                    return;
-                }
-
-                // get the crc from the decoded buffer
-                auto buf = decode_buf_.data();
-                auto payload_start = io::buffers_begin(buf);
-                auto payload_end = io::buffers_begin(buf) + decode_buf_.size() - 4;
-                uint32_t crc_expected = crc::crc32_buffers(payload_start, payload_end);
-                uint32_t crc_actual = 0;
-                crc_actual |= (uint32_t) ((uint8_t) *(payload_end));       payload_end++;
-                crc_actual |= (uint32_t) ((uint8_t) *(payload_end)) << 8;  payload_end++;
-                crc_actual |= (uint32_t) ((uint8_t) *(payload_end)) << 16; payload_end++;
-                crc_actual |= (uint32_t) ((uint8_t) *(payload_end)) << 24; payload_end++;
-                if (crc_actual != crc_expected) {
-                    std::cout << "bad crc" << std::endl;
-                    decode_buf_.consume(decode_buf_.size());
-                    do_reading(0);
-                    return;
-                }
+            if (!db.finished()) break;
+            decoding_ = false;
+            on_frame();
+            // consume any leftover bytes
+            decode_buf_.consume(decode_buf_.size());
+        }
+        // read some more
+        do_reading(0);
+    }
 
-                // decode the payload
-                std::istream input_stream(&decode_buf_);
-                google::protobuf::io::IstreamInputStream iss{&input_stream};
-                google::protobuf::io::CodedInputStream input{&iss};
-                input.PushLimit(decode_buf_.size() - 4);
+    void
+    device::on_frame() {
+        if (decode_buf_.size() < 4) {
+            std::cout << "bad length" << std::endl;
+            return;
+        }
 
-                stream::Packet packet;
-                packet.ParseFromCodedStream(&input);
-                on_read(std::move(packet));
+        // get the crc from the decoded buffer
+        auto buf = decode_buf_.data();
+        auto payload_start = io::buffers_begin(buf);
+        auto payload_end = io::buffers_begin(buf) + decode_buf_.size() - 4;
+        uint32_t crc_expected = crc::crc32_buffers(payload_start, payload_end);
+        uint32_t crc_actual = 0;
+        crc_actual |= (uint32_t) ((uint8_t) *(payload_end));       payload_end++;
+        crc_actual |= (uint32_t) ((uint8_t) *(payload_end)) << 8;  payload_end++;
+        crc_actual |= (uint32_t) ((uint8_t) *(payload_end)) << 16; payload_end++;
+        crc_actual |= (uint32_t) ((uint8_t) *(payload_end)) << 24; payload_end++;
+        if (crc_actual != crc_expected) {
+            std::cout << "bad crc" << std::endl;
+            return;
+        }
+        if (recorder_) {
+            recorder_->record(std::chrono::system_clock::now(),
+                static_cast<const uint8_t*>(decode_buf_.data().data()),
+                decode_buf_.size() - 4);
+        }
 
-                // consume any leftover bytes
-                decode_buf_.consume(decode_buf_.size());
-            }
+        // decode the payload in place, without the crc
+        stream::Packet packet;
+        if (!packet.ParseFromArray(decode_buf_.data().data(), (int) decode_buf_.size() - 4)) {
+            std::cout << "bad packet" << std::endl;
+            return;
         }
-        // read some more
-        do_reading(0);
+        on_read(std::move(packet));
     }
 
     void
     device::do_write_next() {
-        // grab the front of the write queue
-        auto p = std::move(write_queue_.front());
-        write_queue_.pop_front();
-        {
+        // the ring may have written only part of the last batch
+        if (write_queue_.empty() && write_buf_.size() == 0) {
+            writing_ = false;
+            return;
+        }
+        writing_ = true;
+        // encode everything queued so far into a single write
+        while (!write_queue_.empty()) {
+            auto p = std::move(write_queue_.front());
+            write_queue_.pop_front();
+
             std::ostream raw(&write_buf_);
             raw.put('S');
             raw.put('S');
@@ -549,24 +991,171 @@ namespace telegraph {
         */
 
         auto shared = shared_device_this();
-        io::async_write(port_, write_buf_.data(),
-            [shared] (const boost::system::error_code& ec, size_t transferred) {
-                if (ec) return;
-                shared->write_buf_.consume(transferred);
-                // if there are more messages, queue another write
-                if (shared->write_queue_.size() > 0)
-                    shared->do_write_next();
-            });
+        auto written = [shared] (const boost::system::error_code& ec, size_t transferred) {
+            shared->on_written(ec, transferred);
+        };
+        if (ring_) {
+            ring_write_ = ring_->write_some(port_.native_handle(),
+                        {io::const_buffer(write_buf_.data())}, written);
+        } else {
+            io::async_write(port_, write_buf_.data(), written);
+        }
+    }
+
+    void
+    device::on_written(const boost::system::error_code& ec, size_t transferred) {
+        if (ec) {
+            // the write state is reset when the port is closed
+            if (ec != io::error::operation_aborted) link_lost();
+            return;
+        }
+        write_buf_.consume(transferred);
+        // if there are more messages, queue another write
+        do_write_next();
     }
 
     void
     device::write_packet(stream::Packet&& p) {
+        // drop writes while the link is down
+        if (!port_.is_open()) return;
         write_queue_.emplace_back(std::move(p));
         // if there is a write chain active
-        if (write_queue_.size() > 1) return;
+        if (writing_) return;
         do_write_next();
     }
 
+    void
+    device::write_packets(std::vector<stream::Packet>&& packets) {
+        if (!port_.is_open()) return;
+        for (auto& p : packets) write_queue_.emplace_back(std::move(p));
+        if (writing_) return;
+        do_write_next();
+    }
+
+    void
+    device::link_lost() {
+        if (reconnecting_ || closing_) return;
+        reconnecting_ = true;
+        std::cout << "lost link to " << port_name_ << ", reconnecting" << std::endl;
+        close_port();
+
+        auto wp = weak_device_this();
+        io::io_context& ioc = ioc_;
+        io::spawn(ioc_, [&ioc, wp](io::yield_context yield) {
+            io::yield_ctx ctx{yield};
+            io::deadline_timer timer{ioc};
+            int backoff = reconnect_min_ms;
+            while (true) {
+                timer.expires_from_now(boost::posix_time::milliseconds(backoff));
+                timer.async_wait(yield);
+                auto sp = wp.lock();
+                if (!sp || sp->closing_) break;
+                if (sp->reattach(ctx)) break;
+                backoff = std::min(2*backoff, reconnect_max_ms);
+            }
+        });
+    }
+
+    void
+    device::close_port() {
+        stop_reader();
+        if (ring_) {
+            ring_->cancel(ring_read_);
+            ring_->cancel(ring_write_);
+            // the buffer goes back once the cancelled read is done
+            ring_buf_.reset();
+        }
+        boost::system::error_code ec;
+        port_.close(ec);
+        // reset the framing state
+        one_start_ = false;
+        decoding_ = false;
+        read_buf_.consume(read_buf_.size());
+        decode_buf_.consume(decode_buf_.size());
+        write_queue_.clear();
+        write_buf_.consume(write_buf_.size());
+        writing_ = false;
+        // outstanding requests see an empty response and fail
+        for (auto& r : reqs_) {
+            if (r.second.timer) r.second.timer->cancel();
+        }
+    }
+
+    bool
+    device::reattach(io::yield_ctx& yield) {
+        boost::system::error_code ec;
+        port_.open(port_name_, ec);
+        if (ec) return false;
+        port_.set_option(io::serial_port::baud_rate(baud_), ec);
+        if (ec) {
+            close_port();
+            return false;
+        }
+        configure_port();
+        start_reading();
+
+        std::unique_ptr<node> root;
+        if (ping(yield, true, 50)) root.reset(fetch_node(yield, 0));
+        if (!root) {
+            close_port();
+            return false;
+        }
+        if (!same_root(tree_.get(), root.get())) {
+            // subscriptions can't be resumed against a different tree
+            std::cout << "device on " << port_name_ << " changed, removing" << std::endl;
+            reconnecting_ = false;
+            destroy(yield);
+            return true;
+        }
+        reconnecting_ = false;
+        std::cout << "reconnected to " << port_name_ << std::endl;
+        resubscribe(yield);
+        return true;
+    }
+
+    void
+    device::resubscribe(io::yield_ctx& yield) {
+        struct pending {
+            uint32_t req_id;
+            io::deadline_timer timer;
+            stream::Packet res;
+            pending(io::io_context& ioc, uint32_t id)
+                : req_id(id), timer(ioc, boost::posix_time::milliseconds(1000)), res() {}
+        };
+        std::vector<std::unique_ptr<pending>> waiting;
+        std::vector<stream::Packet> packets;
+        for (auto& a : adapters_) {
+            if (!a.second->is_subscribed()) continue;
+            auto r = std::make_unique<pending>(ioc_, req_id_++);
+            reqs_.emplace(r->req_id, req(&r->timer, &r->res));
+            packets.push_back(make_change_sub(r->req_id, a.first,
+                        a.second->get_debounce(), a.second->get_refresh(),
+                        a.second->get_deadband(), 1));
+            waiting.push_back(std::move(r));
+        }
+        if (packets.empty()) return;
+
+        auto sthis = shared_device_this();
+        io::dispatch(port_.get_executor(), [sthis, p = std::move(packets)] () mutable {
+            sthis->write_packets(std::move(p));
+        });
+
+        size_t failed = 0;
+        for (auto& r : waiting) {
+            // the response may have already arrived
+            if (r->res.event_case() == stream::Packet::EVENT_NOT_SET) {
+                boost::system::error_code ec;
+                r->timer.async_wait(yield.ctx[ec]);
+            }
+            reqs_.erase(r->req_id);
+            if (!r->res.success()) failed++;
+        }
+        if (failed > 0) {
+            std::cout << "failed to resume " << failed << " subscriptions on "
+                      << port_name_ << std::endl;
+        }
+    }
+
     void
     device::on_read(stream::Packet&& p) {
         if (p.has_update()) {
@@ -574,13 +1163,55 @@ namespace telegraph {
             node::id var_id = (node::id) p.req_id();
             auto it = adapters_.find(var_id);
             if (it == adapters_.end()) return;
-            else it->second->update(value::unpack(p.update()));
+            if (p.update().has_block()) {
+                // blocks are stamped with the device clock, rebase them
+                // assuming the block was sent right after its last sample
+                Block* b = p.mutable_update()->mutable_block();
+                uint64_t now = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+                uint64_t span = (uint64_t) b->period() * (b->count() > 0 ? b->count() - 1 : 0);
+                b->set_start(now - std::min(now, span));
+            }
+            it->second->update(value::unpack(p.update()));
+        } else if (p.has_capture()) {
+            // captures use the var_id in the req_id like updates
+            node::id var_id = (node::id) p.req_id();
+            const stream::Capture& c = p.capture();
+            // rebase onto our clock using the age of the last sample
+            Block* s = p.mutable_capture()->mutable_samples();
+            uint64_t now = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            uint64_t span = (uint64_t) s->period() * (s->count() > 0 ? s->count() - 1 : 0)
+                                + (uint64_t) c.age() * 1000;
+            s->set_start(now - std::min(now, span));
+            auto b = block::unpack(*s);
+            // recordings of the variable (i.e an archive) get
+            // every sample at its own time, after the live updates
+            auto ait = adapters_.find(var_id);
+            if (ait != adapters_.end()) {
+                ait->second->backfill(datapoint_batch::from_block(*b));
+            }
+            // the datapoint is stamped with the trigger
+            time_point trigger{std::chrono::microseconds{b->get_start() +
+                                (uint64_t) b->get_period() * c.trigger_index()}};
+            auto it = captures_.find(var_id);
+            if (it == captures_.end()) {
+                it = captures_.emplace(var_id, std::make_shared<capture_data>()).first;
+            }
+            it->second->write(datapoint{trigger, value{b}});
         } else {
             // look at the req_id
             uint32_t req_id = p.req_id();
             if (reqs_.find(req_id) != reqs_.end()) {
                 auto& r = reqs_.at(req_id);
+                rtt_.add(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - r.sent).count());
                 if (r.timer) r.timer->cancel();
+                // the answered call makes room for the next one
+                if (r.call) {
+                    r.call = false;
+                    release_call_slot();
+                }
                 if (r.packet) *r.packet = std::move(p);
             }
         }
@@ -592,8 +1223,166 @@ namespace telegraph {
             const params& p) {
         int baud = (int) p.at("baud").get<float>();
         const std::string& port = p.at("port").get<std::string>();
-        auto s = std::make_shared<device>(ioc, std::string{name}, port, baud);
+        const auto& m = p.to_map();
+        auto lit = m.find("low_latency");
+        serial_options opts = lit != m.end() ? serial_options::parse(lit->second) : serial_options{};
+        auto s = std::make_shared<device>(ioc, std::string{name}, port, baud, opts);
+        s->call_window_ = (size_t) std::max(1.0f, num_or(p, "call_window", default_call_window));
         s->init(yield, 500);
+        auto rit = m.find("record");
+        if (rit != m.end() && rit->second.is_object()) {
+            const auto& r = rit->second.to_map();
+            flight_recorder::options rec_opts;
+            auto it = r.find("dir");
+            if (it == r.end() || !it->second.is_str()) throw parse_error("record needs a dir");
+            rec_opts.dir = it->second.get<std::string>();
+            it = r.find("segments");
+            if (it != r.end() && it->second.is_num()) rec_opts.segments = (size_t) it->second.get<float>();
+            it = r.find("segment_size");
+            if (it != r.end() && it->second.is_num()) rec_opts.segment_size = (size_t) it->second.get<float>();
+            it = r.find("direct");
+            if (it != r.end() && it->second.is_bool()) rec_opts.direct = it->second.get<bool>();
+            it = r.find("flush_interval");
+            if (it != r.end() && it->second.is_num()) rec_opts.flush_interval = it->second.get<float>();
+            s->recorder_ = std::make_shared<flight_recorder>(ioc, std::string{name}, rec_opts, *s->tree_);
+        }
+        return s;
+    }
+
+    device_replay::device_replay(io::io_context& ioc, const std::string& name, const params& p,
+                        std::unique_ptr<flight_recorder::reader>&& reader,
+                        float speed, bool loop)
+            : device(ioc, name, "device_replay", p),
+              reader_(std::move(reader)), speed_(speed), loop_(loop), stopped_(false) {}
+
+    void
+    device_replay::destroy(io::yield_ctx& yield) {
+        stopped_ = true;
+        device::destroy(yield);
+    }
+
+    void
+    device_replay::write_packet(stream::Packet&& p) {
+        // there is no device, so answer for it
+        stream::Packet res;
+        res.set_req_id(p.req_id());
+        if (p.has_change_sub() || p.has_cancel_sub()) res.set_success(true);
+        else if (p.has_ping()) res.set_pong(0);
+        else if (p.has_call_action()) res.mutable_call_failed();
+        else return;
+        // not inline, the requester has yet to wait for the response
+        auto sthis = std::static_pointer_cast<device_replay>(shared_from_this());
+        io::post(ioc_, [sthis, res = std::move(res)] () mutable {
+            sthis->on_read(std::move(res));
+        });
+    }
+
+    void
+    device_replay::write_packets(std::vector<stream::Packet>&& packets) {
+        for (auto& p : packets) write_packet(std::move(p));
+    }
+
+    void
+    device_replay::start() {
+        std::weak_ptr<device_replay> wp =
+            std::static_pointer_cast<device_replay>(shared_from_this());
+        io::io_context& ioc = ioc_;
+        io::spawn(ioc_, [&ioc, wp](io::yield_context yield) {
+            io::deadline_timer timer{ioc};
+            flight_recorder::entry r;
+            // recording time which corresponds to base
+            int64_t base_ts = 0;
+            auto base = std::chrono::steady_clock::now();
+            size_t since_yield = 0;
+            while (true) {
+                int64_t wait_us = 0;
+                {
+                    auto sp = wp.lock();
+                    if (!sp || sp->stopped_) break;
+                    if (!sp->reader_->next(r)) {
+                        if (!sp->loop_) break;
+                        sp->reader_->rewind();
+                        if (!sp->reader_->next(r)) break;
+                    }
+                    if (r.type == flight_recorder::Tree) {
+                        // a new segment, which might be from a later run
+                        base_ts = r.timestamp;
+                        base = std::chrono::steady_clock::now();
+                        continue;
+                    }
+                    stream::Packet p;
+                    if (r.type != flight_recorder::Frame ||
+                            !p.ParseFromArray(r.payload.data(), (int) r.payload.size())) continue;
+                    // the recorded req_ids mean nothing to our requests
+                    if (!p.has_update() && !p.has_capture()) continue;
+                    if (sp->speed_ > 0) {
+                        auto due = base + std::chrono::microseconds(
+                                    (int64_t) ((r.timestamp - base_ts) / sp->speed_));
+                        wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                    due - std::chrono::steady_clock::now()).count();
+                    }
+                    if (wait_us <= 0) sp->on_read(std::move(p));
+                    else {
+                        // deliver after the wait
+                        timer.expires_from_now(boost::posix_time::microseconds(wait_us));
+                        sp.reset();
+                        boost::system::error_code ec;
+                        timer.async_wait(yield[ec]);
+                        sp = wp.lock();
+                        if (!sp || sp->stopped_) break;
+                        sp->on_read(std::move(p));
+                        since_yield = 0;
+                        continue;
+                    }
+                }
+                // let everything else run now and then
+                if (++since_yield >= 256) {
+                    since_yield = 0;
+                    timer.expires_from_now(boost::posix_time::microseconds(0));
+                    boost::system::error_code ec;
+                    timer.async_wait(yield[ec]);
+                }
+            }
+        });
+    }
+
+    local_context_ptr
+    device_replay::create(io::yield_ctx&, io::io_context& ioc,
+            const std::string_view& name, const std::string_view& type,
+            const params& p) {
+        const auto& m = p.to_map();
+        auto it = m.find("dir");
+        if (it == m.end() || !it->second.is_str()) throw parse_error("device_replay needs a dir");
+        std::string dir = it->second.get<std::string>();
+        std::string recorded{name};
+        it = m.find("name");
+        if (it != m.end() && it->second.is_str()) recorded = it->second.get<std::string>();
+        float speed = 1;
+        it = m.find("speed");
+        if (it != m.end() && it->second.is_num()) speed = it->second.get<float>();
+        bool loop = false;
+        it = m.find("loop");
+        if (it != m.end() && it->second.is_bool()) loop = it->second.get<bool>();
+
+        auto reader = std::make_unique<flight_recorder::reader>(dir, recorded);
+        // the tree comes first in every segment
+        flight_recorder::entry r;
+        std::unique_ptr<node> root;
+        while (!root && reader->next(r)) {
+            if (r.type != flight_recorder::Tree) continue;
+            log::LogEvent e;
+            if (e.ParseFromArray(r.payload.data(), (int) r.payload.size()) && e.has_root()) {
+                root.reset(node::unpack(e.root()));
+            }
+        }
+        if (!root) throw io_error("no recording of " + recorded + " in " + dir);
+        reader->rewind();
+
+        auto s = std::make_shared<device_replay>(ioc, std::string{name}, p,
+                                        std::move(reader), speed, loop);
+        s->tree_ = std::shared_ptr<node>(root.release());
+        s->tree_->set_owner(s);
+        s->start();
         return s;
     }
 
@@ -618,6 +1407,22 @@ namespace telegraph {
         return ports;
     }
 
+    // the /dev/serial/by-id name of every port which has one
+    static std::unordered_map<std::string, std::string> by_id_names() {
+        std::unordered_map<std::string, std::string> names;
+#if defined(__linux__) && !defined(__ANDROID__)
+        std::error_code ec;
+        fs::path dir{"/dev/serial/by-id"};
+        if (!fs::is_directory(dir, ec)) return names;
+        for (fs::directory_iterator it{dir, ec}, end; !ec && it != end; it.increment(ec)) {
+            fs::path target = fs::canonical(it->path(), ec);
+            if (ec) continue;
+            names[target.string()] = it->path().filename().string();
+        }
+#endif
+        return names;
+    }
+
     static params to_params(const std::vector<std::string>& p) {
         std::vector<params> par;
         for (const std::string& s : p) {
@@ -626,49 +1431,178 @@ namespace telegraph {
         return params{std::move(par)};
     }
 
-    device_scanner::device_scanner(io::io_context& ioc, const std::string_view& name)
-            : local_component(ioc, name, "device_scanner", params()),
-                    requests_() {
+    device_scanner::device_scanner(io::io_context& ioc, const std::string_view& name,
+                                    const params& p)
+            : local_component(ioc, name, "device_scanner", p),
+                    requests_(), last_devices_(), events_(), by_id_watch_(-1),
+                    auto_create_(false), match_(), baud_(115200), created_() {
+        if (!p.is_object()) return;
+        const auto& m = p.to_map();
+        auto it = m.find("auto_create");
+        if (it == m.end() || !it->second.is_object()) return;
+        auto_create_ = true;
+        const auto& ac = it->second.to_map();
+        auto mit = ac.find("match");
+        if (mit != ac.end() && mit->second.is_str()) match_ = mit->second.get<std::string>();
+        auto bit = ac.find("baud");
+        if (bit != ac.end() && bit->second.is_num()) baud_ = (int) bit->second.get<float>();
+    }
+
+    bool
+    device_scanner::watch() {
+#if defined(__linux__) && !defined(__ANDROID__)
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return false;
+        // udev fixes up the permissions after the node is created
+        if (inotify_add_watch(fd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+            ::close(fd);
+            return false;
+        }
+        events_ = std::make_shared<io::posix::stream_descriptor>(ioc_, fd);
+        watch_by_id();
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void
+    device_scanner::watch_by_id() {
+#if defined(__linux__) && !defined(__ANDROID__)
+        // only exists while some serial device is plugged in
+        if (!events_ || by_id_watch_ >= 0) return;
+        by_id_watch_ = inotify_add_watch(events_->native_handle(), "/dev/serial/by-id",
+                                         IN_CREATE | IN_DELETE | IN_ONLYDIR);
+#endif
+    }
+
+    void
+    device_scanner::update_ports(io::yield_ctx& yield) {
+        std::vector<std::string> p = fetch_ports();
+        if (p == last_devices_) return;
+        std::vector<std::string> added;
+        for (const auto& port : p) {
+            if (std::find(last_devices_.begin(), last_devices_.end(), port)
+                    == last_devices_.end()) added.push_back(port);
+        }
+        last_devices_ = p;
+        // broadcast the ports to all parameter streams
+        params ports = to_params(last_devices_);
+        auto it = requests_.begin();
+        while (it != requests_.end()) {
+            auto ps = it->second.lock();
+            if (!ps || ps->is_closed()) {
+                it = requests_.erase(it);
+            } else {
+                ps->write(params{ports});
+                it++;
+            }
+        }
+        if (!auto_create_ || added.empty()) return;
+
+        auto names = by_id_names();
+        for (const auto& port : added) {
+            auto ns = ns_.lock();
+            if (!ns) return;
+            // a device which is still around reattaches on its own
+            auto cit = created_.find(port);
+            if (cit != created_.end()) {
+                auto c = cit->second.lock();
+                if (c && c->get_namespace()) continue;
+                created_.erase(cit);
+            }
+            auto nit = names.find(port);
+            const std::string& by_id = nit != names.end() ? nit->second : port;
+            if (!match_.empty() && port.find(match_) == std::string::npos &&
+                    by_id.find(match_) == std::string::npos) continue;
+
+            std::string name = fs::path{port}.filename().string();
+            params dp = params::object();
+            dp["port"] = params{port};
+            dp["baud"] = params{baud_};
+            try {
+                auto c = ns->create(yield, name, "device", dp);
+                if (c) created_[port] = c;
+            } catch (const std::exception& e) {
+                std::cerr << "unable to create device on " << port
+                          << ": " << e.what() << std::endl;
+            }
+        }
     }
 
     void
     device_scanner::init() {
         io::io_context& ioc = ioc_;
-        // start the device scanner thread...
         auto sp = std::static_pointer_cast<device_scanner>(shared_from_this());
         std::weak_ptr<device_scanner> wp{sp};
-        io::spawn(ioc_, [wp, &ioc](io::yield_context yield) {
+        if (!watch()) {
+            // start the device scanner thread...
+            io::spawn(ioc_, [wp, &ioc](io::yield_context yield) {
+                io::yield_ctx ctx{yield};
+                io::deadline_timer timer{ioc};
+                while (true) {
+                    timer.expires_from_now(boost::posix_time::seconds(2));
+                    timer.async_wait(yield);
+                    auto sp = wp.lock();
+                    if (!sp) break;
+                    sp->update_ports(ctx);
+                }
+            });
+            return;
+        }
+#if defined(__linux__) && !defined(__ANDROID__)
+        auto events = events_;
+        io::spawn(ioc_, [wp, events, &ioc](io::yield_context yield) {
             io::yield_ctx ctx{yield};
             io::deadline_timer timer{ioc};
+            // the initial listing, once registered
+            timer.expires_from_now(boost::posix_time::milliseconds(0));
+            timer.async_wait(yield);
+            {
+                auto sp = wp.lock();
+                if (!sp) return;
+                sp->update_ports(ctx);
+            }
+            alignas(inotify_event) char buf[4096];
             while (true) {
-                timer.expires_from_now(boost::posix_time::seconds(2));
-                timer.async_wait(yield);
-                {
-                    auto sp = wp.lock();
-                    if (!sp) break;
-                    std::vector<std::string> p = fetch_ports();
-                    if (p == sp->last_devices_) continue;
-                    sp->last_devices_ = p;
-                    // broadcast the ports to all parameter streams
-                    params ports = to_params(sp->last_devices_);
-                    auto it = sp->requests_.begin();
-                    while (it != sp->requests_.end()) {
-                        auto p = it->second;
-                        auto ps = p.lock();
-                        if (!ps || ps->is_closed()) {
-                            it = sp->requests_.erase(it);
-                        } else {
-                            ps->write(params{ports});
-                            it++;
-                        }
+                boost::system::error_code ec;
+                size_t n = events->async_read_some(io::buffer(buf), yield[ec]);
+                if (ec) return; // closed by the destructor
+                auto sp = wp.lock();
+                if (!sp) return;
+                bool relevant = false;
+                for (size_t i = 0; i + sizeof(inotify_event) <= n;) {
+                    auto e = reinterpret_cast<const inotify_event*>(buf + i);
+                    std::string_view file = e->len ? std::string_view{e->name} : std::string_view{};
+                    if (e->wd == sp->by_id_watch_) {
+                        relevant = true;
+                        if (e->mask & IN_IGNORED) sp->by_id_watch_ = -1;
+                    } else if (file.rfind("tty", 0) == 0 || file == "serial") {
+                        relevant = true;
                     }
+                    i += sizeof(inotify_event) + e->len;
                 }
+                sp->watch_by_id();
+                if (!relevant) continue;
+                sp.reset();
+
+                // let udev finish (permissions, by-id links)
+                // and handle a burst of events in one go
+                timer.expires_from_now(boost::posix_time::milliseconds(100));
+                timer.async_wait(yield);
+                sp = wp.lock();
+                if (!sp) return;
+                sp->update_ports(ctx);
             }
         });
-
+#endif
     }
 
     device_scanner::~device_scanner() {
+        if (events_) {
+            boost::system::error_code ec;
+            events_->close(ec);
+        }
         for (auto& wp : requests_) {
             auto sp = wp.second.lock();
             if (sp) sp->close();
@@ -701,7 +1635,7 @@ namespace telegraph {
     device_scanner::create(io::yield_ctx&, io::io_context& ioc,
             const std::string_view& name, const std::string_view& type,
             const params& p) {
-        auto sp = std::make_shared<device_scanner>(ioc, name);
+        auto sp = std::make_shared<device_scanner>(ioc, name, p);
         sp->init();
         return sp;
     }
@@ -2,20 +2,26 @@
 #define __TELEGRAPH_LOCAL_DEVICE_HPP__
 
 #include "namespace.hpp"
+#include "flight_recorder.hpp"
 
 #include "../common/params.hpp"
 #include "../common/adapter.hpp"
 #include "../common/nodes.hpp"
 
 #include "../utils/io_fwd.hpp"
+#include "../utils/uring.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <memory>
 #include <unordered_map>
 #include <deque>
+#include <vector>
 #include <iostream>
 
 #include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/asio/serial_port.hpp>
 #include <boost/asio/streambuf.hpp>
 
@@ -23,10 +29,86 @@
 
 namespace telegraph {
     class device_io_worker;
+
+    // triggered captures uploaded by a device,
+    // one block datapoint per capture
+    class capture_data : public data_query {
+    private:
+        datapoint_batch current_;
+    public:
+        void scan(const std::function<void(const datapoint_batch&)>& f) const override {
+            f(current_);
+        }
+        void write(datapoint&& d) {
+            current_.push_back(d);
+            data(datapoint_batch{d});
+        }
+    };
+
+    // how the port of a device is set up and read
+    struct serial_options {
+        // ASYNC_LOW_LATENCY on the port, usb-serial adapters
+        // then pass on every byte instead of on their latency timer
+        bool low_latency = false;
+        // bytes requested per read
+        size_t read_chunk = 512;
+        // read on a dedicated thread instead of the io_context
+        bool reader_thread = false;
+        // the reader thread spins on the port instead of blocking
+        // (one core at 100%, for the lowest latency)
+        bool busy_poll = false;
+        // termios VMIN/VTIME (in deciseconds) of the reader thread,
+        // which wakes up once VMIN bytes are in or VTIME passed after a byte
+        int vmin = 1;
+        int vtime = 0;
+
+        // low_latency: true, or {async_low_latency, read_chunk,
+        //                        thread, busy_poll, vmin, vtime}
+        static serial_options parse(const params& p);
+    };
+
+    // round-trip times of the requests to a device in microseconds,
+    // the percentiles are over the most recent ones
+    class rtt_stats {
+    public:
+        static constexpr size_t window = 1024;
+    private:
+        uint64_t count_;
+        int64_t min_;
+        int64_t max_;
+        int64_t sum_;
+        std::vector<int64_t> recent_;
+    public:
+        rtt_stats() : count_(0), min_(0), max_(0), sum_(0), recent_() {}
+
+        constexpr uint64_t count() const { return count_; }
+        constexpr int64_t min() const { return min_; }
+        constexpr int64_t max() const { return max_; }
+        double mean() const { return count_ ? (double) sum_ / count_ : 0; }
+        int64_t percentile(double q) const {
+            if (recent_.empty()) return 0;
+            std::vector<int64_t> s{recent_};
+            size_t i = std::min(s.size() - 1, (size_t) (q*s.size()));
+            std::nth_element(s.begin(), s.begin() + i, s.end());
+            return s[i];
+        }
+
+        void add(int64_t us) {
+            min_ = count_ ? std::min(min_, us) : us;
+            max_ = count_ ? std::max(max_, us) : us;
+            sum_ += us;
+            if (recent_.size() < window) recent_.push_back(us);
+            else recent_[count_ % window] = us;
+            count_++;
+        }
+        void reset() { *this = rtt_stats{}; }
+    };
+
     class device : public local_context {
     private:
         std::deque<stream::Packet> write_queue_;
         io::streambuf write_buf_;
+        bool writing_; // a write is in flight
         io::streambuf read_buf_;
 
         bool one_start_;
@@ -37,18 +119,53 @@ namespace telegraph {
         struct req {
             io::deadline_timer* timer;
             stream::Packet* packet;
-            constexpr req(io::deadline_timer* t, stream::Packet* p) 
-                : timer(t), packet(p) {}
+            std::chrono::steady_clock::time_point sent;
+            bool call; // holds a slot of the call window until answered
+            req(io::deadline_timer* t, stream::Packet* p, bool c = false) 
+                : timer(t), packet(p), sent(std::chrono::steady_clock::now()), call(c) {}
         };
 
         std::unordered_map<uint32_t, req> reqs_;
+        rtt_stats rtt_;
 
-        // subscription adapters
+        // calls outstanding on the link at once, the
+        // rest wait for a slot in the order they were made
+        size_t call_window_;
+        size_t calls_in_flight_;
+        struct call_waiter;
+        std::deque<call_waiter*> call_waiters_;
+
+        // subscription adapters, with their
+        // debounce timers sharing a single wheel
         std::unordered_map<node::id, std::shared_ptr<adapter_base>> adapters_;
+        timer_wheel_ptr wheel_;
+        // uploaded captures by variable
+        std::unordered_map<node::id, std::shared_ptr<capture_data>> captures_;
 
+        const std::string port_name_;
+        const int baud_;
         io::serial_port port_;
+        // null unless the io_uring backend is enabled,
+        // the port is then read and written through the ring
+        uring* ring_;
+        uring::buffer_ptr ring_buf_;
+        uint64_t ring_read_;
+        uint64_t ring_write_;
+        serial_options serial_;
+        // reads the port on its own thread if requested,
+        // the generation drops what a stopped one still posts
+        struct reader_thread;
+        std::unique_ptr<reader_thread> reader_;
+        uint64_t reader_gen_;
+        // the link was lost and the port is being reopened
+        bool reconnecting_;
+        bool closing_;
+
+        // null unless recording was requested
+        flight_recorder_ptr recorder_;
     public:
-        device(io::io_context& ioc, const std::string& name, const std::string& port, int baud);
+        device(io::io_context& ioc, const std::string& name, const std::string& port, int baud,
+                const serial_options& opts = serial_options{});
         ~device();
 
         // init should be called right after construction! (this is done by create)
@@ -58,13 +175,22 @@ namespace telegraph {
         bool ping(io::yield_ctx&, bool wait=true, int millisec_timeout=50);
         node* fetch_node(io::yield_ctx&, node::id id);
 
-        // no querying
-        params_stream_ptr request(io::yield_ctx&, const params& p) { return nullptr; }
+        constexpr bool is_reconnecting() const { return reconnecting_; }
+        const rtt_stats& round_trips() const { return rtt_; }
+
+        // {type: "latency", reset}: the request round-trip times
+        params_stream_ptr request(io::yield_ctx&, const params& p) override;
 
         subscription_ptr subscribe(io::yield_ctx& ctx, const variable* v,
                                 float min_interval, float max_interval, 
                                 float timeout) override;
+        recording_tap_ptr tap(io::yield_ctx& yield, const variable* v,
+                                float timeout) override;
         value call(io::yield_ctx& ctx, action* a, value v, float timeout);
+        // several calls written out together, as far as the call window allows,
+        // the results (invalid for failed calls) are in the order of the calls
+        std::vector<value> call_many(io::yield_ctx& ctx,
+                        const std::vector<std::pair<action*, value>>& calls, float timeout);
 
         void destroy(io::yield_ctx& ctx) override;
 
@@ -78,6 +204,11 @@ namespace telegraph {
             if (!v) return nullptr;
             return subscribe(ctx, v, min_interval, max_interval, timeout);
         }
+        // the dead-band goes out in the same change_sub as the rates
+        subscription_ptr subscribe(io::yield_ctx& ctx,
+                                const std::vector<std::string_view>& path,
+                                float min_interval, float max_interval,
+                                const deadband& band, float timeout) override;
 
         value call(io::yield_ctx& ctx, 
                         const std::vector<std::string_view>& path, 
@@ -89,20 +220,49 @@ namespace telegraph {
 
         // unimplemented context functions
         bool write_data(io::yield_ctx&, variable* v, 
-                const std::vector<datapoint>& d) override { return false; }
+                const datapoint_batch& d) override { return false; }
 
         bool write_data(io::yield_ctx&, 
                 const std::vector<std::string_view>& path, 
-                const std::vector<datapoint>& d) override { return false; }
+                const datapoint_batch& d) override { return false; }
 
+        // the triggered captures of a variable
         data_query_ptr query_data(io::yield_ctx& yield, 
-                                            const variable * n) override { return nullptr; }
+                                            const variable * n, float timeout) override;
         data_query_ptr query_data(io::yield_ctx& yield, 
-                                const std::vector<std::string_view>& p) override { return nullptr; }
+                                const std::vector<std::string_view>& p, float timeout) override {
+            auto v = dynamic_cast<variable*>(tree_->from_path(p));
+            if (!v) return nullptr;
+            return query_data(yield, v, timeout);
+        }
 
+        // params:
+        //  port, baud
+        //  low_latency: see serial_options
+        //  call_window: calls outstanding on the link at once (default 8)
+        //  record: {dir, segments, segment_size, direct, flush_interval}
+        //          keeps the received frames in a flight_recorder,
+        //          which can be played back with a device_replay
         static local_context_ptr create(io::yield_ctx&, io::io_context& ioc, 
                 const std::string_view& name, const std::string_view& type,
                 const params& p);
+    protected:
+        // a device without a port, for replaying
+        device(io::io_context& ioc, const std::string& name,
+                const std::string& type, const params& p);
+
+        // called from within the port executing strand
+        virtual void write_packet(stream::Packet&& p);
+        // queues several packets, which go out in a single write
+        virtual void write_packets(std::vector<stream::Packet>&& p);
+        void on_read(stream::Packet&& p);
+
+        // only variables which are currently subscribed are cached
+        std::optional<datapoint> last_value(const variable* v) override {
+            auto it = adapters_.find(v->get_id());
+            if (it == adapters_.end()) return std::nullopt;
+            return it->second->last();
+        }
     private:
         std::shared_ptr<device> shared_device_this() {
             return std::static_pointer_cast<device>(shared_from_this());
@@ -111,32 +271,115 @@ namespace telegraph {
             return std::weak_ptr<device>{std::static_pointer_cast<device>(shared_from_this())};
         }
 
+        // the adapter of a variable, created on first use
+        std::shared_ptr<adapter_base> adapter_for(const variable* v);
+
         // will queue a write out
         // called from within the port executing strand
         void do_reading(size_t requested = 0); // requested of 0 just read any amount
         void on_read(const boost::system::error_code& ec, size_t transferred);
+        // handles the frame in decode_buf_
+        void on_frame();
+
+        // low latency/termios settings, after opening the port
+        void configure_port();
+        // reads on the reader thread or the io_context
+        void start_reading();
+        void stop_reader();
 
         void do_write_next();
-        void write_packet(stream::Packet&& p);
-        void on_read(stream::Packet&& p);
+        void on_written(const boost::system::error_code& ec, size_t transferred);
+
+        // closes the port, resetting the framing/write state
+        void close_port();
+        // closes the port, fails outstanding requests and
+        // starts reopening the port with backoff
+        void link_lost();
+        // reopen the port and check the device still has
+        // the same tree, returns false to retry later
+        bool reattach(io::yield_ctx& yield);
+        // re-issue the merged change_sub of every subscribed adapter
+        void resubscribe(io::yield_ctx& yield);
+
+        // waits for a slot of the call window until the deadline
+        bool acquire_call_slot(io::yield_ctx& yield,
+                        const boost::posix_time::ptime& deadline);
+        bool try_acquire_call_slot();
+        // hands the slot to the next waiting call
+        void release_call_slot();
+        // removes the request, releasing its slot if it was never answered
+        void finish_call(uint32_t req_id);
     };
 
+    // Plays a flight recorder recording back as if it came from the device.
+    // Only updates and captures are replayed, subscription requests are
+    // answered locally.
+    class device_replay : public device {
+    private:
+        std::unique_ptr<flight_recorder::reader> reader_;
+        float speed_; // 0 is as fast as possible
+        bool loop_;
+        bool stopped_;
+    public:
+        device_replay(io::io_context& ioc, const std::string& name, const params& p,
+                        std::unique_ptr<flight_recorder::reader>&& reader,
+                        float speed, bool loop);
+
+        void destroy(io::yield_ctx& yield) override;
+
+        // params:
+        //  dir: the recording directory
+        //  name: the recorded device (default is the name of this context)
+        //  speed: playback speed, 1 is real time and 0 is as fast as possible
+        //  loop: start over at the end (default false)
+        static local_context_ptr create(io::yield_ctx&, io::io_context& ioc,
+                const std::string_view& name, const std::string_view& type,
+                const params& p);
+    protected:
+        void write_packet(stream::Packet&& p) override;
+        void write_packets(std::vector<stream::Packet>&& p) override;
+    private:
+        void start();
+    };
+
+    // Lists the serial ports, and optionally creates a device for every
+    // new port that matches. On linux plug events come from inotify on /dev
+    // (and /dev/serial/by-id), elsewhere the ports are polled every 2 seconds.
     class device_scanner : public local_component {
     private:
         std::unordered_map<params_stream*, 
                 std::weak_ptr<params_stream>> requests_;
         std::vector<std::string> last_devices_;
+
+        // inotify descriptor, null when polling
+        std::shared_ptr<io::posix::stream_descriptor> events_;
+        int by_id_watch_;
+
+        // auto-create options
+        bool auto_create_;
+        std::string match_; // substring of the port or its by-id name
+        int baud_;
+        std::unordered_map<std::string, std::weak_ptr<context>> created_;
     public:
-        device_scanner(io::io_context& ioc, const std::string_view& name);
+        device_scanner(io::io_context& ioc, const std::string_view& name,
+                        const params& p);
         ~device_scanner();
 
         void init();
 
         params_stream_ptr request(io::yield_ctx&, const params& p) override;
 
+        // params (all optional):
+        //  auto_create: {match, baud} creates a device context for
+        //               every new port whose path or by-id name contains match
         static local_component_ptr create(io::yield_ctx&, io::io_context& ioc, 
                 const std::string_view& name, const std::string_view& type,
                 const params& p);
+    private:
+        bool watch();
+        void watch_by_id();
+        // rescans, broadcasts any change and creates devices for new ports
+        void update_ports(io::yield_ctx& yield);
     };
 }
 #endif
@@ -26,6 +26,13 @@ namespace telegraph {
         return nullptr;
     }
 
+    std::optional<datapoint>
+    dummy_device::last_value(const variable* v) {
+        auto it = publishers_.find(v);
+        if (it == publishers_.end() || !it->second) return std::nullopt;
+        return it->second->last();
+    }
+
     subscription_ptr
     dummy_device::subscribe(io::yield_ctx&, const variable* v,
                             float min_interval, float max_interval,
@@ -37,6 +44,13 @@ namespace telegraph {
         return p->subscribe(min_interval, max_interval);
     }
 
+    recording_tap_ptr
+    dummy_device::tap(io::yield_ctx&, const variable* v, float timeout) {
+        auto it = publishers_.find(v);
+        if (it == publishers_.end() || !it->second) return nullptr;
+        return it->second->tap();
+    }
+
     value
     dummy_device::call(io::yield_ctx&, action* a,
                             value arg, float timeout) {
@@ -57,9 +71,10 @@ namespace telegraph {
         auto root = std::make_unique<group>(1, "foo", "Foo", "", "", 1, std::move(children));
         auto dev = std::make_shared<dummy_device>(ioc, name, std::move(root));
 
-        auto a_publisher = std::make_shared<publisher>(ioc, value_type::Float);
-        auto b_publisher = std::make_shared<publisher>(ioc, value_type::Int32);
-        auto c_publisher= std::make_shared<publisher>(ioc, status_type);
+        auto wheel = std::make_shared<timer_wheel>(ioc);
+        auto a_publisher = std::make_shared<publisher>(wheel, value_type::Float);
+        auto b_publisher = std::make_shared<publisher>(wheel, value_type::Int32);
+        auto c_publisher= std::make_shared<publisher>(wheel, status_type);
 
         dev->add_publisher(childA, a_publisher);
         dev->add_publisher(childB, b_publisher);
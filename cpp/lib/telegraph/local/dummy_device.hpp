@@ -24,11 +24,15 @@ namespace telegraph {
 
         params_stream_ptr request(io::yield_ctx&, const params& p) override;
 
+        std::optional<datapoint> last_value(const variable* v) override;
+
         subscription_ptr subscribe(io::yield_ctx& ctx,
                 const variable* v, 
                 float min_interval, float max_interval, 
                 float timeout) override;
 
+        recording_tap_ptr tap(io::yield_ctx& yield, const variable* v, float timeout) override;
+
         value call(io::yield_ctx& yield, action* a, value v, float timeout) override;
 
         subscription_ptr subscribe(io::yield_ctx& yield,
@@ -50,21 +54,21 @@ namespace telegraph {
 
         bool write_data(io::yield_ctx& yield, 
                 variable* v, 
-                const std::vector<datapoint>& data) override {
+                const datapoint_batch& data) override {
             return false;
         }
         bool write_data(io::yield_ctx& yield, 
                 const std::vector<std::string_view>&, 
-                const std::vector<datapoint>& data) override {
+                const datapoint_batch& data) override {
             return false;
         }
 
         data_query_ptr query_data(io::yield_ctx& yield, 
-                                    const variable* v) override {
+                                    const variable* v, float timeout) override {
             return nullptr;
         }
         data_query_ptr query_data(io::yield_ctx& yield, 
-                const std::vector<std::string_view>& v) override {
+                const std::vector<std::string_view>& v, float timeout) override {
             return nullptr;
         }
 
@@ -0,0 +1,337 @@
+#include "flight_recorder.hpp"
+
+#include "../common/nodes.hpp"
+#include "../utils/errors.hpp"
+
+#include "log.pb.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace telegraph {
+    static constexpr size_t record_header_size = 16;
+    static constexpr size_t initial_buffer = 64*1024;
+    // anything larger is taken to be corruption
+    static constexpr uint32_t max_record_size = 64*1024*1024;
+
+    static void put_u32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; i++) p[i] = (uint8_t) (v >> (8*i));
+    }
+    static void put_u64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; i++) p[i] = (uint8_t) (v >> (8*i));
+    }
+    static uint32_t get_u32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) v |= (uint32_t) p[i] << (8*i);
+        return v;
+    }
+    static uint64_t get_u64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++) v |= (uint64_t) p[i] << (8*i);
+        return v;
+    }
+
+    static size_t round_up(size_t n) {
+        return (n + flight_recorder::block_size - 1) / flight_recorder::block_size
+                    * flight_recorder::block_size;
+    }
+
+    static int64_t micros(time_point t) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                    t.time_since_epoch()).count();
+    }
+
+    // the sequence number of a segment, if it has a valid header
+    static bool read_header(const std::string& path, uint64_t& seq) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        uint8_t h[16];
+        bool ok = ::read(fd, h, sizeof(h)) == (ssize_t) sizeof(h) &&
+                  get_u32(h) == flight_recorder::magic &&
+                  get_u32(h + 4) == flight_recorder::version;
+        ::close(fd);
+        if (ok) seq = get_u64(h + 8);
+        return ok;
+    }
+
+    // (seq, path) of every segment of a recording, oldest first
+    static std::vector<std::pair<uint64_t, std::string>>
+    list_segments(const std::string& dir, const std::string& name) {
+        std::vector<std::pair<uint64_t, std::string>> segs;
+        std::error_code ec;
+        std::string prefix = name + ".";
+        for (fs::directory_iterator it{dir, ec}, end; !ec && it != end; it.increment(ec)) {
+            std::string f = it->path().filename().string();
+            if (f.rfind(prefix, 0) != 0 || it->path().extension() != ".tgfr") continue;
+            uint64_t seq;
+            if (read_header(it->path().string(), seq)) segs.emplace_back(seq, it->path().string());
+        }
+        std::sort(segs.begin(), segs.end());
+        return segs;
+    }
+
+    std::string
+    flight_recorder::segment_path(const std::string& dir, const std::string& name, size_t i) {
+        return (fs::path{dir} / (name + "." + std::to_string(i) + ".tgfr")).string();
+    }
+
+    flight_recorder::flight_recorder(io::io_context& ioc, const std::string& name,
+                                    const options& opts, const node& tree)
+            : ioc_(ioc), name_(name), opts_(opts), tree_(),
+              fd_(-1), segment_(0), seq_(0), offset_(0),
+              buf_(nullptr), capacity_(0), size_(0),
+              flush_timer_(ioc), flush_armed_(false), failed_(false) {
+        if (opts_.segments == 0) throw parse_error("flight recorder needs at least one segment");
+        log::LogEvent e;
+        tree.pack(e.mutable_root());
+        tree_.resize(e.ByteSizeLong());
+        e.SerializeWithCachedSizesToArray(tree_.data());
+
+        std::error_code ec;
+        fs::create_directories(opts_.dir, ec);
+        // carry on after the newest segment of an earlier run
+        auto segs = list_segments(opts_.dir, name_);
+        if (!segs.empty()) {
+            seq_ = segs.back().first + 1;
+            for (size_t i = 0; i < opts_.segments; i++) {
+                if (segment_path(opts_.dir, name_, i) == segs.back().second) {
+                    segment_ = (i + 1) % opts_.segments;
+                }
+            }
+        }
+        reserve(initial_buffer);
+        open_segment(segment_);
+    }
+
+    flight_recorder::~flight_recorder() {
+        flush();
+        if (fd_ >= 0) ::close(fd_);
+        std::free(buf_);
+    }
+
+    void
+    flight_recorder::reserve(size_t n) {
+        if (n <= capacity_) return;
+        size_t cap = std::max(round_up(n), 2*capacity_);
+        void* p = nullptr;
+        if (posix_memalign(&p, block_size, cap) != 0) throw std::bad_alloc();
+        if (buf_) {
+            std::memcpy(p, buf_, size_);
+            std::free(buf_);
+        }
+        buf_ = static_cast<uint8_t*>(p);
+        capacity_ = cap;
+    }
+
+    void
+    flight_recorder::open_segment(size_t index) {
+        if (fd_ >= 0) ::close(fd_);
+        std::string path = segment_path(opts_.dir, name_, index);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+        if (opts_.direct) {
+            fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+            // not every filesystem supports it (tmpfs)
+            if (fd_ < 0) fd_ = ::open(path.c_str(), flags, 0644);
+        } else {
+            fd_ = ::open(path.c_str(), flags, 0644);
+        }
+#else
+        fd_ = ::open(path.c_str(), flags, 0644);
+#endif
+        if (fd_ < 0) {
+            fail("unable to open " + path);
+            return;
+        }
+        segment_ = index;
+        offset_ = 0;
+        // header block
+        size_ = 0;
+        std::memset(buf_, 0, block_size);
+        put_u32(buf_, magic);
+        put_u32(buf_ + 4, version);
+        put_u64(buf_ + 8, seq_++);
+        put_u64(buf_ + 16, (uint64_t) micros(std::chrono::system_clock::now()));
+        size_ = block_size;
+        append(Tree, micros(std::chrono::system_clock::now()), tree_.data(), tree_.size());
+    }
+
+    void
+    flight_recorder::append(record_type type, int64_t timestamp,
+                            const uint8_t* data, size_t len) {
+        if (failed_) return;
+        size_t n = record_header_size + len;
+        // rotate once the segment is full, as long as it holds a frame
+        bool has_frames = offset_ + size_ > block_size + record_header_size + tree_.size();
+        if (type == Frame && has_frames && offset_ + size_ + n > opts_.segment_size) {
+            flush();
+            open_segment((segment_ + 1) % opts_.segments);
+            if (failed_) return;
+        }
+        if (size_ + n > capacity_) {
+            flush();
+            reserve(n);
+        }
+        uint8_t* p = buf_ + size_;
+        put_u32(p, (uint32_t) len);
+        put_u32(p + 4, type);
+        put_u64(p + 8, (uint64_t) timestamp);
+        if (len) std::memcpy(p + record_header_size, data, len);
+        size_ += n;
+        arm_flush();
+    }
+
+    void
+    flight_recorder::record(time_point t, const uint8_t* data, size_t len) {
+        append(Frame, micros(t), data, len);
+    }
+
+    void
+    flight_recorder::flush() {
+        if (failed_ || size_ == 0 || fd_ < 0) return;
+        size_t n = size_;
+        if (opts_.direct) {
+            // pad to a whole block, the reader skips the zeros
+            n = round_up(size_);
+            std::memset(buf_ + size_, 0, n - size_);
+        }
+        size_t written = 0;
+        while (written < n) {
+            ssize_t r = ::pwrite(fd_, buf_ + written, n - written, (off_t) (offset_ + written));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) {
+                fail("write to " + segment_path(opts_.dir, name_, segment_) + " failed");
+                return;
+            }
+            written += (size_t) r;
+        }
+        offset_ += n;
+        size_ = 0;
+    }
+
+    void
+    flight_recorder::arm_flush() {
+        if (flush_armed_) return;
+        flush_armed_ = true;
+        flush_timer_.expires_from_now(boost::posix_time::milliseconds(
+                                        (int64_t) (1000*opts_.flush_interval)));
+        std::weak_ptr<flight_recorder> w = weak_from_this();
+        flush_timer_.async_wait([w] (const boost::system::error_code& ec) {
+            if (ec == io::error::operation_aborted) return;
+            auto s = w.lock();
+            if (!s) return;
+            s->flush_armed_ = false;
+            s->flush();
+        });
+    }
+
+    void
+    flight_recorder::fail(const std::string& what) {
+        // recording is best effort, the device keeps running
+        std::cerr << "flight recorder " << name_ << ": " << what
+                  << ", recording stopped" << std::endl;
+        failed_ = true;
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+
+    flight_recorder::reader::reader(const std::string& dir, const std::string& name)
+            : files_(), file_(0), fd_(-1), buf_(), pos_(0), end_(0), offset_(0) {
+        for (auto& s : list_segments(dir, name)) files_.push_back(s.second);
+        buf_.resize(initial_buffer);
+        rewind();
+    }
+
+    flight_recorder::reader::~reader() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    void
+    flight_recorder::reader::rewind() {
+        file_ = 0;
+        open_next();
+    }
+
+    bool
+    flight_recorder::reader::open_next() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+        while (file_ < files_.size() && fd_ < 0) {
+            fd_ = ::open(files_[file_++].c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd_ < 0) return false;
+        ::lseek(fd_, (off_t) block_size, SEEK_SET);
+        offset_ = block_size;
+        pos_ = 0;
+        end_ = 0;
+        return true;
+    }
+
+    bool
+    flight_recorder::reader::fill(size_t n) {
+        if (end_ - pos_ >= n) return true;
+        // move what is left to the front
+        std::memmove(buf_.data(), buf_.data() + pos_, end_ - pos_);
+        end_ -= pos_;
+        offset_ += pos_;
+        pos_ = 0;
+        if (buf_.size() < n) buf_.resize(n);
+        while (end_ < n) {
+            ssize_t r = ::read(fd_, buf_.data() + end_, buf_.size() - end_);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            end_ += (size_t) r;
+        }
+        return true;
+    }
+
+    bool
+    flight_recorder::reader::next(entry& r) {
+        while (fd_ >= 0) {
+            if (!fill(record_header_size)) {
+                open_next();
+                continue;
+            }
+            const uint8_t* h = buf_.data() + pos_;
+            uint32_t len = get_u32(h);
+            if (len == 0) {
+                // padding, continue at the next block
+                uint64_t at = offset_ + pos_;
+                if (at % block_size == 0) {
+                    // nothing was written past here
+                    open_next();
+                    continue;
+                }
+                size_t skip = (size_t) (round_up(at) - at);
+                if (!fill(skip)) {
+                    open_next();
+                    continue;
+                }
+                pos_ += skip;
+                continue;
+            }
+            // a torn or corrupt record ends the segment
+            if (len > max_record_size || !fill(record_header_size + len)) {
+                open_next();
+                continue;
+            }
+            h = buf_.data() + pos_;
+            r.type = (record_type) get_u32(h + 4);
+            r.timestamp = (int64_t) get_u64(h + 8);
+            r.payload.assign(h + record_header_size, h + record_header_size + len);
+            pos_ += record_header_size + len;
+            return true;
+        }
+        return false;
+    }
+}
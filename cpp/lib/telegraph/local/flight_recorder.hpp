@@ -0,0 +1,118 @@
+#ifndef __TELEGRAPH_LOCAL_FLIGHT_RECORDER_HPP__
+#define __TELEGRAPH_LOCAL_FLIGHT_RECORDER_HPP__
+
+#include "../common/data.hpp"
+#include "../utils/io.hpp"
+
+#include <boost/asio/deadline_timer.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace telegraph {
+    class node;
+
+    // Records the frames received from a device into a bounded ring of
+    // segment files, <dir>/<name>.<i>.tgfr. Once every segment is in use
+    // the oldest one is overwritten. Every segment begins with the device
+    // tree, so any of them can be replayed on its own.
+    //
+    // A segment is a 4 KiB header block followed by records:
+    //   u32 length, u32 type, i64 timestamp (us), then length payload bytes
+    // a zero length skips to the next 4 KiB boundary (padding).
+    class flight_recorder : public std::enable_shared_from_this<flight_recorder> {
+    public:
+        static constexpr uint32_t magic = 0x72666774; // "tgfr"
+        static constexpr uint32_t version = 1;
+        static constexpr size_t block_size = 4096;
+
+        enum record_type : uint32_t {
+            Frame = 0, // a CRC-checked stream::Packet
+            Tree = 1 // a log::LogEvent with the root
+        };
+
+        struct options {
+            std::string dir;
+            size_t segment_size = 16*1024*1024;
+            size_t segments = 4;
+            // O_DIRECT writes, bypassing the page cache. each
+            // flush is then padded to a whole block
+            bool direct = false;
+            // unflushed records are written out after this long
+            float flush_interval = 1;
+        };
+
+        struct entry {
+            record_type type;
+            int64_t timestamp;
+            std::vector<uint8_t> payload;
+        };
+
+        // reads the segments of a recording, oldest first
+        class reader {
+        private:
+            std::vector<std::string> files_;
+            size_t file_;
+            int fd_;
+            std::vector<uint8_t> buf_;
+            size_t pos_;
+            size_t end_;
+            uint64_t offset_; // file offset of buf_[0]
+        public:
+            reader(const std::string& dir, const std::string& name);
+            ~reader();
+            reader(const reader&) = delete;
+            reader& operator=(const reader&) = delete;
+
+            bool empty() const { return files_.empty(); }
+            // false once the recording is exhausted
+            bool next(entry& e);
+            // back to the oldest record
+            void rewind();
+        private:
+            bool open_next();
+            bool fill(size_t n);
+        };
+    private:
+        io::io_context& ioc_;
+        const std::string name_;
+        const options opts_;
+        std::vector<uint8_t> tree_; // packed LogEvent, repeated in every segment
+
+        int fd_;
+        size_t segment_; // index of the open segment
+        uint64_t seq_;
+        uint64_t offset_; // write offset in the open segment
+
+        uint8_t* buf_; // block aligned
+        size_t capacity_;
+        size_t size_;
+
+        io::deadline_timer flush_timer_;
+        bool flush_armed_;
+        bool failed_;
+    public:
+        flight_recorder(io::io_context& ioc, const std::string& name,
+                        const options& opts, const node& tree);
+        ~flight_recorder();
+        flight_recorder(const flight_recorder&) = delete;
+        flight_recorder& operator=(const flight_recorder&) = delete;
+
+        static std::string segment_path(const std::string& dir,
+                                const std::string& name, size_t i);
+
+        void record(time_point t, const uint8_t* data, size_t len);
+        void flush();
+    private:
+        void append(record_type type, int64_t timestamp, const uint8_t* data, size_t len);
+        void open_segment(size_t index);
+        void reserve(size_t n);
+        void arm_flush();
+        void fail(const std::string& what);
+    };
+    using flight_recorder_ptr = std::shared_ptr<flight_recorder>;
+}
+
+#endif
@@ -0,0 +1,297 @@
+#include "load_generator.hpp"
+
+#include "../utils/io.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <cmath>
+#include <limits>
+
+namespace telegraph {
+    static constexpr double two_pi = 6.283185307179586;
+
+    template<typename T>
+        static T clamp_to(double x) {
+            double lo = (double) std::numeric_limits<T>::lowest();
+            double hi = (double) std::numeric_limits<T>::max();
+            return (T) std::min(hi, std::max(lo, x));
+        }
+
+    static bool is_unsigned(value_type::type_class t) {
+        return t == value_type::Uint8 || t == value_type::Uint16 ||
+               t == value_type::Uint32 || t == value_type::Uint64;
+    }
+
+    // converts a sample (centered around zero) to the variable's type
+    static value to_value(value_type::type_class t, double x) {
+        switch (t) {
+        case value_type::Bool: return value{x > 0};
+        case value_type::Uint8: return value{clamp_to<uint8_t>(x)};
+        case value_type::Uint16: return value{clamp_to<uint16_t>(x)};
+        case value_type::Uint32: return value{clamp_to<uint32_t>(x)};
+        case value_type::Uint64: return value{clamp_to<uint64_t>(x)};
+        case value_type::Int8: return value{clamp_to<int8_t>(x)};
+        case value_type::Int16: return value{clamp_to<int16_t>(x)};
+        case value_type::Int32: return value{clamp_to<int32_t>(x)};
+        case value_type::Int64: return value{clamp_to<int64_t>(x)};
+        case value_type::Float: return value{(float) x};
+        case value_type::Double: return value{x};
+        default: return value::invalid();
+        }
+    }
+
+    static value_type::type_class parse_type(const std::string& s) {
+        if (s == "bool") return value_type::Bool;
+        if (s == "uint8") return value_type::Uint8;
+        if (s == "uint16") return value_type::Uint16;
+        if (s == "uint32") return value_type::Uint32;
+        if (s == "uint64") return value_type::Uint64;
+        if (s == "int8") return value_type::Int8;
+        if (s == "int16") return value_type::Int16;
+        if (s == "int32") return value_type::Int32;
+        if (s == "int64") return value_type::Int64;
+        if (s == "float") return value_type::Float;
+        if (s == "double") return value_type::Double;
+        throw bad_type_error("unknown load_generator type: " + s);
+    }
+
+    static load_generator::waveform parse_waveform(const std::string& s) {
+        if (s == "ramp") return load_generator::Ramp;
+        if (s == "sine") return load_generator::Sine;
+        if (s == "random_walk") return load_generator::RandomWalk;
+        if (s == "step") return load_generator::Step;
+        throw parse_error("unknown load_generator waveform: " + s);
+    }
+
+    // either a single value or a list
+    // which is cycled over the variables
+    static const params& nth(const params& p, size_t i) {
+        if (!p.is_array()) return p;
+        const auto& v = p.to_vector();
+        if (v.empty()) throw parse_error("empty load_generator parameter list");
+        return v[i % v.size()];
+    }
+
+    static float num_or(const params& p, const std::string_view& key, float def) {
+        if (!p.is_object()) return def;
+        const auto& m = p.to_map();
+        auto it = m.find(key);
+        if (it == m.end() || !it->second.is_num()) return def;
+        return it->second.get<float>();
+    }
+
+    static load_generator::clock::duration to_duration(double secs) {
+        return std::chrono::duration_cast<load_generator::clock::duration>(
+                    std::chrono::duration<double>(secs));
+    }
+
+    load_generator::load_generator(io::io_context& ioc, const std::string_view& name,
+                                    const params& p, std::unique_ptr<node>&& tree)
+            : local_context(ioc, name, "load_generator", p, std::move(tree)),
+              channels_(), schedule_(), timer_(ioc),
+              start_(clock::now()), rng_(std::random_device{}()),
+              generated_(0) {}
+
+    load_generator::~load_generator() {
+        timer_.cancel();
+    }
+
+    void
+    load_generator::add_channel(channel&& c) {
+        channels_.emplace_back(std::move(c));
+    }
+
+    void
+    load_generator::start() {
+        start_ = clock::now();
+        for (size_t i = 0; i < channels_.size(); i++) {
+            channel& c = channels_[i];
+            c.next = start_ + c.interval;
+            c.burst_start = start_;
+            schedule_.emplace(c.next, i);
+        }
+        schedule_next();
+    }
+
+    void
+    load_generator::schedule_next() {
+        if (schedule_.empty()) return;
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                        schedule_.top().first - clock::now());
+        timer_.expires_from_now(boost::posix_time::microseconds(
+                    std::max<int64_t>(0, wait.count())));
+
+        auto sp = std::static_pointer_cast<load_generator>(shared_from_this());
+        std::weak_ptr<load_generator> wp{sp};
+        timer_.async_wait([wp] (const boost::system::error_code& ec) {
+            auto s = wp.lock();
+            if (!s) return;
+            s->on_timer(ec);
+        });
+    }
+
+    void
+    load_generator::on_timer(const boost::system::error_code& ec) {
+        if (ec) return;
+        auto now = clock::now();
+        while (!schedule_.empty() && schedule_.top().first <= now) {
+            size_t i = schedule_.top().second;
+            schedule_.pop();
+            channel& c = channels_[i];
+
+            bool in_burst = true;
+            if (c.burst_off.count() > 0) {
+                auto cycle = c.burst_on + c.burst_off;
+                auto into = (now - c.burst_start) % cycle;
+                in_burst = into < c.burst_on;
+                // skip over the quiet part of the cycle
+                if (!in_burst) c.next = now + (cycle - into);
+            }
+            if (in_burst) {
+                c.pub->update(sample(c, now));
+                generated_++;
+                c.next += c.interval;
+                // if we fell behind by more than a sample,
+                // drop the missed samples rather than bursting them out
+                if (c.next < now) c.next = now + c.interval;
+            }
+            schedule_.emplace(c.next, i);
+        }
+        schedule_next();
+    }
+
+    value
+    load_generator::sample(channel& c, clock::time_point now) {
+        double t = std::chrono::duration<double>(now - start_).count();
+        double phase = c.period > 0 ? std::fmod(t, c.period) / c.period : 0;
+        double a = c.amplitude;
+        double x = 0;
+        switch (c.wave) {
+        case Ramp: x = -a + 2*a*phase; break;
+        case Sine: x = a*std::sin(two_pi*phase); break;
+        case Step: x = phase < 0.5 ? -a : a; break;
+        case RandomWalk: {
+            std::uniform_real_distribution<double> step(-a/50, a/50);
+            c.state = std::min(a, std::max(-a, c.state + step(rng_)));
+            x = c.state;
+        } break;
+        }
+        auto tc = c.var->get_type().get_class();
+        if (is_unsigned(tc)) x += a;
+        return to_value(tc, x);
+    }
+
+    params_stream_ptr
+    load_generator::request(io::yield_ctx&, const params& p) {
+        if (!p.is_object()) return nullptr;
+        const auto& m = p.to_map();
+        auto it = m.find("type");
+        if (it == m.end() || !it->second.is_str() ||
+                it->second.get<std::string>() != "stats") return nullptr;
+        params stats = params::object();
+        stats["generated"] = params{(float) generated_};
+        stats["variables"] = params{(float) channels_.size()};
+        auto s = std::make_shared<params_stream>();
+        s->write(std::move(stats));
+        s->close();
+        return s;
+    }
+
+    std::optional<datapoint>
+    load_generator::last_value(const variable* v) {
+        for (auto& c : channels_) {
+            if (c.var == v) return c.pub->last();
+        }
+        return std::nullopt;
+    }
+
+    subscription_ptr
+    load_generator::subscribe(io::yield_ctx&, const variable* v,
+                            float min_interval, float max_interval,
+                            float timeout) {
+        for (auto& c : channels_) {
+            if (c.var == v) return c.pub->subscribe(min_interval, max_interval);
+        }
+        return nullptr;
+    }
+
+    recording_tap_ptr
+    load_generator::tap(io::yield_ctx&, const variable* v, float timeout) {
+        for (auto& c : channels_) {
+            if (c.var == v) return c.pub->tap();
+        }
+        return nullptr;
+    }
+
+    local_context_ptr
+    load_generator::create(io::yield_ctx&, io::io_context& ioc,
+            const std::string_view& name, const std::string_view& type,
+            const params& p) {
+        std::vector<std::string> types{"float"};
+        params rate{10.0f};
+        params wave{std::string{"sine"}};
+        int vars = 1;
+        float period = 1;
+        float amplitude = 100;
+        float burst_on = 0, burst_off = 0;
+
+        if (p.is_object()) {
+            const auto& m = p.to_map();
+            auto it = m.find("types");
+            if (it != m.end()) {
+                types.clear();
+                if (it->second.is_str()) types.push_back(it->second.get<std::string>());
+                else for (const auto& t : it->second.to_vector())
+                    types.push_back(t.get<std::string>());
+            }
+            if ((it = m.find("rate")) != m.end()) rate = it->second;
+            if ((it = m.find("waveform")) != m.end()) wave = it->second;
+            if ((it = m.find("burst")) != m.end()) {
+                burst_on = num_or(it->second, "on", 0);
+                burst_off = num_or(it->second, "off", 0);
+            }
+            vars = (int) num_or(p, "vars", 1);
+            period = num_or(p, "period", period);
+            amplitude = num_or(p, "amplitude", amplitude);
+        }
+
+        // build the tree, one group per type
+        node::id id = 1;
+        std::vector<std::pair<variable*, value_type>> created;
+        std::vector<node*> groups;
+        for (const std::string& t : types) {
+            value_type vt{parse_type(t)};
+            std::vector<node*> children;
+            for (int i = 0; i < vars; i++) {
+                std::string n = "v" + std::to_string(i);
+                auto v = new variable(id++, n, n, "", vt);
+                children.push_back(v);
+                created.emplace_back(v, vt);
+            }
+            groups.push_back(new group(id++, t, t, "", "", 1, std::move(children)));
+        }
+        auto root = std::make_unique<group>(0, "load", "Load", "", "", 1, std::move(groups));
+        auto gen = std::make_shared<load_generator>(ioc, name, p, std::move(root));
+
+        // one wheel drives the refresh/debounce
+        // timers of every subscription
+        auto wheel = std::make_shared<timer_wheel>(ioc);
+        for (size_t i = 0; i < created.size(); i++) {
+            double hz = nth(rate, i).get<float>();
+            if (hz <= 0) throw parse_error("load_generator rate must be positive");
+            channel c;
+            c.var = created[i].first;
+            c.pub = std::make_shared<publisher>(wheel, created[i].second);
+            c.wave = parse_waveform(nth(wave, i).get<std::string>());
+            c.interval = to_duration(1.0 / hz);
+            c.period = period;
+            c.amplitude = amplitude;
+            c.burst_on = to_duration(burst_on);
+            c.burst_off = to_duration(burst_off);
+            c.state = 0;
+            gen->add_channel(std::move(c));
+        }
+        gen->start();
+        return gen;
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef __TELEGRAPH_LOCAL_LOAD_GENERATOR_HPP__
+#define __TELEGRAPH_LOCAL_LOAD_GENERATOR_HPP__
+
+#include "namespace.hpp"
+#include "../common/publisher.hpp"
+#include "../common/nodes.hpp"
+
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <random>
+#include <chrono>
+
+#include <boost/asio/deadline_timer.hpp>
+
+namespace telegraph {
+    // synthetic data source for load testing the
+    // publisher -> forwarder -> websocket path without hardware.
+    // all variables are driven from a single timer
+    class load_generator : public local_context {
+    public:
+        enum waveform { Ramp, Sine, RandomWalk, Step };
+
+        using clock = std::chrono::steady_clock;
+
+        struct channel {
+            const variable* var;
+            publisher_ptr pub;
+            waveform wave;
+            clock::duration interval; // time between samples
+            double period; // waveform period in seconds
+            double amplitude;
+            // bursts: on for burst_on, off for burst_off
+            // (burst_off of zero disables bursting)
+            clock::duration burst_on;
+            clock::duration burst_off;
+
+            clock::time_point next; // next sample is due
+            clock::time_point burst_start;
+            double state; // random walk position
+        };
+    private:
+        // ordered by the next due time
+        struct due_later {
+            bool operator()(const std::pair<clock::time_point, size_t>& a,
+                            const std::pair<clock::time_point, size_t>& b) const {
+                return a.first > b.first;
+            }
+        };
+
+        std::vector<channel> channels_;
+        std::priority_queue<std::pair<clock::time_point, size_t>,
+            std::vector<std::pair<clock::time_point, size_t>>, due_later> schedule_;
+        io::deadline_timer timer_;
+        clock::time_point start_;
+        std::mt19937 rng_;
+
+        uint64_t generated_;
+    public:
+        load_generator(io::io_context& ioc, const std::string_view& name,
+                    const params& p, std::unique_ptr<node>&& tree);
+        ~load_generator();
+
+        void add_channel(channel&& c);
+
+        // start the timer loop, should be called after construction
+        void start();
+
+        constexpr uint64_t get_generated() const { return generated_; }
+
+        // {type: "stats"} returns the number of generated updates
+        params_stream_ptr request(io::yield_ctx&, const params& p) override;
+
+        std::optional<datapoint> last_value(const variable* v) override;
+
+        subscription_ptr subscribe(io::yield_ctx& ctx,
+                const variable* v,
+                float min_interval, float max_interval,
+                float timeout) override;
+
+        recording_tap_ptr tap(io::yield_ctx& yield, const variable* v, float timeout) override;
+
+        subscription_ptr subscribe(io::yield_ctx& yield,
+                const std::vector<std::string_view>& path,
+                float min_interval, float max_interval,
+                float timeout) override {
+            auto v = dynamic_cast<variable*>(tree_->from_path(path));
+            if (!v) return nullptr;
+            return subscribe(yield, v, min_interval, max_interval, timeout);
+        }
+
+        value call(io::yield_ctx& yield, action* a, value v, float timeout) override {
+            return value::invalid();
+        }
+        value call(io::yield_ctx& yield,
+                    const std::vector<std::string_view>& path,
+                    value v, float timeout) override {
+            return value::invalid();
+        }
+
+        bool write_data(io::yield_ctx& yield,
+                variable* v,
+                const datapoint_batch& data) override {
+            return false;
+        }
+        bool write_data(io::yield_ctx& yield,
+                const std::vector<std::string_view>&,
+                const datapoint_batch& data) override {
+            return false;
+        }
+
+        data_query_ptr query_data(io::yield_ctx& yield,
+                                    const variable* v, float timeout) override {
+            return nullptr;
+        }
+        data_query_ptr query_data(io::yield_ctx& yield,
+                const std::vector<std::string_view>& v, float timeout) override {
+            return nullptr;
+        }
+
+        // params:
+        //  types: list of type names (float, double, uint8, ..., int64, bool)
+        //  vars: number of variables per type
+        //  rate: samples per second, a number or a list cycled over the variables
+        //  waveform: ramp, sine, random_walk or step (or a list, cycled)
+        //  period: waveform period in seconds
+        //  amplitude: waveform amplitude
+        //  burst: {on: seconds, off: seconds}
+        static local_context_ptr create(io::yield_ctx&, io::io_context& ioc,
+                const std::string_view& name, const std::string_view& type,
+                const params& p);
+    private:
+        void on_timer(const boost::system::error_code& ec);
+        void schedule_next();
+        value sample(channel& c, clock::time_point now);
+    };
+}
+
+#endif
@@ -57,6 +57,21 @@ namespace telegraph {
         destroyed(yield);
     }
 
+    std::vector<std::pair<const variable*, datapoint>>
+    local_context::snapshot(io::yield_ctx& yield, const std::vector<std::string_view>& path) {
+        std::vector<std::pair<const variable*, datapoint>> values;
+        if (!tree_) return values;
+        const node* root = tree_->from_path(path);
+        if (!root) throw missing_error("no such node");
+        for (const node* n : root->nodes()) {
+            auto v = dynamic_cast<const variable*>(n);
+            if (!v) continue;
+            auto dp = last_value(v);
+            if (dp) values.emplace_back(v, *dp);
+        }
+        return values;
+    }
+
     local_component::local_component(io::io_context& ioc, const std::string_view& name, 
                                     const std::string_view& type, const params& i) :
                         local_context(ioc, name, type, i, nullptr, true) {}
@@ -14,6 +14,7 @@
 #include <string_view>
 #include <map>
 #include <functional>
+#include <optional>
 
 namespace telegraph {
     class local_context;
@@ -55,11 +56,17 @@ namespace telegraph {
         std::shared_ptr<namespace_> get_namespace() override { return ns_.lock(); }
         std::shared_ptr<const namespace_> get_namespace() const override { return ns_.lock(); }
 
-        void reg(io::yield_ctx& yield, const std::shared_ptr<local_namespace>& ns);
+        virtual void reg(io::yield_ctx& yield, const std::shared_ptr<local_namespace>& ns);
         void destroy(io::yield_ctx& yield) override;
 
         inline std::shared_ptr<node> fetch(io::yield_ctx&) override {  return tree_; }
+
+        std::vector<std::pair<const variable*, datapoint>>
+            snapshot(io::yield_ctx& yield, const std::vector<std::string_view>& path) override;
     protected:
+        // latest value of a variable, if one is cached
+        virtual std::optional<datapoint> last_value(const variable* v) { return std::nullopt; }
+
         std::shared_ptr<node> tree_;
         std::weak_ptr<local_namespace> ns_;
     };
@@ -85,12 +92,12 @@ namespace telegraph {
                             value v, float timeout) override { return value::invalid(); }
 
         bool write_data(io::yield_ctx& yield, variable* v, 
-                                    const std::vector<datapoint>& data) override { return false; }
+                                    const datapoint_batch& data) override { return false; }
         bool write_data(io::yield_ctx& yield, const std::vector<std::string_view>& var,
-                                    const std::vector<datapoint>& data) override { return false; }
+                                    const datapoint_batch& data) override { return false; }
 
-        data_query_ptr query_data(io::yield_ctx& yield, const variable* v) override { return nullptr; }
-        data_query_ptr query_data(io::yield_ctx& yield, const std::vector<std::string_view>& v) override { return nullptr; }
+        data_query_ptr query_data(io::yield_ctx& yield, const variable* v, float timeout) override { return nullptr; }
+        data_query_ptr query_data(io::yield_ctx& yield, const std::vector<std::string_view>& v, float timeout) override { return nullptr; }
     };
 }
 
@@ -0,0 +1,465 @@
+#include "relay.hpp"
+
+#include "../utils/errors.hpp"
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <iostream>
+
+namespace telegraph {
+    // paths on the wire are relative to the root
+    static std::vector<std::string> relative_path(const node* n) {
+        std::vector<std::string> p = n->path();
+        if (!p.empty()) p.erase(p.begin());
+        return p;
+    }
+
+    static const variable* find_variable(const node* tree, node::id id) {
+        if (!tree) return nullptr;
+        for (const node* n : tree->nodes()) {
+            if (n->get_id() == id) return dynamic_cast<const variable*>(n);
+        }
+        return nullptr;
+    }
+
+    relayed_context::relayed_context(io::io_context& ioc, const std::string_view& name,
+                        const std::string_view& type, const params& p,
+                        std::unique_ptr<node>&& tree, const timer_wheel_ptr& wheel)
+            : local_context(ioc, name, type, p, std::shared_ptr<node>(std::move(tree))),
+              remote_(), adapters_(), upstream_(), wheel_(wheel) {}
+
+    relayed_context::~relayed_context() {
+        detach();
+    }
+
+    void
+    relayed_context::attach(io::yield_ctx& yield, const context_ptr& remote) {
+        detach();
+        remote_ = remote;
+        // resume at the merged rates the adapters already hold
+        std::vector<node::id> ids;
+        for (auto& a : adapters_) {
+            if (a.second->is_subscribed()) ids.push_back(a.first);
+        }
+        size_t failed = 0;
+        for (node::id id : ids) {
+            auto it = adapters_.find(id);
+            if (it == adapters_.end()) continue;
+            auto a = it->second;
+            if (!change_upstream(yield, id, a->get_debounce(), a->get_refresh(),
+                                 a->get_deadband(), 1)) failed++;
+        }
+        if (failed > 0) {
+            std::cout << "failed to resume " << failed << " relayed subscriptions on "
+                      << get_name() << std::endl;
+        }
+    }
+
+    void
+    relayed_context::detach() {
+        remote_.reset();
+        // the upstream subscriptions went away with the connection
+        for (auto& u : upstream_) {
+            u.second->data.remove(this);
+            u.second->cancelled.remove(this);
+        }
+        upstream_.clear();
+    }
+
+    bool
+    relayed_context::change_upstream(io::yield_ctx& yield, node::id id, float debounce,
+                                float refresh, const deadband& band, float timeout) {
+        auto remote = remote_;
+        if (!remote) return false;
+        try {
+            auto it = upstream_.find(id);
+            if (it != upstream_.end()) {
+                it->second->change(yield, debounce, refresh, band, timeout);
+                return true;
+            }
+            const variable* v = find_variable(tree_.get(), id);
+            if (!v) return false;
+            std::vector<std::string> p = relative_path(v);
+            std::vector<std::string_view> path(p.begin(), p.end());
+            auto s = remote->subscribe(yield, path, debounce, refresh, band, timeout);
+            // reconnected (or detached) while subscribing
+            if (!s || remote_ != remote) return false;
+
+            std::weak_ptr<adapter_base> wa = adapters_.at(id);
+            s->data.add(this, [wa] (value v) {
+                auto a = wa.lock();
+                if (a) a->update(v);
+            });
+            s->cancelled.add(this, [this, id] () {
+                upstream_.erase(id);
+            });
+            upstream_.emplace(id, std::move(s));
+            return true;
+        } catch (const std::exception& e) {
+            return false;
+        }
+    }
+
+    bool
+    relayed_context::cancel_upstream(io::yield_ctx& yield, node::id id, float timeout) {
+        // keep the adapter alive for the duration of this operation
+        auto a = adapters_.at(id);
+        adapters_.erase(id);
+        auto it = upstream_.find(id);
+        if (it == upstream_.end()) return true;
+        auto s = it->second;
+        upstream_.erase(it);
+        s->data.remove(this);
+        s->cancelled.remove(this);
+        s->cancel(yield, timeout);
+        return true;
+    }
+
+    std::optional<datapoint>
+    relayed_context::last_value(const variable* v) {
+        auto it = adapters_.find(v->get_id());
+        if (it == adapters_.end()) return std::nullopt;
+        return it->second->last();
+    }
+
+    params_stream_ptr
+    relayed_context::request(io::yield_ctx& yield, const params& p) {
+        if (!remote_) return nullptr;
+        return remote_->request(yield, p);
+    }
+
+    subscription_ptr
+    relayed_context::subscribe(io::yield_ctx& yield,
+            const std::vector<std::string_view>& path,
+            float min_interval, float max_interval, float timeout) {
+        auto v = dynamic_cast<variable*>(tree_->from_path(path));
+        if (!v) return nullptr;
+        return subscribe(yield, v, min_interval, max_interval, timeout);
+    }
+
+    std::shared_ptr<adapter_base>
+    relayed_context::adapter_for(const variable* v) {
+        node::id id = v->get_id();
+        auto it = adapters_.find(id);
+        if (it == adapters_.end()) {
+            auto wp = std::weak_ptr<relayed_context>(
+                    std::static_pointer_cast<relayed_context>(shared_from_this()));
+            auto change = [wp, id](io::yield_ctx& yield, float debounce,
+                            float refresh, const deadband& band, float timeout) -> bool {
+                auto sthis = wp.lock();
+                if (!sthis) return false;
+                return sthis->change_upstream(yield, id, debounce, refresh, band, timeout);
+            };
+            auto poll = [wp, id]() {
+                auto sthis = wp.lock();
+                if (!sthis) return;
+                auto it = sthis->upstream_.find(id);
+                if (it != sthis->upstream_.end()) it->second->poll();
+            };
+            auto cancel = [wp, id](io::yield_ctx& yield, float timeout) -> bool {
+                auto sthis = wp.lock();
+                if (!sthis) return false;
+                return sthis->cancel_upstream(yield, id, timeout);
+            };
+            auto a = std::make_shared<adapter<decltype(poll), decltype(change), decltype(cancel)>>(
+                                ioc_, wheel_, v->get_type(), poll, change, cancel);
+            it = adapters_.emplace(id, a).first;
+        }
+        return it->second;
+    }
+
+    subscription_ptr
+    relayed_context::subscribe(io::yield_ctx& yield, const variable* v,
+            float min_interval, float max_interval, float timeout) {
+        return adapter_for(v)->subscribe(yield, min_interval, max_interval,
+                                            deadband{}, timeout);
+    }
+
+    subscription_ptr
+    relayed_context::subscribe(io::yield_ctx& yield,
+            const std::vector<std::string_view>& path,
+            float min_interval, float max_interval,
+            const deadband& band, float timeout) {
+        auto v = dynamic_cast<variable*>(tree_->from_path(path));
+        if (!v) return nullptr;
+        return adapter_for(v)->subscribe(yield, min_interval, max_interval,
+                                            band, timeout);
+    }
+
+    recording_tap_ptr
+    relayed_context::tap(io::yield_ctx& yield, const variable* v, float timeout) {
+        return adapter_for(v)->tap(yield, timeout);
+    }
+
+    value
+    relayed_context::call(io::yield_ctx& yield, action* a, value v, float timeout) {
+        std::vector<std::string> p = relative_path(a);
+        std::vector<std::string_view> path(p.begin(), p.end());
+        return call(yield, path, v, timeout);
+    }
+
+    value
+    relayed_context::call(io::yield_ctx& yield, const std::vector<std::string_view>& a,
+                            value v, float timeout) {
+        if (!remote_) return value::invalid();
+        return remote_->call(yield, a, v, timeout);
+    }
+
+    bool
+    relayed_context::write_data(io::yield_ctx& yield, variable* v,
+                                const datapoint_batch& data) {
+        std::vector<std::string> p = relative_path(v);
+        std::vector<std::string_view> path(p.begin(), p.end());
+        return write_data(yield, path, data);
+    }
+
+    bool
+    relayed_context::write_data(io::yield_ctx& yield,
+                                const std::vector<std::string_view>& var,
+                                const datapoint_batch& data) {
+        if (!remote_) return false;
+        return remote_->write_data(yield, var, data);
+    }
+
+    data_query_ptr
+    relayed_context::query_data(io::yield_ctx& yield, const variable* v, float timeout) {
+        std::vector<std::string> p = relative_path(v);
+        std::vector<std::string_view> path(p.begin(), p.end());
+        return query_data(yield, path, timeout);
+    }
+
+    data_query_ptr
+    relayed_context::query_data(io::yield_ctx& yield,
+                                const std::vector<std::string_view>& v, float timeout) {
+        if (!remote_) return nullptr;
+        return remote_->query_data(yield, v, timeout);
+    }
+
+    std::vector<std::pair<const variable*, datapoint>>
+    relayed_context::snapshot(io::yield_ctx& yield, const std::vector<std::string_view>& path) {
+        if (!remote_) return local_context::snapshot(yield, path);
+        // the upstream cache covers variables nobody subscribed to here
+        std::vector<std::pair<const variable*, datapoint>> values;
+        for (auto& e : remote_->snapshot(yield, path)) {
+            std::vector<std::string> p = relative_path(e.first);
+            std::vector<std::string_view> vp(p.begin(), p.end());
+            auto v = dynamic_cast<const variable*>(tree_->from_path(vp));
+            if (v) values.emplace_back(v, e.second);
+        }
+        return values;
+    }
+
+
+    relay::relay(io::io_context& ioc, const std::string_view& name,
+                    const std::string_view& type, const params& p)
+            : local_component(ioc, name, type, p),
+              unix_path_(), host_(), port_(), retry_(1),
+              wheel_(std::make_shared<timer_wheel>(ioc)),
+              remote_(), mirrors_(), destroyed_(false), reconnecting_(false) {}
+
+    relay::~relay() {
+        detach_remote();
+    }
+
+    std::shared_ptr<remote_namespace>
+    relay::connect(io::yield_ctx& yield) {
+        if (!unix_path_.empty())
+            return remote_namespace::connect(yield, ioc_, unix_path_);
+        boost::asio::ip::tcp::resolver resolver(ioc_);
+        boost::system::error_code ec;
+        auto results = resolver.async_resolve(host_, port_, yield.ctx[ec]);
+        if (ec) throw io_error("unable to resolve " + host_ + ": " + ec.message());
+        std::string last_error = "no addresses for " + host_;
+        for (const auto& r : results) {
+            try {
+                return remote_namespace::connect(yield, ioc_, r.endpoint());
+            } catch (const io_error& e) {
+                last_error = e.what();
+            }
+        }
+        throw io_error(last_error);
+    }
+
+    void
+    relay::detach_remote() {
+        if (!remote_) return;
+        remote_->contexts->added.remove(this);
+        remote_->contexts->removed.remove(this);
+        remote_->disconnected.remove(this);
+    }
+
+    void
+    relay::attach(io::yield_ctx& yield, const std::shared_ptr<remote_namespace>& ns) {
+        detach_remote();
+        remote_ = ns;
+        std::weak_ptr<relay> w = shared_relay_this();
+        ns->contexts->added.add(this, [w] (const context_ptr& c) {
+            auto r = w.lock();
+            if (!r || r->destroyed_) return;
+            io::spawn(r->ioc_, [r, c] (io::yield_context yield) {
+                io::yield_ctx y{yield};
+                try {
+                    r->mirror(y, c);
+                } catch (const std::exception& e) {
+                    std::cerr << "failed to relay " << c->get_name()
+                              << ": " << e.what() << std::endl;
+                }
+            });
+        });
+        ns->contexts->removed.add(this, [w] (const context_ptr& c) {
+            auto r = w.lock();
+            if (!r) return;
+            auto it = r->mirrors_.find(c->get_name());
+            if (it == r->mirrors_.end()) return;
+            auto m = it->second;
+            if (!r->remote_->is_connected()) {
+                // keep it around for when the connection is back
+                m->detach();
+                return;
+            }
+            r->mirrors_.erase(it);
+            io::spawn(r->ioc_, [m] (io::yield_context yield) {
+                io::yield_ctx y{yield};
+                m->destroy(y);
+            });
+        });
+        ns->disconnected.add(this, [w] () {
+            auto r = w.lock();
+            if (r) r->on_disconnected();
+        });
+
+        std::vector<context_ptr> contexts;
+        for (const auto& c : *ns->contexts) contexts.push_back(c.second);
+        for (const auto& c : contexts) {
+            try {
+                mirror(yield, c);
+            } catch (const std::exception& e) {
+                std::cerr << "failed to relay " << c->get_name()
+                          << ": " << e.what() << std::endl;
+            }
+        }
+    }
+
+    void
+    relay::mirror(io::yield_ctx& yield, const context_ptr& remote) {
+        auto tree = remote->fetch(yield);
+        // components have nothing to relay
+        if (!tree || destroyed_) return;
+        auto it = mirrors_.find(remote->get_name());
+        if (it != mirrors_.end()) {
+            auto m = it->second;
+            // destroyed locally in the meantime
+            if (!m->get_namespace()) {
+                mirrors_.erase(it);
+            } else if (m->tree_->compatible_with(tree.get())) {
+                m->attach(yield, remote);
+                return;
+            } else {
+                // subscriptions can't be resumed against a different tree
+                mirrors_.erase(it);
+                m->destroy(yield);
+            }
+        }
+        auto ns = ns_.lock();
+        if (!ns) return;
+        auto m = std::make_shared<relayed_context>(ioc_,
+                    name_ + "/" + remote->get_name(), remote->get_type(),
+                    remote->get_params(), tree->clone(), wheel_);
+        mirrors_.emplace(remote->get_name(), m);
+        m->attach(yield, remote);
+        m->reg(yield, ns);
+    }
+
+    void
+    relay::on_disconnected() {
+        for (auto& m : mirrors_) m.second->detach();
+        if (destroyed_) return;
+        std::cout << "lost connection to relay " << name_ << ", reconnecting" << std::endl;
+        start_reconnecting();
+    }
+
+    void
+    relay::start_reconnecting() {
+        if (reconnecting_) return;
+        reconnecting_ = true;
+        std::weak_ptr<relay> w = shared_relay_this();
+        io::spawn(ioc_, [w, &ioc = ioc_] (io::yield_context yield) {
+            io::yield_ctx y{yield};
+            while (true) {
+                float retry;
+                {
+                    auto r = w.lock();
+                    if (!r || r->destroyed_) return;
+                    retry = r->retry_;
+                }
+                io::deadline_timer timer(ioc, boost::posix_time::milliseconds((int64_t) (1000*retry)));
+                boost::system::error_code ec;
+                timer.async_wait(y.ctx[ec]);
+
+                auto r = w.lock();
+                if (!r || r->destroyed_) return;
+                try {
+                    auto ns = r->connect(y);
+                    if (r->destroyed_) return;
+                    r->reconnecting_ = false;
+                    std::cout << "relay " << r->name_ << " connected" << std::endl;
+                    r->attach(y, ns);
+                    return;
+                } catch (const std::exception& e) {}
+            }
+        });
+    }
+
+    void
+    relay::reg(io::yield_ctx& yield, const std::shared_ptr<local_namespace>& ns) {
+        local_context::reg(yield, ns);
+        if (remote_) attach(yield, remote_);
+        else start_reconnecting();
+    }
+
+    void
+    relay::destroy(io::yield_ctx& yield) {
+        if (destroyed_) return;
+        destroyed_ = true;
+        auto mirrors = std::move(mirrors_);
+        mirrors_.clear();
+        for (auto& m : mirrors) {
+            if (m.second->get_namespace()) m.second->destroy(yield);
+        }
+        detach_remote();
+        if (remote_) remote_->close();
+        local_context::destroy(yield);
+    }
+
+    local_context_ptr
+    relay::create(io::yield_ctx& yield, io::io_context& ioc,
+            const std::string_view& name, const std::string_view& type,
+            const params& p) {
+        if (!p.is_object()) throw parse_error("relay expects an object");
+        const auto& m = p.to_map();
+        auto r = std::make_shared<relay>(ioc, name, type, p);
+        auto it = m.find("unix");
+        if (it != m.end() && it->second.is_str()) {
+            r->unix_path_ = it->second.get<std::string>();
+        } else {
+            auto h = m.find("host");
+            auto port = m.find("port");
+            if (h == m.end() || !h->second.is_str() ||
+                    port == m.end() || !port->second.is_num())
+                throw parse_error("relay needs a unix path or a host and port");
+            r->host_ = h->second.get<std::string>();
+            r->port_ = std::to_string((int) port->second.get<float>());
+        }
+        if ((it = m.find("retry")) != m.end() && it->second.is_num())
+            r->retry_ = std::max(0.05f, it->second.get<float>());
+
+        // an unreachable server is retried once the relay is registered
+        try {
+            r->remote_ = r->connect(yield);
+        } catch (const std::exception& e) {
+            std::cerr << "relay " << name << ": " << e.what() << std::endl;
+        }
+        return r;
+    }
+}
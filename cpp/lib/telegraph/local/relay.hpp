@@ -0,0 +1,128 @@
+#ifndef __TELEGRAPH_LOCAL_RELAY_HPP__
+#define __TELEGRAPH_LOCAL_RELAY_HPP__
+
+#include "namespace.hpp"
+#include "../common/adapter.hpp"
+#include "../common/nodes.hpp"
+#include "../remote/client.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace telegraph {
+    class relay;
+
+    // a local copy of a context on another server, every variable
+    // has a single upstream subscription at the merged rate of
+    // the local subscribers
+    class relayed_context : public local_context {
+        friend class relay;
+    private:
+        context_ptr remote_; // null while disconnected
+        std::unordered_map<node::id, std::shared_ptr<adapter_base>> adapters_;
+        std::unordered_map<node::id, subscription_ptr> upstream_;
+        timer_wheel_ptr wheel_;
+    public:
+        relayed_context(io::io_context& ioc, const std::string_view& name,
+                        const std::string_view& type, const params& p,
+                        std::unique_ptr<node>&& tree, const timer_wheel_ptr& wheel);
+        ~relayed_context();
+
+        bool is_attached() const { return remote_ != nullptr; }
+
+        params_stream_ptr request(io::yield_ctx& yield, const params& p) override;
+
+        subscription_ptr subscribe(io::yield_ctx& yield,
+                const std::vector<std::string_view>& path,
+                float min_interval, float max_interval, float timeout) override;
+        subscription_ptr subscribe(io::yield_ctx& yield, const variable* v,
+                float min_interval, float max_interval, float timeout) override;
+        subscription_ptr subscribe(io::yield_ctx& yield,
+                const std::vector<std::string_view>& path,
+                float min_interval, float max_interval,
+                const deadband& band, float timeout) override;
+        recording_tap_ptr tap(io::yield_ctx& yield, const variable* v,
+                float timeout) override;
+
+        value call(io::yield_ctx& yield, action* a, value v, float timeout) override;
+        value call(io::yield_ctx& yield, const std::vector<std::string_view>& a,
+                    value v, float timeout) override;
+
+        bool write_data(io::yield_ctx& yield, variable* v,
+                            const datapoint_batch& data) override;
+        bool write_data(io::yield_ctx& yield, const std::vector<std::string_view>& var,
+                            const datapoint_batch& data) override;
+
+        data_query_ptr query_data(io::yield_ctx& yield, const variable* v, float timeout) override;
+        data_query_ptr query_data(io::yield_ctx& yield,
+                            const std::vector<std::string_view>& v, float timeout) override;
+
+        std::vector<std::pair<const variable*, datapoint>>
+            snapshot(io::yield_ctx& yield, const std::vector<std::string_view>& path) override;
+    protected:
+        std::optional<datapoint> last_value(const variable* v) override;
+    private:
+        std::shared_ptr<adapter_base> adapter_for(const variable* v);
+
+        // point at a (new) upstream context and resume the subscriptions
+        void attach(io::yield_ctx& yield, const context_ptr& remote);
+        void detach();
+
+        bool change_upstream(io::yield_ctx& yield, node::id id, float debounce,
+                            float refresh, const deadband& band, float timeout);
+        bool cancel_upstream(io::yield_ctx& yield, node::id id, float timeout);
+    };
+
+    // Mounts the namespace of another server: every context there gets
+    // a relayed_context here, named <relay>/<context>. However many
+    // clients subscribe here, the other server only sees one subscription
+    // per variable. The connection is re-established when it drops and
+    // the relayed contexts pick up where they left off.
+    class relay : public local_component {
+    private:
+        std::string unix_path_;
+        std::string host_;
+        std::string port_;
+        float retry_; // seconds between connection attempts
+        timer_wheel_ptr wheel_; // shared by the relayed contexts
+
+        std::shared_ptr<remote_namespace> remote_;
+        // by upstream context name
+        std::unordered_map<std::string, std::shared_ptr<relayed_context>> mirrors_;
+        bool destroyed_;
+        bool reconnecting_;
+    public:
+        relay(io::io_context& ioc, const std::string_view& name,
+                const std::string_view& type, const params& p);
+        ~relay();
+
+        void reg(io::yield_ctx& yield, const std::shared_ptr<local_namespace>& ns) override;
+        void destroy(io::yield_ctx& yield) override;
+
+        params_stream_ptr request(io::yield_ctx&, const params& p) override { return nullptr; }
+
+        // params:
+        //  unix: path of the other server's unix socket, or
+        //  host/port: its length-prefixed tcp listener
+        //  retry: seconds between reconnection attempts (default 1)
+        static local_context_ptr create(io::yield_ctx&, io::io_context& ioc,
+                const std::string_view& name, const std::string_view& type,
+                const params& p);
+    private:
+        std::shared_ptr<relay> shared_relay_this() {
+            return std::static_pointer_cast<relay>(shared_from_this());
+        }
+
+        std::shared_ptr<remote_namespace> connect(io::yield_ctx& yield);
+        void attach(io::yield_ctx& yield, const std::shared_ptr<remote_namespace>& ns);
+        void mirror(io::yield_ctx& yield, const context_ptr& remote);
+        void on_disconnected();
+        void start_reconnecting();
+        void detach_remote();
+    };
+}
+
+#endif
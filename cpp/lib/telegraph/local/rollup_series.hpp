@@ -0,0 +1,78 @@
+#ifndef __TELEGRAPH_LOCAL_ROLLUP_SERIES_HPP__
+#define __TELEGRAPH_LOCAL_ROLLUP_SERIES_HPP__
+
+#include "../common/data.hpp"
+#include "../common/value.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+namespace telegraph {
+
+    // min/max/mean/count of the numeric updates of a series over fixed
+    // intervals, updated as the data is written. late updates land in
+    // their own interval, anything that is not a number is skipped
+    class rollup_series {
+    public:
+        struct bucket {
+            int64_t start; // microseconds since the epoch
+            double min;
+            double max;
+            double sum;
+            uint64_t count;
+
+            bucket(int64_t s, double v) : start(s), min(v), max(v), sum(v), count(1) {}
+
+            double mean() const { return count ? sum / count : 0; }
+            void add(double v) {
+                min = std::min(min, v);
+                max = std::max(max, v);
+                sum += v;
+                count++;
+            }
+        };
+    private:
+        int64_t interval_;
+        std::deque<bucket> buckets_;
+    public:
+        rollup_series(int64_t interval) : interval_(interval), buckets_() {}
+
+        constexpr int64_t get_interval() const { return interval_; }
+        const std::deque<bucket>& buckets() const { return buckets_; }
+
+        void add(int64_t micros, double v) {
+            // floor, also for times before the epoch
+            int64_t start = micros / interval_ * interval_;
+            if (start > micros) start -= interval_;
+
+            if (buckets_.empty() || buckets_.back().start < start) {
+                buckets_.emplace_back(start, v);
+                return;
+            }
+            if (buckets_.back().start == start) {
+                buckets_.back().add(v);
+                return;
+            }
+            auto it = std::lower_bound(buckets_.begin(), buckets_.end(), start,
+                    [] (const bucket& b, int64_t s) { return b.start < s; });
+            if (it->start == start) it->add(v);
+            else buckets_.emplace(it, start, v);
+        }
+        void add(const datapoint_batch& b) {
+            for (size_t i = 0; i < b.size(); i++) {
+                auto d = to_double(b.value_at(i));
+                if (d) add(b.micros(i), *d);
+            }
+        }
+
+        // drops the intervals which end before the given time
+        void drop_before(int64_t micros) {
+            while (!buckets_.empty() && buckets_.front().start + interval_ <= micros) {
+                buckets_.pop_front();
+            }
+        }
+    };
+}
+
+#endif
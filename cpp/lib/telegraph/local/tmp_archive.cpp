@@ -3,19 +3,111 @@
 #include "../common/nodes.hpp"
 #include "../common/data.hpp"
 
+#include "../utils/errors.hpp"
+
+#include <algorithm>
+#include <limits>
 #include <string_view>
 
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/lexical_cast.hpp>
 
 namespace telegraph {
+    static constexpr int64_t second = 1000000;
+    static constexpr int64_t minute = 60*second;
+
+    static float num_or(const params& p, const std::string_view& key, float def) {
+        if (!p.is_object()) return def;
+        const auto& m = p.to_map();
+        auto it = m.find(key);
+        if (it == m.end() || !it->second.is_num()) return def;
+        return it->second.get<float>();
+    }
+
+    retention
+    retention::parse(const params& p) {
+        retention r;
+        r.raw = num_or(p, "raw", 0);
+        r.seconds = num_or(p, "seconds", 0);
+        r.minutes = num_or(p, "minutes", 0);
+        if (r.raw < 0 || r.seconds < 0 || r.minutes < 0) {
+            throw parse_error("retention must not be negative");
+        }
+        return r;
+    }
+
+    tmp_data::tmp_data(const retention& r)
+            : store_(), retention_(), seconds_(), minutes_(),
+              newest_(std::numeric_limits<int64_t>::min()) {
+        set_retention(r);
+    }
+
+    void
+    tmp_data::set_retention(const retention& r) {
+        retention_ = r;
+        bool fresh_seconds = false, fresh_minutes = false;
+        if (r.seconds <= 0) seconds_.reset();
+        else if (!seconds_) seconds_.emplace(second), fresh_seconds = true;
+        if (r.minutes <= 0) minutes_.reset();
+        else if (!minutes_) minutes_.emplace(minute), fresh_minutes = true;
+        if (fresh_seconds || fresh_minutes) {
+            store_.scan([&] (const datapoint_batch& b) {
+                if (fresh_seconds) seconds_->add(b);
+                if (fresh_minutes) minutes_->add(b);
+            });
+        }
+        compact();
+    }
+
+    const rollup_series*
+    tmp_data::get_rollup(int64_t interval) const {
+        if (interval == second && seconds_) return &*seconds_;
+        if (interval == minute && minutes_) return &*minutes_;
+        return nullptr;
+    }
+
+    void
+    tmp_data::write(const datapoint_batch& d) {
+        store_.append(d);
+        if (seconds_) seconds_->add(d);
+        if (minutes_) minutes_->add(d);
+        for (int64_t t : d.times()) newest_ = std::max(newest_, t);
+        data(d);
+    }
+
+    void
+    tmp_data::compact() {
+        if (store_.empty()) return;
+        auto cutoff = [this] (float secs) {
+            return newest_ - (int64_t) ((double) secs * second);
+        };
+        if (retention_.raw > 0) store_.drop_before(cutoff(retention_.raw));
+        if (seconds_) seconds_->drop_before(cutoff(retention_.seconds));
+        if (minutes_) minutes_->drop_before(cutoff(retention_.minutes));
+    }
+
+    static std::vector<std::string_view> var_path(const params& p) {
+        std::vector<std::string_view> path;
+        for (const params& e : p.at("var").get<std::vector<params>>()) {
+            path.push_back(e.get<std::string>());
+        }
+        return path;
+    }
 
     tmp_archive::tmp_archive(io::io_context& ioc, const std::string_view& name,
-                            std::unique_ptr<node>&& src)
-            : local_context(ioc, name, "tmp_archive", params{}, std::move(src)) {}
+                            std::unique_ptr<node>&& src, const retention& r)
+            : local_context(ioc, name, "tmp_archive", params{}, std::move(src)),
+              retention_(r), compact_timer_(ioc) {}
 
     tmp_archive::~tmp_archive() {
-        for (auto i : recordings_) i.second->cancelled.remove(this);
+        compact_timer_.cancel();
+        for (auto i : recordings_) {
+            i.second->cancelled.remove(this);
+            i.second->data.remove(this);
+        }
+        for (auto i : taps_) {
+            i.second->data.remove(this);
+        }
         for (auto i : recordings_queries_) {
             auto r = i.second.lock();
             if (r) {
@@ -29,7 +121,27 @@ namespace telegraph {
     tmp_archive::record(variable* v, subscription_ptr s) {
         if (!v) return;
         recordings_[v] = s;
+        // block values are stored as-is, sharing their samples
+        s->data.add(this, [this, v] (value val) {
+            datapoint_batch d{v->get_type().get_class()};
+            d.push_back(datapoint::now(), val);
+            store(v, d);
+        });
+        recording_started(v);
+    }
+
+    void
+    tmp_archive::record(variable* v, recording_tap_ptr t) {
+        if (!v) return;
+        taps_[v] = t;
+        t->data.add(this, [this, v] (const datapoint_batch& d) {
+            store(v, d);
+        });
+        recording_started(v);
+    }
 
+    void
+    tmp_archive::recording_started(const variable* v) {
         params obj = params::object();
         obj["event"] = "record";
         obj["path"] = params{v->path()};
@@ -43,7 +155,18 @@ namespace telegraph {
     void
     tmp_archive::record_stop(variable* v) {
         if (!v) return;
-        recordings_.erase(v);
+        auto it = recordings_.find(v);
+        if (it != recordings_.end()) {
+            it->second->data.remove(this);
+            recordings_.erase(it);
+        }
+        auto tit = taps_.find(v);
+        if (tit != taps_.end()) {
+            // keep what was received up to now
+            tit->second->flush();
+            tit->second->data.remove(this);
+            taps_.erase(tit);
+        }
 
         params obj = params::object();
         obj["event"] = "record_stop";
@@ -54,6 +177,32 @@ namespace telegraph {
         }
     }
 
+    void
+    tmp_archive::start() {
+        compact_timer_.expires_from_now(boost::posix_time::seconds(compact_interval));
+        auto sp = std::static_pointer_cast<tmp_archive>(shared_from_this());
+        std::weak_ptr<tmp_archive> wp{sp};
+        compact_timer_.async_wait([wp] (const boost::system::error_code& ec) {
+            auto s = wp.lock();
+            if (!s || ec) return;
+            s->compact();
+            s->start();
+        });
+    }
+
+    void
+    tmp_archive::compact() {
+        for (auto& i : data_) i.second->compact();
+    }
+
+    data_query_ptr
+    tmp_archive::query_data(io::yield_ctx& ctx,
+                            const std::vector<std::string_view>& path, float timeout) {
+        auto v = dynamic_cast<const variable*>(tree_->from_path(path));
+        if (!v) return nullptr;
+        return query_data(ctx, v, timeout);
+    }
+
     params_stream_ptr
     tmp_archive::request(io::yield_ctx& yield,
                         const params& p) {
@@ -74,12 +223,21 @@ namespace telegraph {
                 }
                 auto v = dynamic_cast<variable*>(tree_->from_path(path));
                 if (!v) return nullptr;
-                float min_interval = p.at("min_interval").get<float>();
-                float max_interval = p.at("max_interval").get<float>();
-                // do the subscribe
-                auto s = ctx->subscribe(yield, path, min_interval, max_interval, 1);
-                if (!s) return nullptr;
-                record(v, s);
+                // tap every update if the source can, so
+                // nothing is lost to the subscription rates
+                auto tree = ctx->fetch(yield);
+                auto src = tree ? dynamic_cast<const variable*>(tree->from_path(path)) : nullptr;
+                auto t = src ? ctx->tap(yield, src, 1) : nullptr;
+                if (t) {
+                    record(v, t);
+                } else {
+                    float min_interval = p.at("min_interval").get<float>();
+                    float max_interval = p.at("max_interval").get<float>();
+                    // do the subscribe
+                    auto s = ctx->subscribe(yield, path, min_interval, max_interval, 1);
+                    if (!s) return nullptr;
+                    record(v, s);
+                }
 
                 params_stream_ptr p = std::make_shared<params_stream>();
                 p->write(params{true});
@@ -99,6 +257,47 @@ namespace telegraph {
                 p->write(params{true});
                 p->close();
                 return p;
+            } else if (s == "retention") {
+                auto v = dynamic_cast<variable*>(tree_->from_path(var_path(p)));
+                if (!v) return nullptr;
+                data_for(v)->set_retention(retention::parse(p));
+
+                params_stream_ptr p = std::make_shared<params_stream>();
+                p->write(params{true});
+                p->close();
+                return p;
+            } else if (s == "rollups") {
+                auto v = dynamic_cast<variable*>(tree_->from_path(var_path(p)));
+                if (!v) return nullptr;
+                int64_t interval = (int64_t) (num_or(p, "interval", 1) * second);
+                auto it = data_.find(v);
+                const rollup_series* r = it != data_.end() ?
+                            it->second->get_rollup(interval) : nullptr;
+                if (!r) return nullptr;
+
+                const auto& buckets = r->buckets();
+                int64_t origin = buckets.empty() ? 0 : buckets.front().start;
+                std::vector<params> index, min, max, mean, count;
+                for (const auto& b : buckets) {
+                    index.push_back(params{(float) ((b.start - origin) / interval)});
+                    min.push_back(params{(float) b.min});
+                    max.push_back(params{(float) b.max});
+                    mean.push_back(params{(float) b.mean()});
+                    count.push_back(params{(float) b.count});
+                }
+                params obj = params::object();
+                obj["origin"] = params{std::to_string(origin)};
+                obj["interval"] = params{(float) interval / second};
+                obj["index"] = params{std::move(index)};
+                obj["min"] = params{std::move(min)};
+                obj["max"] = params{std::move(max)};
+                obj["mean"] = params{std::move(mean)};
+                obj["count"] = params{std::move(count)};
+
+                params_stream_ptr p = std::make_shared<params_stream>();
+                p->write(std::move(obj));
+                p->close();
+                return p;
             } else if (s == "recordings") {
                 params_stream_ptr p = std::make_shared<params_stream>();
                 params_stream* raw = p.get();
@@ -118,6 +317,13 @@ namespace telegraph {
                     obj["path"] = params{path};
                     p->write(std::move(obj));
                 }
+                for (auto i : taps_) {
+                    std::vector<std::string> path = i.first->path();
+                    params obj = params::object();
+                    obj["event"] = "recording";
+                    obj["path"] = params{path};
+                    p->write(std::move(obj));
+                }
                 return p;
             }
         }
@@ -143,6 +349,11 @@ namespace telegraph {
             n = mn->clone();
         }
         if (!n) return nullptr;
-        return std::make_shared<tmp_archive>(ioc, name, std::move(n));
+        retention r;
+        auto rit = srcs.find("retention");
+        if (rit != srcs.end()) r = retention::parse(rit->second);
+        auto a = std::make_shared<tmp_archive>(ioc, name, std::move(n), r);
+        a->start();
+        return a;
     }
 }
\ No newline at end of file
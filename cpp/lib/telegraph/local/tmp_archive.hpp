@@ -5,51 +5,98 @@
 #include "../common/nodes.hpp"
 
 #include "namespace.hpp"
+#include "compressed_series.hpp"
+#include "rollup_series.hpp"
+
+#include <boost/asio/deadline_timer.hpp>
+
+#include <optional>
 
 namespace telegraph {
 
+    // how long a recorded variable keeps each tier, in seconds. raw data
+    // is kept forever if its retention is 0, a rollup is only maintained
+    // if it has a retention. times are relative to the newest datapoint
+    struct retention {
+        float raw = 0;
+        float seconds = 0; // 1 second rollups
+        float minutes = 0; // 1 minute rollups
+
+        static retention parse(const params& p);
+    };
+
+    // recorded datapoints, compressed in memory, and their rollups
     class tmp_data : public data_query {
     private:
-        std::vector<datapoint> current_;
+        compressed_series store_;
+        retention retention_;
+        std::optional<rollup_series> seconds_;
+        std::optional<rollup_series> minutes_;
+        int64_t newest_;
     public:
-        const std::vector<datapoint>& get_current() const override { return current_; }
-        void write(const std::vector<datapoint>& d) {
-            current_.insert(current_.end(), d.begin(), d.end());
-            data(d);
+        tmp_data(const retention& r = retention{});
+
+        const compressed_series& get_store() const { return store_; }
+        const retention& get_retention() const { return retention_; }
+        // starts rollups which were not maintained from the raw data still kept
+        void set_retention(const retention& r);
+        // the rollup with the given interval (1 or 60 seconds), if maintained
+        const rollup_series* get_rollup(int64_t interval) const;
+
+        void scan(const std::function<void(const datapoint_batch&)>& f) const override {
+            store_.scan(f);
+        }
+        std::unique_ptr<data_cursor> cursor() const override {
+            return store_.cursor();
         }
+        void write(const datapoint_batch& d);
+        // drops whatever is past its retention
+        void compact();
     };
     // for the request recording info
     class tmp_archive : public local_context {
     private:
         std::unordered_map<const variable*, std::shared_ptr<tmp_data>> data_;
+        // recordings through a subscription, where the source has no tap
         std::unordered_map<const variable*, subscription_ptr> recordings_;
+        std::unordered_map<const variable*, recording_tap_ptr> taps_;
         std::unordered_map<params_stream*, 
             std::weak_ptr<params_stream>> recordings_queries_;
+        // for variables without a rule of their own
+        retention retention_;
+        io::deadline_timer compact_timer_;
     public:
+        // how often data past its retention is dropped, in seconds
+        static constexpr int compact_interval = 5;
+
         tmp_archive(io::io_context& ioc, const std::string_view& name,
-                    std::unique_ptr<node>&& s);
+                    std::unique_ptr<node>&& s, const retention& r = retention{});
         ~tmp_archive();
 
+        // start compacting in the background, should be called after construction
+        void start();
+
+        // besides record, record_stop and recordings:
+        //  {type: "retention", var: path, raw, seconds, minutes} sets the
+        //  retention of a variable
+        //  {type: "rollups", var: path, interval: 1 or 60} returns the rollup as
+        //  {origin: first start (us, as a string), interval, index: [starts, in
+        //  intervals from the origin], min: [], max: [], mean: [], count: []}
         params_stream_ptr request(io::yield_ctx&, const params& p) override;
 
         void record(variable* v, subscription_ptr s);
+        // records every update, in batches
+        void record(variable* v, recording_tap_ptr t);
         void record_stop(variable* v);
 
         bool write_data(io::yield_ctx& yield, variable* v,
-                        const std::vector<datapoint>& data) override {
-            auto it = data_.find(v);
-            if (it == data_.end()) {
-                auto s = std::make_shared<tmp_data>();
-                data_[v] = s;
-                s->write(data);
-            } else {
-                it->second->write(data);
-            }
+                        const datapoint_batch& data) override {
+            store(v, data);
             return true;
         }
         bool write_data(io::yield_ctx& yield, 
                         const std::vector<std::string_view>& v,
-                        const std::vector<datapoint>& data) override {
+                        const datapoint_batch& data) override {
             auto n =  tree_->from_path(v);
             auto var = dynamic_cast<variable*>(n);
             if (!var) return false;
@@ -57,18 +104,12 @@ namespace telegraph {
         }
 
         data_query_ptr query_data(io::yield_ctx& ctx,
-                                  const variable* v) override {
-            auto it = data_.find(v);
-            if (it == data_.end()) {
-                auto s = std::make_shared<tmp_data>();
-                data_[v] = s;
-                return s;
-            }
-            return it->second;
+                                  const variable* v, float timeout) override {
+            return data_for(v);
         }
         
         data_query_ptr query_data(io::yield_ctx& ctx,
-                                  const std::vector<std::string_view>& v) override;
+                                  const std::vector<std::string_view>& v, float timeout) override;
 
         subscription_ptr subscribe(io::yield_ctx& ctx,
                 const variable* v, 
@@ -93,9 +134,25 @@ namespace telegraph {
             return value::invalid();
         }
 
+        // params:
+        //  src: the context or tree to archive
+        //  retention: {raw, seconds, minutes}, the default for every variable
         static local_context_ptr create(io::yield_ctx&, io::io_context& ioc, 
                 const std::string_view& name, const std::string_view& type,
                 const params& p);
+    private:
+        const std::shared_ptr<tmp_data>& data_for(const variable* v) {
+            auto it = data_.find(v);
+            if (it == data_.end()) {
+                it = data_.emplace(v, std::make_shared<tmp_data>(retention_)).first;
+            }
+            return it->second;
+        }
+        void store(const variable* v, const datapoint_batch& data) {
+            data_for(v)->write(data);
+        }
+        void compact();
+        void recording_started(const variable* v);
     };
 }
 
@@ -0,0 +1,663 @@
+#include "client.hpp"
+
+#include "../utils/errors.hpp"
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <chrono>
+
+namespace telegraph {
+    // a context must answer creation with its uuid before
+    // the reply times out, devices can take a while to come up
+    static constexpr float create_timeout = 10;
+
+    static std::string uuid_string(const uuid& u) {
+        return boost::lexical_cast<std::string>(u);
+    }
+
+    // paths on the wire are relative to the root
+    static std::vector<std::string> relative_path(const node* n) {
+        std::vector<std::string> p = n->path();
+        if (!p.empty()) p.erase(p.begin());
+        return p;
+    }
+
+    // the server sends batches, older ones repeated
+    // Datapoints with timestamps in milliseconds
+    static datapoint_batch unpack_archived(const api::DataPacket& p) {
+        if (p.has_batch()) return datapoint_batch::unpack(p.batch());
+        datapoint_batch b;
+        b.reserve(p.data_size());
+        for (const Datapoint& d : p.data()) {
+            std::chrono::milliseconds m{(int64_t) d.timestamp()};
+            b.push_back(time_point{m}, value{d.value()});
+        }
+        return b;
+    }
+
+    static void throw_if_error(const api::Packet& res) {
+        if (res.payload_case() == api::Packet::kError)
+            throw remote_error(res.error());
+    }
+
+    class remote_subscription : public subscription {
+    private:
+        io::io_context& ioc_;
+        std::shared_ptr<connection> conn_;
+        int32_t req_id_;
+        bool started_;
+        // the change waiting for a reply, if any
+        io::deadline_timer* waiting_;
+        bool change_ok_;
+    public:
+        remote_subscription(io::io_context& ioc, const std::shared_ptr<connection>& conn,
+                            float debounce, float refresh, const deadband& band)
+            : subscription(value_type{}, debounce, refresh),
+              ioc_(ioc), conn_(conn), req_id_(0), started_(false),
+              waiting_(nullptr), change_ok_(false) {
+            deadband_ = band;
+        }
+
+        ~remote_subscription() {
+            cancel();
+        }
+
+        void start(int32_t req_id, const value_type& t) {
+            req_id_ = req_id;
+            type_ = t;
+            started_ = true;
+        }
+
+        void received(io::yield_ctx& yield, const api::Packet& p) {
+            switch (p.payload_case()) {
+            case api::Packet::kSubUpdate:
+                data(value{p.sub_update().value()});
+                break;
+            case api::Packet::kSuccess:
+            case api::Packet::kError:
+                change_ok_ = p.payload_case() == api::Packet::kSuccess && p.success();
+                if (waiting_) waiting_->cancel();
+                break;
+            case api::Packet::kCancel:
+                // cancelled on the server side
+                if (cancelled_) break;
+                cancelled_ = true;
+                conn_->close_stream(req_id_);
+                cancelled();
+                break;
+            default: break;
+            }
+        }
+
+        void poll() override {
+            if (cancelled_ || !started_) return;
+            api::Packet p;
+            p.mutable_sub_poll();
+            conn_->write_back(req_id_, std::move(p));
+        }
+
+        void change(io::yield_ctx& yield, float debounce,
+                        float refresh, float timeout) override {
+            send_change(yield, debounce, refresh, deadband_, timeout);
+            debounce_ = debounce;
+            refresh_ = refresh;
+        }
+
+        void change(io::yield_ctx& yield, float debounce, float refresh,
+                        const deadband& d, float timeout) override {
+            send_change(yield, debounce, refresh, d, timeout);
+            debounce_ = debounce;
+            refresh_ = refresh;
+            if (d != deadband_) subscription::set_deadband(yield, d, timeout);
+        }
+
+        void set_deadband(io::yield_ctx& yield, const deadband& d, float timeout) override {
+            send_change(yield, debounce_, refresh_, d, timeout);
+            subscription::set_deadband(yield, d, timeout);
+        }
+
+        void cancel(io::yield_ctx& yield, float timeout) override {
+            if (cancelled_ || !started_) return;
+            send_cancel(timeout);
+            cancelled();
+        }
+
+        void cancel() override {
+            if (cancelled_ || !started_) return;
+            send_cancel(0);
+            cancelled();
+        }
+    private:
+        void send_cancel(float timeout) {
+            cancelled_ = true;
+            conn_->close_stream(req_id_);
+            api::Packet p;
+            p.set_cancel(timeout);
+            conn_->write_back(req_id_, std::move(p));
+        }
+
+        void send_change(io::yield_ctx& yield, float debounce, float refresh,
+                            const deadband& d, float timeout) {
+            if (cancelled_) throw remote_error("subscription cancelled");
+            if (waiting_) throw remote_error("subscription change already in progress");
+            api::Packet p;
+            api::Subscription* s = p.mutable_sub_change();
+            s->set_debounce(debounce);
+            s->set_refresh(refresh);
+            s->set_timeout(timeout);
+            s->set_deadband(d.threshold);
+            s->set_relative(d.relative);
+            conn_->write_back(req_id_, std::move(p));
+
+            io::deadline_timer timer(ioc_, boost::posix_time::milliseconds(
+                                        (int64_t) (1000*(timeout + 1))));
+            waiting_ = &timer;
+            change_ok_ = false;
+            boost::system::error_code ec;
+            timer.async_wait(yield.ctx[ec]);
+            waiting_ = nullptr;
+            if (ec != io::error::operation_aborted)
+                throw io_error("subscription change timed out");
+            if (!change_ok_) throw remote_error("unable to change subscription");
+        }
+    };
+
+    class remote_query : public data_query {
+    public:
+        // the history is received in chunks of this many datapoints,
+        // with this many chunks in flight
+        static constexpr uint32_t chunk_size = 16384;
+        static constexpr uint32_t credits = 4;
+    private:
+        std::shared_ptr<connection> conn_;
+        int32_t req_id_;
+        bool started_;
+        bool complete_; // the whole history was received
+        bool progress_;
+        io::deadline_timer wait_;
+        datapoint_batch current_;
+    public:
+        remote_query(io::io_context& ioc, const std::shared_ptr<connection>& conn)
+            : conn_(conn), req_id_(0), started_(false), complete_(false),
+              progress_(false), wait_(ioc), current_() {}
+        ~remote_query() {
+            if (!started_) return;
+            conn_->close_stream(req_id_);
+            api::Packet p;
+            p.set_cancel(0);
+            conn_->write_back(req_id_, std::move(p));
+        }
+
+        void start(int32_t req_id, const api::DataPacket& initial) {
+            req_id_ = req_id;
+            started_ = true;
+            history(initial);
+        }
+
+        // until the rest of the history is in, timeout
+        // being the longest wait for the next chunk
+        void wait_complete(io::yield_ctx& yield, float timeout) {
+            while (!complete_) {
+                progress_ = false;
+                wait_.expires_from_now(boost::posix_time::milliseconds(
+                                        (int64_t) (1000*timeout)));
+                boost::system::error_code ec;
+                wait_.async_wait(yield.ctx[ec]);
+                if (!complete_ && !progress_) throw io_error("archive query timed out");
+            }
+        }
+
+        void received(const api::Packet& p) {
+            if (p.payload_case() == api::Packet::kArchiveData) {
+                history(p.archive_data());
+                return;
+            }
+            if (p.payload_case() != api::Packet::kArchiveUpdate) return;
+            datapoint_batch update = unpack_archived(p.archive_update());
+            current_.append(update);
+            data(update);
+        }
+
+        void scan(const std::function<void(const datapoint_batch&)>& f) const override {
+            f(current_);
+        }
+    private:
+        void history(const api::DataPacket& d) {
+            current_.append(unpack_archived(d));
+            progress_ = true;
+            if (d.more()) {
+                // room for another one
+                api::Packet p;
+                p.set_data_credit(1);
+                conn_->write_back(req_id_, std::move(p));
+            } else {
+                complete_ = true;
+                wait_.cancel();
+            }
+        }
+    };
+
+    remote_context::remote_context(io::io_context& ioc,
+            const std::shared_ptr<remote_namespace>& ns,
+            const uuid& u, const std::string_view& name, const std::string_view& type,
+            const params& p, bool headless)
+        : context(ioc, u, name, type, p, headless),
+          ns_(ns), conn_(ns->conn_), tree_() {}
+
+    params_stream_ptr
+    remote_context::request(io::yield_ctx& yield, const params& p) {
+        api::Packet req;
+        api::Request* r = req.mutable_request();
+        r->set_uuid(uuid_string(uuid_));
+        p.pack(r->mutable_params());
+
+        auto s = std::make_shared<params_stream>();
+        std::weak_ptr<params_stream> ws = s;
+        std::weak_ptr<remote_namespace> wns = ns_;
+        auto conn = conn_;
+        api::Packet res = conn_->request_stream(yield, std::move(req),
+            [ws, wns, conn] (io::yield_ctx&, const api::Packet& p) {
+                auto s = ws.lock();
+                if (!s) return;
+                if (p.payload_case() == api::Packet::kRequestUpdate) {
+                    auto ns = wns.lock();
+                    s->write(params::unpack(p.request_update(), ns.get()));
+                } else if (p.payload_case() == api::Packet::kCancel) {
+                    conn->close_stream(p.req_id());
+                    s->close();
+                }
+            });
+        int32_t req_id = res.req_id();
+        if (res.payload_case() != api::Packet::kSuccess || !res.success()) {
+            conn_->close_stream(req_id);
+            throw_if_error(res);
+            return nullptr;
+        }
+        // dropping the stream cancels the request
+        s->destroyed.add(s.get(), [conn, req_id] () {
+            conn->close_stream(req_id);
+            api::Packet p;
+            p.set_cancel(0);
+            conn->write_back(req_id, std::move(p));
+        });
+        return s;
+    }
+
+    std::shared_ptr<node>
+    remote_context::fetch(io::yield_ctx& yield) {
+        if (tree_) return tree_;
+        api::Packet req;
+        req.set_fetch_tree(uuid_string(uuid_));
+        api::Packet res = conn_->request_response(yield, std::move(req));
+        throw_if_error(res);
+        if (res.payload_case() != api::Packet::kFetchedTree) return nullptr;
+        // another coroutine may have fetched it while we waited
+        if (tree_) return tree_;
+        tree_ = std::shared_ptr<node>(node::unpack(res.fetched_tree()));
+        tree_->set_owner(weak_from_this());
+        return tree_;
+    }
+
+    subscription_ptr
+    remote_context::subscribe(io::yield_ctx& yield,
+            const std::vector<std::string_view>& variable,
+            float min_interval, float max_interval, float timeout) {
+        return subscribe(yield, variable, min_interval, max_interval,
+                            deadband{}, timeout);
+    }
+
+    subscription_ptr
+    remote_context::subscribe(io::yield_ctx& yield,
+            const std::vector<std::string_view>& variable,
+            float min_interval, float max_interval,
+            const deadband& band, float timeout) {
+        api::Packet req;
+        api::Subscription* s = req.mutable_sub_change();
+        s->set_uuid(uuid_string(uuid_));
+        for (const auto& v : variable) s->add_variable(std::string{v});
+        s->set_debounce(min_interval);
+        s->set_refresh(max_interval);
+        s->set_timeout(timeout);
+        s->set_deadband(band.threshold);
+        s->set_relative(band.relative);
+
+        auto sub = std::make_shared<remote_subscription>(ioc_, conn_,
+                                            min_interval, max_interval, band);
+        std::weak_ptr<remote_subscription> ws = sub;
+        api::Packet res = conn_->request_stream(yield, std::move(req),
+            [ws] (io::yield_ctx& y, const api::Packet& p) {
+                auto s = ws.lock();
+                if (s) s->received(y, p);
+            }, timeout + 1);
+        if (res.payload_case() != api::Packet::kSubType) {
+            conn_->close_stream(res.req_id());
+            throw_if_error(res);
+            return nullptr;
+        }
+        sub->start(res.req_id(), value_type::unpack(res.sub_type()));
+        return sub;
+    }
+
+    subscription_ptr
+    remote_context::subscribe(io::yield_ctx& yield, const variable* v,
+            float min_interval, float max_interval, float timeout) {
+        std::vector<std::string> p = relative_path(v);
+        std::vector<std::string_view> path(p.begin(), p.end());
+        return subscribe(yield, path, min_interval, max_interval, timeout);
+    }
+
+    value
+    remote_context::call(io::yield_ctx& yield, action* a, value v, float timeout) {
+        std::vector<std::string> p = relative_path(a);
+        std::vector<std::string_view> path(p.begin(), p.end());
+        return call(yield, path, v, timeout);
+    }
+
+    value
+    remote_context::call(io::yield_ctx& yield, const std::vector<std::string_view>& a,
+                            value v, float timeout) {
+        api::Packet req;
+        api::Call* c = req.mutable_call_action();
+        c->set_uuid(uuid_string(uuid_));
+        for (const auto& s : a) c->add_action(std::string{s});
+        v.pack(c->mutable_value());
+        c->set_timeout(timeout);
+        // leave the server time to report its own timeout
+        api::Packet res = conn_->request_response(yield, std::move(req), timeout + 1);
+        throw_if_error(res);
+        if (res.payload_case() != api::Packet::kCallReturn) return value::invalid();
+        return value{res.call_return().value()};
+    }
+
+    bool
+    remote_context::write_data(io::yield_ctx& yield, variable* v,
+                                const datapoint_batch& data) {
+        std::vector<std::string> p = relative_path(v);
+        std::vector<std::string_view> path(p.begin(), p.end());
+        return write_data(yield, path, data);
+    }
+
+    bool
+    remote_context::write_data(io::yield_ctx& yield,
+                                const std::vector<std::string_view>& var,
+                                const datapoint_batch& data) {
+        api::Packet req;
+        api::DataWrite* w = req.mutable_data_write();
+        w->set_uuid(uuid_string(uuid_));
+        for (const auto& s : var) w->add_path(std::string{s});
+        data.pack(w->mutable_batch());
+        api::Packet res = conn_->request_response(yield, std::move(req));
+        throw_if_error(res);
+        return res.payload_case() == api::Packet::kSuccess && res.success();
+    }
+
+    data_query_ptr
+    remote_context::query_data(io::yield_ctx& yield, const variable* v, float timeout) {
+        std::vector<std::string> p = relative_path(v);
+        std::vector<std::string_view> path(p.begin(), p.end());
+        return query_data(yield, path, timeout);
+    }
+
+    data_query_ptr
+    remote_context::query_data(io::yield_ctx& yield,
+                                const std::vector<std::string_view>& v, float timeout) {
+        api::Packet req;
+        api::DataQuery* q = req.mutable_data_query();
+        q->set_uuid(uuid_string(uuid_));
+        for (const auto& s : v) q->add_path(std::string{s});
+        q->set_chunk_size(remote_query::chunk_size);
+        q->set_credits(remote_query::credits);
+
+        auto query = std::make_shared<remote_query>(ioc_, conn_);
+        std::weak_ptr<remote_query> wq = query;
+        api::Packet res = conn_->request_stream(yield, std::move(req),
+            [wq] (io::yield_ctx&, const api::Packet& p) {
+                auto q = wq.lock();
+                if (q) q->received(p);
+            }, timeout);
+        if (res.payload_case() != api::Packet::kArchiveData) {
+            conn_->close_stream(res.req_id());
+            throw_if_error(res);
+            return nullptr;
+        }
+        query->start(res.req_id(), res.archive_data());
+        query->wait_complete(yield, timeout);
+        return query;
+    }
+
+    std::vector<std::pair<const variable*, datapoint>>
+    remote_context::snapshot(io::yield_ctx& yield, const std::vector<std::string_view>& path) {
+        std::vector<std::pair<const variable*, datapoint>> values;
+        auto tree = fetch(yield);
+        if (!tree) return values;
+
+        api::Packet req;
+        api::Snapshot* s = req.mutable_snapshot();
+        s->set_uuid(uuid_string(uuid_));
+        for (const auto& p : path) s->add_path(std::string{p});
+        api::Packet res = conn_->request_response(yield, std::move(req));
+        throw_if_error(res);
+        if (res.payload_case() != api::Packet::kSnapshotData) return values;
+
+        for (const auto& e : res.snapshot_data().entries()) {
+            std::vector<std::string_view> p(e.path().begin(), e.path().end());
+            auto v = dynamic_cast<const variable*>(tree->from_path(p));
+            if (!v) continue;
+            // sub_update style timestamp, in microseconds
+            std::chrono::microseconds us{(int64_t) e.value().timestamp()};
+            values.emplace_back(v, datapoint{time_point{us}, value{e.value().value()}});
+        }
+        return values;
+    }
+
+    bool
+    remote_context::query_join(io::yield_ctx& yield,
+                const std::vector<std::vector<std::string_view>>& vars,
+                const join_options& opts, const join_handler& h, float timeout) {
+        api::Packet req;
+        api::JoinQuery* q = req.mutable_join_query();
+        q->set_uuid(uuid_string(uuid_));
+        for (const auto& v : vars) {
+            auto* col = q->add_columns();
+            for (const auto& s : v) col->add_path(std::string{s});
+        }
+        q->set_start(opts.start);
+        q->set_end(opts.end);
+        q->set_step(opts.step);
+        q->set_interpolate(opts.interpolate);
+        q->set_chunk_rows((uint32_t) opts.chunk_rows);
+        q->set_credits(remote_query::credits);
+        q->set_timeout(timeout);
+
+        // the stream outlives this call if it times out
+        struct state {
+            bool done = false;
+            bool progress = false;
+            api::Packet error;
+            io::deadline_timer timer;
+            state(io::io_context& ioc) : timer(ioc) {}
+        };
+        auto st = std::make_shared<state>(ioc_);
+        connection* conn = conn_.get();
+        auto chunk = [st, h, conn] (const api::Packet& p) {
+            if (p.payload_case() != api::Packet::kJoinChunk) {
+                st->error = p;
+                st->done = true;
+            } else {
+                h(joined_table::unpack(p.join_chunk()));
+                st->progress = true;
+                st->done = p.join_chunk().last();
+                if (!st->done) {
+                    // room for another one
+                    api::Packet c;
+                    c.set_data_credit(1);
+                    conn->write_back(p.req_id(), std::move(c));
+                }
+            }
+            if (st->done) st->timer.cancel();
+        };
+        api::Packet res = conn_->request_stream(yield, std::move(req),
+            [chunk] (io::yield_ctx&, const api::Packet& p) { chunk(p); }, timeout);
+        int32_t req_id = res.req_id();
+        chunk(res);
+        while (!st->done) {
+            st->progress = false;
+            st->timer.expires_from_now(boost::posix_time::milliseconds(
+                                        (int64_t) (1000*timeout)));
+            boost::system::error_code ec;
+            st->timer.async_wait(yield.ctx[ec]);
+            if (!st->done && !st->progress) {
+                conn_->close_stream(req_id);
+                throw io_error("join query timed out");
+            }
+        }
+        conn_->close_stream(req_id);
+        if (st->error.payload_case() != api::Packet::PAYLOAD_NOT_SET) {
+            throw_if_error(st->error);
+            return false;
+        }
+        return true;
+    }
+
+    void
+    remote_context::destroy(io::yield_ctx& yield) {
+        auto ns = ns_.lock();
+        if (!ns) return;
+        ns->destroy(yield, uuid_);
+    }
+
+
+    remote_namespace::remote_namespace(io::io_context& ioc,
+                            const std::shared_ptr<connection>& conn,
+                            const std::function<void()>& close)
+        : namespace_(), ioc_(ioc), conn_(conn), close_(close), connected_(true) {}
+
+    remote_namespace::~remote_namespace() {
+        close();
+    }
+
+    void
+    remote_namespace::close() {
+        conn_->reset();
+        if (close_) close_();
+    }
+
+    void
+    remote_namespace::init(io::yield_ctx& yield) {
+        std::weak_ptr<remote_namespace> w = weak_from_this();
+        auto add = [w] (const api::Context& c) {
+            auto ns = w.lock();
+            if (!ns) return;
+            uuid u = boost::lexical_cast<uuid>(c.uuid());
+            if (ns->contexts->get(u)) return;
+            auto ctx = std::make_shared<remote_context>(ns->ioc_, ns, u,
+                    c.name(), c.type(), params::unpack(c.params(), ns.get()),
+                    c.headless());
+            ns->contexts->add_(ctx);
+        };
+        api::Packet req;
+        req.mutable_query_ns();
+        api::Packet res = conn_->request_stream(yield, std::move(req),
+            [w, add] (io::yield_ctx& y, const api::Packet& p) {
+                auto ns = w.lock();
+                if (!ns) return;
+                if (p.payload_case() == api::Packet::kAdded) {
+                    add(p.added());
+                } else if (p.payload_case() == api::Packet::kRemoved) {
+                    uuid u = boost::lexical_cast<uuid>(p.removed());
+                    auto ctx = std::dynamic_pointer_cast<remote_context>(ns->contexts->get(u));
+                    if (!ctx) return;
+                    ns->contexts->remove_by_key_(u);
+                    ctx->removed(y);
+                }
+            });
+        throw_if_error(res);
+        if (res.payload_case() != api::Packet::kNs)
+            throw remote_error("bad namespace reply");
+        for (const auto& c : res.ns().contexts()) add(c);
+    }
+
+    void
+    remote_namespace::on_closed(io::yield_ctx& yield) {
+        if (!connected_) return;
+        connected_ = false;
+        conn_->reset();
+        std::vector<std::shared_ptr<remote_context>> removed;
+        for (const auto& i : *contexts) {
+            auto c = std::dynamic_pointer_cast<remote_context>(i.second);
+            if (c) removed.push_back(c);
+        }
+        for (auto& c : removed) {
+            contexts->remove_by_key_(c->get_uuid());
+            c->removed(yield);
+        }
+        disconnected();
+    }
+
+    context_ptr
+    remote_namespace::create(io::yield_ctx& yield,
+                const std::string_view& name, const std::string_view& type,
+                const params& p) {
+        api::Packet req;
+        api::Create* c = req.mutable_create();
+        c->set_name(std::string{name});
+        c->set_type(std::string{type});
+        p.pack(c->mutable_params());
+        api::Packet res = conn_->request_response(yield, std::move(req), create_timeout);
+        throw_if_error(res);
+        if (res.payload_case() != api::Packet::kCreated) return nullptr;
+        // the added notification is sent ahead of the reply
+        auto ctx = contexts->get(boost::lexical_cast<uuid>(res.created()));
+        if (!ctx) throw remote_error("created context was not announced");
+        return ctx;
+    }
+
+    void
+    remote_namespace::destroy(io::yield_ctx& yield, const uuid& u) {
+        api::Packet req;
+        req.set_destroy(uuid_string(u));
+        api::Packet res = conn_->request_response(yield, std::move(req));
+        throw_if_error(res);
+    }
+
+    template<typename Socket>
+        std::shared_ptr<remote_namespace>
+        remote_namespace::attach(io::yield_ctx& yield, io::io_context& ioc, Socket&& socket) {
+            auto conn = std::make_shared<stream_connection<Socket>>(
+                                ioc, std::move(socket), false);
+            auto ns = std::make_shared<remote_namespace>(ioc, conn,
+                                [conn] () { conn->close(); });
+            std::weak_ptr<remote_namespace> w = ns;
+            conn->closed.add(ns.get(), [w] (io::yield_ctx& y) {
+                auto ns = w.lock();
+                if (ns) ns->on_closed(y);
+            });
+            conn->start();
+            ns->init(yield);
+            return ns;
+        }
+
+    std::shared_ptr<remote_namespace>
+    remote_namespace::connect(io::yield_ctx& yield, io::io_context& ioc,
+                                const boost::asio::ip::tcp::endpoint& ep) {
+        boost::asio::ip::tcp::socket socket(ioc);
+        boost::system::error_code ec;
+        socket.async_connect(ep, yield.ctx[ec]);
+        if (ec) throw io_error("unable to connect: " + ec.message());
+        socket.set_option(boost::asio::ip::tcp::no_delay(true));
+        return attach(yield, ioc, std::move(socket));
+    }
+
+    std::shared_ptr<remote_namespace>
+    remote_namespace::connect(io::yield_ctx& yield, io::io_context& ioc,
+                                const std::string& unix_path) {
+        using stream = boost::asio::local::stream_protocol;
+        stream::socket socket(ioc);
+        boost::system::error_code ec;
+        socket.async_connect(stream::endpoint(unix_path), yield.ctx[ec]);
+        if (ec) throw io_error("unable to connect to " + unix_path + ": " + ec.message());
+        return attach(yield, ioc, std::move(socket));
+    }
+}
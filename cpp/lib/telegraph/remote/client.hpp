@@ -0,0 +1,131 @@
+#ifndef __TELEGRAPH_CLIENT_HPP__
+#define __TELEGRAPH_CLIENT_HPP__
+
+#include "../utils/io.hpp"
+
+#include "api.pb.h"
+
+#include "connection.hpp"
+#include "stream_connection.hpp"
+#include "../common/namespace.hpp"
+#include "../common/nodes.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace telegraph {
+    class remote_context;
+
+    // The client side of the api, over the length-prefixed tcp or unix
+    // socket transports. Mirrors the contexts of the server namespace so
+    // remote contexts can be used wherever local ones are. All requests
+    // are multiplexed over a single connection, so any number of
+    // coroutines can have requests outstanding at once.
+    class remote_namespace :
+            public std::enable_shared_from_this<remote_namespace>,
+            public namespace_ {
+        friend class remote_context;
+    private:
+        io::io_context& ioc_;
+        std::shared_ptr<connection> conn_;
+        // closes the underlying socket
+        std::function<void()> close_;
+        bool connected_;
+    public:
+        remote_namespace(io::io_context& ioc, const std::shared_ptr<connection>& conn,
+                            const std::function<void()>& close);
+        ~remote_namespace();
+
+        static std::shared_ptr<remote_namespace> connect(io::yield_ctx& yield,
+                io::io_context& ioc, const boost::asio::ip::tcp::endpoint& ep);
+        static std::shared_ptr<remote_namespace> connect(io::yield_ctx& yield,
+                io::io_context& ioc, const std::string& unix_path);
+
+        constexpr bool is_connected() const { return connected_; }
+        connection& get_connection() { return *conn_; }
+
+        // fired once if the connection drops, after
+        // all contexts have been removed
+        signal<> disconnected;
+
+        context_ptr create(io::yield_ctx& yield,
+                    const std::string_view& name, const std::string_view& type,
+                    const params& p) override;
+
+        void destroy(io::yield_ctx& yield, const uuid& u) override;
+
+        void close();
+    private:
+        // fetches the contexts and follows added/removed
+        void init(io::yield_ctx& yield);
+        void on_closed(io::yield_ctx& yield);
+
+        template<typename Socket>
+            static std::shared_ptr<remote_namespace> attach(io::yield_ctx& yield,
+                    io::io_context& ioc, Socket&& socket);
+    };
+
+    class remote_context : public context {
+    private:
+        std::weak_ptr<remote_namespace> ns_;
+        std::shared_ptr<connection> conn_;
+        std::shared_ptr<node> tree_; // cached after the first fetch
+    public:
+        remote_context(io::io_context& ioc, const std::shared_ptr<remote_namespace>& ns,
+                const uuid& u, const std::string_view& name, const std::string_view& type,
+                const params& p, bool headless);
+
+        std::shared_ptr<namespace_> get_namespace() override { return ns_.lock(); }
+        std::shared_ptr<const namespace_> get_namespace() const override { return ns_.lock(); }
+
+        params_stream_ptr request(io::yield_ctx& yield, const params& p) override;
+
+        std::shared_ptr<node> fetch(io::yield_ctx& yield) override;
+
+        subscription_ptr subscribe(io::yield_ctx& yield,
+                const std::vector<std::string_view>& variable,
+                float min_interval, float max_interval,
+                float timeout) override;
+        subscription_ptr subscribe(io::yield_ctx& yield,
+                const variable* v,
+                float min_interval, float max_interval,
+                float timeout) override;
+        // the dead-band is sent along with the subscription
+        subscription_ptr subscribe(io::yield_ctx& yield,
+                const std::vector<std::string_view>& variable,
+                float min_interval, float max_interval,
+                const deadband& band, float timeout) override;
+
+        value call(io::yield_ctx& yield, action* a, value v, float timeout) override;
+        value call(io::yield_ctx& yield, const std::vector<std::string_view>& a,
+                    value v, float timeout) override;
+
+        bool write_data(io::yield_ctx& yield, variable* v,
+                            const datapoint_batch& data) override;
+        bool write_data(io::yield_ctx& yield, const std::vector<std::string_view>& var,
+                            const datapoint_batch& data) override;
+
+        data_query_ptr query_data(io::yield_ctx& yield, const variable* v, float timeout) override;
+        data_query_ptr query_data(io::yield_ctx& yield, const std::vector<std::string_view>& v, float timeout) override;
+
+        std::vector<std::pair<const variable*, datapoint>>
+            snapshot(io::yield_ctx& yield, const std::vector<std::string_view>& path) override;
+
+        // the join runs on the server, only the table is sent
+        bool query_join(io::yield_ctx& yield,
+                    const std::vector<std::vector<std::string_view>>& vars,
+                    const join_options& opts, const join_handler& h, float timeout) override;
+
+        void destroy(io::yield_ctx& yield) override;
+
+        // called by the namespace when the context goes away on the server
+        void removed(io::yield_ctx& yield) { destroyed(yield); }
+    };
+}
+
+#endif
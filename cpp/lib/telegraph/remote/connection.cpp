@@ -26,9 +26,12 @@ namespace telegraph {
             // for the first reply
             return;
         }
-        if (open_streams_.find(p.req_id()) != open_streams_.end()) {
-            // call the stream handler
-            open_streams_.at(p.req_id())(yield, p);
+        auto it = open_streams_.find(p.req_id());
+        if (it != open_streams_.end()) {
+            // call the stream handler, on a copy since
+            // the handler may close its own stream
+            handler h = it->second;
+            h(yield, p);
             return;
         }
         if (handlers_.find(p.payload_case()) != handlers_.end()) {
@@ -37,21 +40,25 @@ namespace telegraph {
     }
 
     api::Packet
-    connection::request_response(io::yield_ctx& yield, api::Packet&& req) {
-        int32_t id = counter_++;
+    connection::await_response(io::yield_ctx& yield, int32_t id,
+                                api::Packet&& req, float timeout) {
         req.set_req_id(id);
 
-        io::deadline_timer timeout(ioc_, boost::posix_time::seconds(1));
+        io::deadline_timer timer(ioc_, boost::posix_time::milliseconds(
+                                    (int64_t) (1000*timeout)));
         api::Packet res;
 
-        response res_handler(timeout, res);
+        response res_handler(timer, res);
         open_requests_.emplace(std::make_pair(id, res_handler));
 
         send(std::move(req));
 
         boost::system::error_code error;
-        timeout.async_wait(yield.ctx[error]);
+        timer.async_wait(yield.ctx[error]);
         if (error != io::error::operation_aborted) {
+            // the entry refers to this frame
+            open_requests_.erase(id);
+            open_streams_.erase(id);
             throw io_error("request timed out");
         }
 
@@ -59,26 +66,16 @@ namespace telegraph {
     }
 
     api::Packet
-    connection::request_stream(io::yield_ctx& yield, api::Packet&& req, const handler& h) {
-        int32_t id = counter_++;
-        req.set_req_id(id);
-
-        io::deadline_timer timeout(ioc_, boost::posix_time::seconds(1));
-        api::Packet res;
+    connection::request_response(io::yield_ctx& yield, api::Packet&& req, float timeout) {
+        return await_response(yield, next_id(), std::move(req), timeout);
+    }
 
-        response res_handler(timeout, res);
-        open_requests_.emplace(std::make_pair(id, res_handler));
+    api::Packet
+    connection::request_stream(io::yield_ctx& yield, api::Packet&& req,
+                                const handler& h, float timeout) {
+        int32_t id = next_id();
         open_streams_.emplace(std::make_pair(id, h));
-
-        send(std::move(req));
-
-        boost::system::error_code error;
-        timeout.async_wait(yield.ctx[error]);
-        if (error != io::error::operation_aborted) {
-            throw io_error("request timed out");
-        }
-
-        return res;
+        return await_response(yield, id, std::move(req), timeout);
     }
 
     void
@@ -101,4 +98,10 @@ namespace telegraph {
     connection::close_stream(int32_t stream_id) {
         open_streams_.erase(stream_id);
     }
+
+    void
+    connection::reset() {
+        open_streams_.clear();
+        handlers_.clear();
+    }
 }
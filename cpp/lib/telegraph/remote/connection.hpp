@@ -46,9 +46,13 @@ namespace telegraph {
 
         virtual void send(api::Packet&& p) = 0;
 
-        // request-response pair
-        api::Packet request_response(io::yield_ctx& yield, api::Packet&& req);
-        api::Packet request_stream(io::yield_ctx& yield, api::Packet&& req, const handler& cb);
+        // request-response pair, any number of requests
+        // can be outstanding at once (from different coroutines)
+        api::Packet request_response(io::yield_ctx& yield, api::Packet&& req,
+                                        float timeout=1);
+        // the handler gets everything after the first response
+        api::Packet request_stream(io::yield_ctx& yield, api::Packet&& req,
+                                        const handler& cb, float timeout=1);
 
         void set_handler(api::Packet::PayloadCase c, const handler& h);
         void set_stream_cb(int32_t req_id, const handler& h);
@@ -56,6 +60,13 @@ namespace telegraph {
         void write_back(int32_t req_id, api::Packet&& p);
 
         void close_stream(int32_t req_id);
+
+        // drops all handlers and streams, outstanding requests time out
+        void reset();
+    private:
+        int32_t next_id() { return count_down_ ? counter_-- : counter_++; }
+        api::Packet await_response(io::yield_ctx& yield, int32_t id,
+                                    api::Packet&& req, float timeout);
     };
 }
 
@@ -7,14 +7,17 @@
 #include "api.pb.h"
 
 #include "api.pb.h"
+#include "../utils/uuid.hpp"
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
 #include <string_view>
 
 namespace telegraph {
 
-    forwarder::forwarder(connection& conn, const std::shared_ptr<namespace_>& ns)
-        : conn_(conn), ns_(ns) {
+    forwarder::forwarder(connection& conn, const std::shared_ptr<namespace_>& ns,
+                            uint32_t max_shm_capacity)
+        : conn_(conn), ns_(ns), max_shm_capacity_(max_shm_capacity) {
         if (!ns_) return;
         // set the handlers
         conn_.set_handler(api::Packet::kQueryNs, 
@@ -35,6 +38,12 @@ namespace telegraph {
                 [this] (io::yield_ctx& c, const api::Packet& p) { handle_data_write(c, p); });
         conn_.set_handler(api::Packet::kDataQuery,
                 [this] (io::yield_ctx& c, const api::Packet& p) { handle_data_query(c, p); });
+        conn_.set_handler(api::Packet::kSnapshot,
+                [this] (io::yield_ctx& c, const api::Packet& p) { handle_snapshot(c, p); });
+        conn_.set_handler(api::Packet::kJoinQuery,
+                [this] (io::yield_ctx& c, const api::Packet& p) { handle_join_query(c, p); });
+        conn_.set_handler(api::Packet::kShmOpen,
+                [this] (io::yield_ctx& c, const api::Packet& p) { handle_shm_open(c, p); });
 
     }
 
@@ -61,6 +70,8 @@ namespace telegraph {
         for (auto& s : queries_) {
             s.second->data.remove(this);
         }
+        histories_.clear();
+        joins_.clear();
     }
 
     void
@@ -144,6 +155,7 @@ namespace telegraph {
             float db = cs.debounce();
             float rf = cs.refresh();
             float timeout = cs.timeout();
+            deadband band{cs.deadband(), cs.relative()};
 
             auto it = subs_.find(req_id);
 
@@ -155,14 +167,21 @@ namespace telegraph {
                 }
                 auto ctx = ns_->contexts->get(ctx_uuid);
                 if (!ctx) throw missing_error("no such context");
-                auto sub = ctx->subscribe(c, path, db, rf, timeout);
+                auto sub = ctx->subscribe(c, path, db, rf, band, timeout);
                 if (!sub) {
                     api::Packet r;
                     r.set_success(false);
                     conn_.write_back(req_id, std::move(r));
                     return;
                 }
-                sub->data.add(this, [this, req_id](value v) {
+                sub->data.add(this, [this, req_id, shm = cs.shm()](value v) {
+                    // same-host clients read straight from the ring, a full
+                    // ring drops the update (counted in the ring header).
+                    // blocks don't fit a record and take the packet path
+                    if (shm && ring_ && v.get_type_class() != value_type::Block) {
+                        ring_->push(req_id, datapoint::now(), v);
+                        return;
+                    }
                     // write the data back
                     api::Packet p;
                     datapoint dp{datapoint::now(), v};
@@ -183,9 +202,11 @@ namespace telegraph {
                             const api::Subscription& s = p.sub_change();
                             bool success = false;
                             try {
-                                subs_.at(p.req_id())->change(yield,
+                                const auto& sub = subs_.at(p.req_id());
+                                deadband band{s.deadband(), s.relative()};
+                                sub->change(yield,
                                         s.debounce(), s.refresh(),
-                                        s.timeout());
+                                        band, s.timeout());
                                 success = true;
                             } catch (...) {}
                             api::Packet r;
@@ -205,8 +226,7 @@ namespace telegraph {
                 // put in subs map
                 subs_.emplace(std::make_pair(req_id, std::move(sub)));
             } else {
-                const auto& sub = it->second;
-                sub->change(c, db, rf, timeout);
+                it->second->change(c, db, rf, band, timeout);
             }
         } catch (const std::exception& e) {
             reply_error(p, e);
@@ -246,13 +266,16 @@ namespace telegraph {
             const auto& req = p.data_write();
 
             uuid u = boost::lexical_cast<uuid>(req.uuid());
-            std::vector<datapoint> data;
-            for (const Datapoint& v : req.data()) {
-                uint64_t millisecs = v.timestamp();
-                std::chrono::milliseconds m{millisecs};
-                time_point tp{m};
-                data.push_back(datapoint{tp,
-                               value{v.value()}});
+            datapoint_batch data;
+            if (req.has_batch()) {
+                data = datapoint_batch::unpack(req.batch());
+            } else {
+                data.reserve(req.data_size());
+                for (const Datapoint& v : req.data()) {
+                    uint64_t millisecs = v.timestamp();
+                    std::chrono::milliseconds m{millisecs};
+                    data.push_back(time_point{m}, value{v.value()});
+                }
             }
             std::vector<std::string_view> path;
             for (const auto& s : req.path()) {
@@ -282,26 +305,205 @@ namespace telegraph {
             }
             auto ctx = ns_->contexts->get(u);
             if (!ctx) throw missing_error("no such context");
-            auto q = ctx->query_data(c, path);
-            q->data.add(this, [this, req_id](const std::vector<datapoint>& data) {
-                api::Packet p;
-                api::DataPacket* pack = p.mutable_archive_update();
-                for (const datapoint& dp : data) {
-                    Datapoint* d = pack->add_data();
-                    auto dur = dp.get_time().time_since_epoch();
-                    uint64_t ts = (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-                    d->set_timestamp(ts);
-                    dp.get_value().pack(d->mutable_value());
-                }
-                conn_.write_back(req_id, std::move(p));
-            });
+            auto q = ctx->query_data(c, path, 1);
+            if (!q) {
+                api::Packet r;
+                r.set_success(false);
+                conn_.write_back(req_id, std::move(r));
+                return;
+            }
             conn_.set_stream_cb(req_id,
                 [this](io::yield_ctx& yield, const api::Packet& p) {
                     if (p.payload_case() == api::Packet::kCancel) {
+                        histories_.erase(p.req_id());
                         queries_.erase(p.req_id());
+                    } else if (p.payload_case() == api::Packet::kDataCredit) {
+                        auto it = histories_.find(p.req_id());
+                        if (it == histories_.end()) return;
+                        it->second.credits += p.data_credit();
+                        send_history(p.req_id());
                     }
                 });
-            queries_.emplace(req_id, q);
+            if (!req.chunk_size()) {
+                // the initial reply carries everything archived so far
+                api::Packet initial;
+                q->get_current().pack(initial.mutable_archive_data()->mutable_batch());
+                conn_.write_back(req_id, std::move(initial));
+                forward_updates(req_id, q);
+                return;
+            }
+            history_stream h{q, q->cursor(), req.chunk_size(),
+                             std::max<uint32_t>(req.credits(), 1), datapoint_batch{}};
+            h.cursor->next(h.chunk_size, h.next);
+            histories_.emplace(req_id, std::move(h));
+            send_history(req_id);
+        } catch (const std::exception& e) {
+            reply_error(p, e);
+        }
+    }
+
+    void
+    forwarder::send_history(int32_t req_id) {
+        auto it = histories_.find(req_id);
+        if (it == histories_.end()) return;
+        history_stream& h = it->second;
+        while (h.credits > 0) {
+            // the first is sent even if it is empty, as the reply
+            api::Packet p;
+            api::DataPacket* d = p.mutable_archive_data();
+            h.next.pack(d->mutable_batch());
+            h.cursor->next(h.chunk_size, h.next);
+            bool more = !h.next.empty();
+            d->set_more(more);
+            conn_.write_back(req_id, std::move(p));
+            h.credits--;
+            if (!more) {
+                // caught up, nothing was written since the last read
+                data_query_ptr q = std::move(h.query);
+                histories_.erase(it);
+                forward_updates(req_id, q);
+                return;
+            }
+        }
+    }
+
+    void
+    forwarder::forward_updates(int32_t req_id, const data_query_ptr& q) {
+        q->data.add(this, [this, req_id](const datapoint_batch& data) {
+            api::Packet p;
+            data.pack(p.mutable_archive_update()->mutable_batch());
+            conn_.write_back(req_id, std::move(p));
+        });
+        queries_.emplace(req_id, q);
+    }
+
+    void
+    forwarder::handle_snapshot(io::yield_ctx& c, const api::Packet& p) {
+        try {
+            const auto& req = p.snapshot();
+            uuid u = boost::lexical_cast<uuid>(req.uuid());
+            std::vector<std::string_view> path;
+            for (const auto& s : req.path()) {
+                path.push_back(s);
+            }
+            auto ctx = ns_->contexts->get(u);
+            if (!ctx) throw missing_error("no such context");
+
+            api::Packet res;
+            api::SnapshotData* snap = res.mutable_snapshot_data();
+            for (auto& e : ctx->snapshot(c, path)) {
+                api::SnapshotEntry* entry = snap->add_entries();
+                // paths are relative to the root, like subscribe paths
+                std::vector<std::string> vp = e.first->path();
+                for (size_t i = 1; i < vp.size(); i++) {
+                    entry->add_path(std::move(vp[i]));
+                }
+                e.second.pack(entry->mutable_value());
+            }
+            conn_.write_back(p.req_id(), std::move(res));
+        } catch (const std::exception& e) {
+            reply_error(p, e);
+        }
+    }
+
+    void
+    forwarder::handle_join_query(io::yield_ctx& c, const api::Packet& p) {
+        try {
+            int32_t req_id = p.req_id();
+            const auto& req = p.join_query();
+            uuid u = boost::lexical_cast<uuid>(req.uuid());
+            auto ctx = ns_->contexts->get(u);
+            if (!ctx) throw missing_error("no such context");
+            std::vector<std::vector<std::string_view>> vars;
+            for (const auto& col : req.columns()) {
+                vars.emplace_back(col.path().begin(), col.path().end());
+            }
+            join_options opts;
+            opts.start = req.start();
+            opts.end = req.end();
+            opts.step = req.step();
+            opts.interpolate = req.interpolate();
+            if (req.chunk_rows()) opts.chunk_rows = req.chunk_rows();
+            float timeout = req.timeout() > 0 ? req.timeout() : 1;
+
+            auto j = ctx->open_join(c, vars, opts, timeout);
+            if (!j) {
+                api::Packet r;
+                r.set_success(false);
+                conn_.write_back(req_id, std::move(r));
+                return;
+            }
+            conn_.set_stream_cb(req_id,
+                [this](io::yield_ctx& yield, const api::Packet& p) {
+                    if (p.payload_case() == api::Packet::kCancel) {
+                        joins_.erase(p.req_id());
+                        conn_.close_stream(p.req_id());
+                    } else if (p.payload_case() == api::Packet::kDataCredit) {
+                        auto it = joins_.find(p.req_id());
+                        if (it == joins_.end()) return;
+                        it->second.credits += p.data_credit();
+                        send_join(p.req_id());
+                    }
+                });
+            join_stream js{std::move(j), std::max<uint32_t>(req.credits(), 1), joined_table{}, false};
+            js.has_next = js.cursor->next(js.next);
+            joins_.emplace(req_id, std::move(js));
+            send_join(req_id);
+        } catch (const std::exception& e) {
+            conn_.close_stream(p.req_id());
+            reply_error(p, e);
+        }
+    }
+
+    void
+    forwarder::send_join(int32_t req_id) {
+        auto it = joins_.find(req_id);
+        if (it == joins_.end()) return;
+        join_stream& j = it->second;
+        try {
+            while (j.credits > 0) {
+                // the first is sent even if it is empty, as the reply
+                api::Packet p;
+                api::JoinChunk* chunk = p.mutable_join_chunk();
+                if (j.has_next) j.next.pack(chunk);
+                j.has_next = j.cursor->next(j.next);
+                chunk->set_last(!j.has_next);
+                conn_.write_back(req_id, std::move(p));
+                j.credits--;
+                if (!j.has_next) break;
+            }
+        } catch (const std::exception& e) {
+            api::Packet res;
+            res.set_error(e.what());
+            conn_.write_back(req_id, std::move(res));
+            j.has_next = false;
+        }
+        if (!j.has_next) {
+            joins_.erase(it);
+            conn_.close_stream(req_id);
+        }
+    }
+
+    void
+    forwarder::handle_shm_open(io::yield_ctx& c, const api::Packet& p) {
+        try {
+            if (!max_shm_capacity_) {
+                throw remote_error("shared memory is only offered over the unix socket");
+            }
+            if (!ring_) {
+                std::string name = "/telegraph-" + boost::lexical_cast<std::string>(rand_uuid());
+                // the ring rounds up to a power of two, stay within the limit
+                uint32_t limit = 1;
+                while (limit <= max_shm_capacity_ / 2) limit <<= 1;
+                uint32_t cap = std::clamp<uint32_t>(p.shm_open().capacity(), 1, limit);
+                ring_ = shm_ring::create(name, cap);
+            }
+            api::Packet res;
+            api::ShmRing* r = res.mutable_shm_ring();
+            r->set_name(ring_->get_name());
+            r->set_capacity(ring_->capacity());
+            r->set_record_size(sizeof(shm_record));
+            conn_.write_back(p.req_id(), std::move(res));
         } catch (const std::exception& e) {
             reply_error(p, e);
         }
@@ -11,6 +11,7 @@
 #include "../common/collection.hpp"
 #include "../common/data.hpp"
 #include "../common/namespace.hpp"
+#include "../common/shm_ring.hpp"
 
 #include <unordered_map>
 
@@ -29,10 +30,33 @@ namespace telegraph {
         // active component query streams
         std::unordered_map<int32_t, params_stream_ptr> streams_;
         std::unordered_map<int32_t, data_query_ptr> queries_;
+        // queries still sending their history in chunks
+        struct history_stream {
+            data_query_ptr query;
+            std::unique_ptr<data_cursor> cursor;
+            size_t chunk_size;
+            uint32_t credits; // archive_data packets the client takes
+            datapoint_batch next; // read ahead, to mark the last one
+        };
+        std::unordered_map<int32_t, history_stream> histories_;
+        // joins sending their chunks
+        struct join_stream {
+            std::unique_ptr<join_cursor> cursor;
+            uint32_t credits; // join_chunk packets the client takes
+            joined_table next; // read ahead, to mark the last one
+            bool has_next;
+        };
+        std::unordered_map<int32_t, join_stream> joins_;
+        // shared-memory data plane, if the client asked for one
+        shm_ring_ptr ring_;
+        // most records the ring may hold, 0 if the client
+        // isn't known to be on this host
+        uint32_t max_shm_capacity_;
     public:
         // will register handlers
         forwarder(connection& conn, 
-                const std::shared_ptr<namespace_>& ns);
+                const std::shared_ptr<namespace_>& ns,
+                uint32_t max_shm_capacity = 0);
         ~forwarder();
     private:
         void reply_error(const api::Packet& p, const std::exception& e);
@@ -48,6 +72,14 @@ namespace telegraph {
 
         void handle_data_write(io::yield_ctx&, const api::Packet& p);
         void handle_data_query(io::yield_ctx&, const api::Packet& p);
+        // sends history chunks while there are credits, then the updates
+        void send_history(int32_t req_id);
+        void forward_updates(int32_t req_id, const data_query_ptr& q);
+        void handle_snapshot(io::yield_ctx&, const api::Packet& p);
+        void handle_join_query(io::yield_ctx&, const api::Packet& p);
+        // sends join chunks while there are credits
+        void send_join(int32_t req_id);
+        void handle_shm_open(io::yield_ctx&, const api::Packet& p);
 
         void handle_create(io::yield_ctx&, const api::Packet& p);
         void handle_destroy(io::yield_ctx&, const api::Packet& p);
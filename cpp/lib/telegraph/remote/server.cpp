@@ -4,6 +4,13 @@
 
 #include <boost/asio/strand.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/deadline_timer.hpp>
+
+#include <google/protobuf/arena.h>
+
+#include <array>
+#include <filesystem>
+#include <functional>
 
 using tcp = boost::asio::ip::tcp;
 namespace net = boost::asio;
@@ -12,35 +19,111 @@ namespace http = beast::http;
 namespace websocket = beast::websocket;
 
 namespace telegraph {
+    using unix_socket = net::local::stream_protocol::socket;
+
     server::server(io::io_context& ioc, tcp::endpoint ep, 
             const std::shared_ptr<namespace_>& local) 
-        : ioc_(ioc), ep_(ep),
-          local_(local) {}
+        : ioc_(ioc), opts_(),
+          local_(local) {
+        opts_.websocket = ep;
+    }
 
-    void
-    server::run(io::yield_ctx& cyield) {
-        // unwrap
-        io::yield_context yield = cyield.ctx;
+    server::server(io::io_context& ioc, const options& opts,
+            const std::shared_ptr<namespace_>& local)
+        : ioc_(ioc), opts_(opts), local_(local) {}
+
+    template<typename Acceptor>
+        static void open_acceptor(Acceptor& acceptor,
+                        const typename Acceptor::endpoint_type& ep) {
+            beast::error_code ec;
+            acceptor.open(ep.protocol(), ec);
+            if (ec) throw io_error("failed to open server socket");
+
+            acceptor.set_option(net::socket_base::reuse_address(true), ec);
+            if (ec) throw io_error("failed to set server socket options");
 
-        beast::error_code ec;
+            acceptor.bind(ep, ec);
+            if (ec) throw io_error("failed to bind to server socket");
 
-        tcp::acceptor acceptor(ioc_);
-        acceptor.open(ep_.protocol(), ec);
-        if (ec) throw io_error("failed to open server socket");
+            acceptor.listen(net::socket_base::max_listen_connections, ec);
+            if (ec) throw io_error("failed to listen to server socket");
+        }
+
+    void
+    server::run(io::yield_ctx& cyield) {
+        // all listeners are opened up front so that
+        // a bad option fails before anything is accepted
+        std::vector<std::function<void(io::yield_ctx&)>> loops;
+        if (opts_.websocket) {
+            auto a = std::make_shared<tcp::acceptor>(ioc_);
+            open_acceptor(*a, *opts_.websocket);
+            loops.push_back([this, a](io::yield_ctx& y) { accept_websocket(y, *a); });
+        }
+        if (opts_.tcp) {
+            auto a = std::make_shared<tcp::acceptor>(ioc_);
+            open_acceptor(*a, *opts_.tcp);
+            loops.push_back([this, a](io::yield_ctx& y) { accept_tcp(y, *a); });
+        }
+        if (opts_.unix_path) {
+            // a stale socket file from a previous run blocks the bind,
+            // but anything else at the path is not ours to remove
+            std::error_code fec;
+            auto st = std::filesystem::symlink_status(*opts_.unix_path, fec);
+            if (std::filesystem::is_socket(st)) {
+                std::filesystem::remove(*opts_.unix_path, fec);
+            } else if (std::filesystem::exists(st)) {
+                throw io_error("unix socket path exists and is not a socket");
+            }
+            auto a = std::make_shared<net::local::stream_protocol::acceptor>(ioc_);
+            open_acceptor(*a, net::local::stream_protocol::endpoint{*opts_.unix_path});
+            loops.push_back([this, a](io::yield_ctx& y) { accept_unix(y, *a); });
+        }
+        if (loops.empty()) throw io_error("no server listeners enabled");
 
-        acceptor.set_option(net::socket_base::reuse_address(true), ec);
-        if (ec) throw io_error("failed to set server socket options");
+        // the last listener runs here so run() never returns
+        for (size_t i = 0; i + 1 < loops.size(); i++) {
+            io::spawn(ioc_, [l = loops[i]] (io::yield_context yield) {
+                io::yield_ctx c(yield);
+                l(c);
+            });
+        }
+        loops.back()(cyield);
+    }
 
-        acceptor.bind(ep_, ec);
-        if (ec) throw io_error("failed to bind to server socket");
+    // how long to wait before accepting again when
+    // the process is out of file descriptors or memory
+    static constexpr long accept_backoff_ms = 100;
 
-        acceptor.listen(net::socket_base::max_listen_connections, ec);
-        if (ec) throw io_error("failed to listen to server socket");
+    // whether the accept loop should carry on after a failed accept
+    static bool retry_accept(io::io_context& ioc, io::yield_context& yield,
+                                const beast::error_code& ec) {
+        if (ec == net::error::operation_aborted) return false;
+        if (ec == net::error::no_descriptors // EMFILE
+                || ec == boost::system::errc::too_many_files_open_in_system
+                || ec == net::error::no_buffer_space
+                || ec == net::error::no_memory) {
+            // the pending connection stays queued, retrying
+            // straight away would only spin on the same error
+            io::deadline_timer backoff(ioc,
+                    boost::posix_time::milliseconds(accept_backoff_ms));
+            beast::error_code tec;
+            backoff.async_wait(yield[tec]);
+        }
+        return true;
+    }
 
+    void
+    server::accept_websocket(io::yield_ctx& cyield, tcp::acceptor& acceptor) {
+        io::yield_context yield = cyield.ctx;
         while (true) {
+            beast::error_code ec;
             // create a socket with its own strand
             tcp::socket socket(net::make_strand(ioc_));
             acceptor.async_accept(socket, yield[ec]);
+            if (ec) {
+                if (!retry_accept(ioc_, yield, ec)) break;
+                continue;
+            }
             // we have a socket!
             // create a connection
             std::shared_ptr<remote> conn = std::make_shared<remote>(ioc_, std::move(socket), local_);
@@ -48,15 +131,67 @@ namespace telegraph {
         }
     }
 
+    void
+    server::accept_tcp(io::yield_ctx& cyield, tcp::acceptor& acceptor) {
+        io::yield_context yield = cyield.ctx;
+        while (true) {
+            beast::error_code ec;
+            tcp::socket socket(net::make_strand(ioc_));
+            acceptor.async_accept(socket, yield[ec]);
+            if (ec) {
+                if (!retry_accept(ioc_, yield, ec)) break;
+                continue;
+            }
+            // small request/response packets, don't wait to coalesce them
+            socket.set_option(tcp::no_delay(true), ec);
+            auto conn = std::make_shared<stream_remote<tcp::socket>>(
+                                ioc_, std::move(socket), local_);
+            conn->start();
+        }
+    }
+
+    void
+    server::accept_unix(io::yield_ctx& cyield,
+                net::local::stream_protocol::acceptor& acceptor) {
+        io::yield_context yield = cyield.ctx;
+        while (true) {
+            beast::error_code ec;
+            unix_socket socket(net::make_strand(ioc_));
+            acceptor.async_accept(socket, yield[ec]);
+            if (ec) {
+                if (!retry_accept(ioc_, yield, ec)) break;
+                continue;
+            }
+            auto conn = std::make_shared<stream_remote<unix_socket>>(
+                                ioc_, std::move(socket), local_, opts_.max_shm_records);
+            conn->start();
+        }
+    }
+
     server::remote::remote(io::io_context& ioc,
             tcp::socket&& socket, 
             const std::shared_ptr<namespace_>& local) 
         : connection(ioc, true), local_fwd_(*this, local),
           ws_(std::move(socket)) {}
 
+    // arena memory retained between resets when reading,
+    // small packets never hit the heap
+    static constexpr size_t arena_block_size = 4096;
+    // number of recycled write buffers kept around per connection
+    static constexpr size_t max_spare_bufs = 16;
+
     void
     server::remote::send(api::Packet&& p) {
-        write_queue_.emplace_back(std::move(p));
+        std::vector<uint8_t> buf;
+        if (!spare_bufs_.empty()) {
+            buf = std::move(spare_bufs_.back());
+            spare_bufs_.pop_back();
+        }
+        // serialize directly into the pre-sized buffer
+        buf.resize(p.ByteSizeLong());
+        p.SerializeWithCachedSizesToArray(buf.data());
+
+        write_queue_.emplace_back(std::move(buf));
         if (write_queue_.size() > 1) return;
         do_write_next();
     }
@@ -93,12 +228,19 @@ namespace telegraph {
         io::spawn(ws_.get_executor(), [s] (io::yield_context yield) {
             io::yield_ctx cyield(yield);
 
-            io::streambuf read_buf;
-            api::Packet read_packet;
+            // websocket frames are read into a single
+            // contiguous buffer and parsed in place
+            beast::flat_buffer read_buf;
+
+            // packets are allocated from an arena which is
+            // reset once the previous batch has been handled
+            std::array<char, arena_block_size> initial_block;
+            google::protobuf::ArenaOptions opts;
+            opts.initial_block = initial_block.data();
+            opts.initial_block_size = initial_block.size();
+            google::protobuf::Arena arena(opts);
 
-            int i = 0;
             while (true) {
-                i++;
                 beast::error_code ec;
                 s->ws_.async_read(read_buf, yield[ec]);
 
@@ -108,15 +250,18 @@ namespace telegraph {
                     std::cerr << "error: " << ec.message() << " " << ec << std::endl;
                 }
                 if (ec) break;
-                {
-                    std::istream input_stream(&read_buf);
-                    read_packet.ParseFromIstream(&input_stream);
-                }
-                // should be no bytes left but just in case
+
+                api::Packet* read_packet =
+                    google::protobuf::Arena::CreateMessage<api::Packet>(&arena);
+                auto data = read_buf.data();
+                bool parsed = read_packet->ParseFromArray(data.data(), (int) data.size());
                 read_buf.consume(read_buf.size());
                 // handle the packets synchronously
                 // for now (TODO: Switch to parallel handling)
-                s->received(cyield, read_packet);
+                if (parsed) s->received(cyield, *read_packet);
+                // received() has fully processed the packet, so
+                // the arena can be released if it grew past the first block
+                if (arena.SpaceUsed() > arena_block_size) arena.Reset();
             }
         });
     }
@@ -124,18 +269,16 @@ namespace telegraph {
     void
     server::remote::do_write_next() {
         if (write_queue_.size() == 0) return;
-        auto p = std::move(write_queue_.front());
-        {
-            std::ostream output_stream(&write_buf_);
-            p.SerializeToOstream(&output_stream);
-            output_stream.flush();
-        }
+        const auto& buf = write_queue_.front();
 
         auto shared = shared_from_this();
-        ws_.async_write(write_buf_.data(),
+        ws_.async_write(io::buffer(buf),
                 [shared] (const boost::system::error_code& ec, size_t transferred) {
-                    shared->write_buf_.consume(transferred);
-                    shared->write_queue_.pop_front();
+                    auto& q = shared->write_queue_;
+                    if (shared->spare_bufs_.size() < max_spare_bufs) {
+                        shared->spare_bufs_.emplace_back(std::move(q.front()));
+                    }
+                    q.pop_front();
                     if (ec) return;
                     shared->do_write_next();
                 });
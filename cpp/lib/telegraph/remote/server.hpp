@@ -6,23 +6,42 @@
 #include "api.pb.h"
 
 #include "connection.hpp"
+#include "stream_connection.hpp"
 #include "forwarder.hpp"
 #include "../common/namespace.hpp"
 
 #include <unordered_map>
 #include <memory>
 #include <deque>
+#include <optional>
+#include <string>
 
-#include <boost/asio/streambuf.hpp>
+#include <vector>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 
 
 namespace telegraph {
     class server {
+    public:
+        // any combination of listeners can be enabled
+        struct options {
+            // websocket over tcp, for browsers
+            std::optional<boost::asio::ip::tcp::endpoint> websocket;
+            // packets prefixed with their length (32-bit little-endian),
+            // for co-located processes which don't need the websocket layer
+            std::optional<boost::asio::ip::tcp::endpoint> tcp;
+            std::optional<std::string> unix_path;
+            // most records in the shared-memory ring of a unix socket
+            // client (24 bytes each), other transports get none
+            uint32_t max_shm_records = 1u << 16;
+        };
     private:
         io::io_context& ioc_;
-        boost::asio::ip::tcp::endpoint ep_;
+        options opts_;
         std::shared_ptr<namespace_> local_;
     public:
         class remote : 
@@ -33,8 +52,10 @@ namespace telegraph {
             boost::beast::websocket::stream<
                 boost::beast::tcp_stream> ws_;
 
-            std::deque<api::Packet> write_queue_;
-            io::streambuf write_buf_;
+            // packets are serialized on send() into
+            // pre-sized buffers, which are recycled once written
+            std::deque<std::vector<uint8_t>> write_queue_;
+            std::vector<std::vector<uint8_t>> spare_bufs_;
         public:
             remote(io::io_context& ioc,
                    boost::asio::ip::tcp::socket&& socket, 
@@ -50,12 +71,35 @@ namespace telegraph {
             void do_write_next();
         };
 
+        // a connection over a plain byte stream (tcp or unix socket)
+        // with length-prefixed packets
+        template<typename Socket>
+            class stream_remote : public stream_connection<Socket> {
+            private:
+                forwarder local_fwd_;
+            public:
+                stream_remote(io::io_context& ioc, Socket&& socket,
+                        const std::shared_ptr<namespace_>& local,
+                        uint32_t max_shm_capacity = 0)
+                    : stream_connection<Socket>(ioc, std::move(socket), true),
+                      local_fwd_(*this, local, max_shm_capacity) {}
+            };
+
         server(io::io_context& ioc, 
             boost::asio::ip::tcp::endpoint ep,
             const std::shared_ptr<namespace_>& local);
+        server(io::io_context& ioc, const options& opts,
+            const std::shared_ptr<namespace_>& local);
 
         // will handle exceptions
         void run(io::yield_ctx& yield);
+    private:
+        void accept_websocket(io::yield_ctx& yield,
+                    boost::asio::ip::tcp::acceptor& acceptor);
+        void accept_tcp(io::yield_ctx& yield,
+                    boost::asio::ip::tcp::acceptor& acceptor);
+        void accept_unix(io::yield_ctx& yield,
+                    boost::asio::local::stream_protocol::acceptor& acceptor);
     };
 }
 
@@ -0,0 +1,186 @@
+#ifndef __TELEGRAPH_STREAM_CONNECTION_HPP__
+#define __TELEGRAPH_STREAM_CONNECTION_HPP__
+
+#include "../utils/io.hpp"
+#include "../utils/signal.hpp"
+#include "../utils/uring.hpp"
+
+#include "api.pb.h"
+#include "connection.hpp"
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+
+#include <google/protobuf/arena.h>
+
+#include <array>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace telegraph {
+    // A connection over a plain byte stream (a tcp or unix socket),
+    // every packet is prefixed with its length (32-bit little-endian).
+    // Used by both the server and the client side.
+    template<typename Socket>
+        class stream_connection :
+            public std::enable_shared_from_this<stream_connection<Socket>>,
+            public connection {
+        public:
+            // largest packet accepted
+            static constexpr uint32_t max_packet_size = 64*1024*1024;
+            // bytes requested from the socket per read
+            static constexpr size_t read_chunk_size = 16*1024;
+            // arena memory retained between resets when reading
+            static constexpr size_t arena_block_size = 4096;
+            // number of recycled write buffers kept around
+            static constexpr size_t max_spare_bufs = 16;
+        private:
+            Socket socket_;
+
+            // each buffer holds the length prefix and packet,
+            // everything queued goes out in a single gathered write
+            std::deque<std::vector<uint8_t>> write_queue_;
+            std::vector<std::vector<uint8_t>> spare_bufs_;
+            size_t writing_; // buffers at the front of the queue being written
+            size_t write_offset_; // into the front buffer, after a partial write
+        public:
+            // fired once the read loop ends
+            signal<io::yield_ctx&> closed;
+
+            // count_down as in connection
+            stream_connection(io::io_context& ioc, Socket&& socket, bool count_down)
+                : connection(ioc, count_down), socket_(std::move(socket)),
+                  write_queue_(), spare_bufs_(), writing_(0), write_offset_(0) {}
+
+            Socket& get_socket() { return socket_; }
+            bool is_open() const { return socket_.is_open(); }
+
+            void send(api::Packet&& p) override {
+                if (!socket_.is_open()) return;
+                std::vector<uint8_t> buf;
+                if (!spare_bufs_.empty()) {
+                    buf = std::move(spare_bufs_.back());
+                    spare_bufs_.pop_back();
+                }
+                uint32_t len = (uint32_t) p.ByteSizeLong();
+                buf.resize(4 + len);
+                buf[0] = len & 0xFF;
+                buf[1] = (len >> 8) & 0xFF;
+                buf[2] = (len >> 16) & 0xFF;
+                buf[3] = (len >> 24) & 0xFF;
+                p.SerializeWithCachedSizesToArray(buf.data() + 4);
+
+                write_queue_.emplace_back(std::move(buf));
+                if (writing_ > 0) return;
+                do_write_next();
+            }
+
+            void close() {
+                boost::system::error_code ec;
+                socket_.close(ec);
+            }
+
+            // starts the read loop
+            void start() {
+                auto s = this->shared_from_this();
+                io::spawn(socket_.get_executor(), [s] (io::yield_context yield) {
+                    io::yield_ctx cyield(yield);
+                    s->read_loop(cyield);
+                    s->closed(cyield);
+                });
+            }
+        private:
+            void read_loop(io::yield_ctx& cyield) {
+                // reads can carry several packets (or part of one),
+                // complete packets are parsed in place from the buffer
+                boost::beast::flat_buffer read_buf;
+
+                std::array<char, arena_block_size> initial_block;
+                google::protobuf::ArenaOptions opts;
+                opts.initial_block = initial_block.data();
+                opts.initial_block_size = initial_block.size();
+                google::protobuf::Arena arena(opts);
+
+                while (true) {
+                    boost::system::error_code ec;
+                    size_t n = socket_.async_read_some(
+                            read_buf.prepare(read_chunk_size), cyield.ctx[ec]);
+                    if (ec && ec != io::error::eof
+                           && ec != io::error::connection_reset
+                           && ec != io::error::operation_aborted
+                           && ec != io::error::bad_descriptor) {
+                        std::cerr << "error: " << ec.message() << " " << ec << std::endl;
+                    }
+                    if (ec) return;
+                    read_buf.commit(n);
+
+                    while (read_buf.size() >= 4) {
+                        auto data = static_cast<const uint8_t*>(read_buf.data().data());
+                        uint32_t len = (uint32_t) data[0] | ((uint32_t) data[1] << 8) |
+                                       ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+                        if (len > max_packet_size) {
+                            std::cerr << "error: oversized packet, closing" << std::endl;
+                            close();
+                            return;
+                        }
+                        if (read_buf.size() < 4 + (size_t) len) break;
+
+                        api::Packet* read_packet =
+                            google::protobuf::Arena::CreateMessage<api::Packet>(&arena);
+                        bool parsed = read_packet->ParseFromArray(data + 4, (int) len);
+                        read_buf.consume(4 + len);
+                        if (parsed) received(cyield, *read_packet);
+                        if (arena.SpaceUsed() > arena_block_size) arena.Reset();
+                    }
+                }
+            }
+
+            void do_write_next() {
+                if (write_queue_.empty()) return;
+                std::vector<io::const_buffer> bufs;
+                bufs.reserve(write_queue_.size());
+                for (const auto& b : write_queue_) bufs.push_back(io::buffer(b));
+                bufs.front() += write_offset_;
+                writing_ = write_queue_.size();
+
+                auto shared = this->shared_from_this();
+                if (uring* r = uring::get(socket_.get_executor().context())) {
+                    // goes out in the same submission as the
+                    // writes of the other connections
+                    r->write_some(socket_.native_handle(), bufs,
+                        [shared] (const boost::system::error_code& ec, size_t transferred) {
+                            io::dispatch(shared->socket_.get_executor(), [shared, ec, transferred] () {
+                                shared->on_written(ec, transferred);
+                            });
+                        });
+                    return;
+                }
+                io::async_write(socket_, bufs,
+                    [shared] (const boost::system::error_code& ec, size_t transferred) {
+                        shared->on_written(ec, transferred);
+                    });
+            }
+
+            void on_written(const boost::system::error_code& ec, size_t transferred) {
+                auto& q = write_queue_;
+                transferred += write_offset_;
+                while (writing_ > 0 && transferred >= q.front().size()) {
+                    transferred -= q.front().size();
+                    if (spare_bufs_.size() < max_spare_bufs) {
+                        spare_bufs_.emplace_back(std::move(q.front()));
+                    }
+                    q.pop_front();
+                    writing_--;
+                }
+                write_offset_ = writing_ > 0 ? transferred : 0;
+                writing_ = 0;
+                if (ec) return;
+                do_write_next();
+            }
+        };
+}
+
+#endif
@@ -0,0 +1,414 @@
+#include "uring.hpp"
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef TELEGRAPH_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace telegraph {
+    io::execution_context::id uring::id;
+
+    // user_data of the poll in front of an operation
+    static constexpr uint64_t poll_tag = 1ull << 63;
+
+    uring::buffer::buffer(uring* r, unsigned index, uint8_t* data)
+        : alive_(r->alive_), ring_(r), index_(index), data_(data) {}
+
+    uring::buffer::~buffer() {
+        if (alive_.lock()) ring_->free_buffers_.push_back(index_);
+    }
+
+    uring::uring(io::execution_context& ctx)
+        : io::execution_context::service(ctx),
+          fd_(-1), event_fd_(-1), fixed_(false), flush_posted_(false),
+          ioc_(nullptr), events_(), event_count_(0), alive_(),
+          sq_ring_(nullptr), sq_ring_size_(0), cq_ring_(nullptr), cq_ring_size_(0),
+          sqes_(nullptr), sqes_size_(0),
+          sq_head_(nullptr), sq_tail_(nullptr), sq_flags_(nullptr), sq_mask_(0), sq_entries_(0),
+          sq_array_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0),
+          cqes_(nullptr), queued_(0), backlog_(), next_op_(1), ops_(),
+          buffers_(), free_buffers_() {}
+
+    bool
+    uring::enable(io::io_context& ioc, unsigned entries) {
+        auto& r = io::use_service<uring>(static_cast<io::execution_context&>(ioc));
+        return r.alive_ || r.start(ioc, entries);
+    }
+
+    uring*
+    uring::get(io::execution_context& ctx) {
+        if (!io::has_service<uring>(ctx)) return nullptr;
+        auto& r = io::use_service<uring>(ctx);
+        return r.alive_ ? &r : nullptr;
+    }
+
+    uring::buffer_ptr
+    uring::acquire_buffer() {
+        if (free_buffers_.empty()) return nullptr;
+        unsigned i = free_buffers_.back();
+        free_buffers_.pop_back();
+        return std::make_shared<buffer>(this, i, buffers_.get() + i*buffer_size);
+    }
+
+#ifdef TELEGRAPH_HAS_IO_URING
+    static int sys_setup(unsigned entries, io_uring_params* p) {
+        return (int) syscall(__NR_io_uring_setup, entries, p);
+    }
+    static int sys_enter(int fd, unsigned submit, unsigned complete, unsigned flags) {
+        return (int) syscall(__NR_io_uring_enter, fd, submit, complete, flags, nullptr, 0);
+    }
+    static int sys_register(int fd, unsigned opcode, const void* arg, unsigned n) {
+        return (int) syscall(__NR_io_uring_register, fd, opcode, arg, n);
+    }
+
+    bool
+    uring::start(io::io_context& ioc, unsigned entries) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int fd = sys_setup(entries, &p);
+        if (fd < 0) return false;
+
+        sq_ring_size_ = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+        cq_ring_size_ = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        sqes_size_ = p.sq_entries*sizeof(io_uring_sqe);
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_ring_ = single ? sq_ring_ :
+                   mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED ||
+                efd < 0 || sys_register(fd, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+            if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+            if (cq_ring_ != MAP_FAILED && !single) munmap(cq_ring_, cq_ring_size_);
+            if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+            sq_ring_ = cq_ring_ = sqes_ = nullptr;
+            if (efd >= 0) ::close(efd);
+            ::close(fd);
+            return false;
+        }
+        fd_ = fd;
+        event_fd_ = efd;
+
+        auto* sq = static_cast<uint8_t*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_flags_ = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_entries_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        auto* cq = static_cast<uint8_t*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = cq + p.cq_off.cqes;
+
+        // the read buffers, plain reads if they can't be registered
+        buffers_.reset(new uint8_t[num_buffers*buffer_size]);
+        std::vector<iovec> iovs(num_buffers);
+        for (unsigned i = 0; i < num_buffers; i++) {
+            iovs[i].iov_base = buffers_.get() + i*buffer_size;
+            iovs[i].iov_len = buffer_size;
+            free_buffers_.push_back(num_buffers - 1 - i);
+        }
+        fixed_ = sys_register(fd_, IORING_REGISTER_BUFFERS, iovs.data(), num_buffers) == 0;
+        if (!fixed_) {
+            std::cerr << "unable to register io_uring buffers: "
+                      << std::strerror(errno) << std::endl;
+        }
+
+        ioc_ = &ioc;
+        events_ = std::make_unique<io::posix::stream_descriptor>(ioc, event_fd_);
+        alive_ = std::make_shared<bool>(true);
+        wait_events();
+        return true;
+    }
+
+    uring::~uring() {
+        events_.reset(); // closes the eventfd
+        if (fd_ >= 0) {
+            if (sqes_) munmap(sqes_, sqes_size_);
+            if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+            if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+            // cancels anything still in flight
+            ::close(fd_);
+        }
+    }
+
+    void
+    uring::shutdown() {
+        alive_.reset();
+        ops_.clear();
+        backlog_.clear();
+        if (events_) {
+            boost::system::error_code ec;
+            events_->close(ec);
+        }
+    }
+
+    uint64_t
+    uring::read_some(int fd, const buffer_ptr& b, handler h) {
+        op o{std::move(h), b, fd, POLLIN,
+             (uint8_t) (fixed_ ? IORING_OP_READ_FIXED : IORING_OP_READ),
+             (uint64_t) b->data(), (uint32_t) b->size(), fixed_ ? (int) b->index_ : -1, false};
+        return start_op(std::move(o));
+    }
+
+    uint64_t
+    uring::write_some(int fd, const std::vector<io::const_buffer>& bufs, handler h) {
+        auto iovs = std::make_shared<std::vector<iovec>>(bufs.size());
+        for (size_t i = 0; i < bufs.size(); i++) {
+            (*iovs)[i].iov_base = const_cast<void*>(bufs[i].data());
+            (*iovs)[i].iov_len = bufs[i].size();
+        }
+        op o{std::move(h), nullptr, fd, POLLOUT, (uint8_t) IORING_OP_WRITEV,
+             (uint64_t) iovs->data(), (uint32_t) iovs->size(), -1, false};
+        o.keep = std::move(iovs);
+        return start_op(std::move(o));
+    }
+
+    uint64_t
+    uring::start_op(op&& o) {
+        uint64_t id = next_op_++;
+        ops_.emplace(id, std::move(o));
+        submit(id);
+        return id;
+    }
+
+    void
+    uring::submit(uint64_t id) {
+        // entries wait here while the submission queue is full,
+        // in order, so a cancel never overtakes its operation
+        backlog_.push_back(entry{id, false});
+        fill();
+        post_flush();
+    }
+
+    void
+    uring::cancel(uint64_t id) {
+        if (!alive_) return;
+        auto it = ops_.find(id);
+        if (it == ops_.end()) return;
+        it->second.cancelled = true;
+
+        // never reached the kernel, so nothing to cancel there
+        auto b = std::find_if(backlog_.begin(), backlog_.end(),
+                    [id] (const entry& e) { return e.id == id && !e.cancel; });
+        if (b != backlog_.end()) {
+            backlog_.erase(b);
+            handler h = std::move(it->second.h);
+            ops_.erase(it);
+            io::post(*ioc_, [h = std::move(h)] () { h(io::error::operation_aborted, 0); });
+            return;
+        }
+        backlog_.push_back(entry{id, true});
+        fill();
+        post_flush();
+    }
+
+    bool
+    uring::push(const entry& e) {
+        // both entries have to fit, since the poll is linked
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        unsigned tail = *sq_tail_;
+        if (tail - head + 2 > sq_entries_) return false;
+        auto* sqes = static_cast<io_uring_sqe*>(sqes_);
+        unsigned i = tail & sq_mask_;
+        unsigned j = (tail + 1) & sq_mask_;
+        io_uring_sqe* a = &sqes[i];
+        io_uring_sqe* b = &sqes[j];
+        std::memset(a, 0, sizeof(*a));
+        std::memset(b, 0, sizeof(*b));
+
+        if (e.cancel) {
+            // cancelling the poll fails the linked operation too,
+            // unless it has already started
+            for (io_uring_sqe* s : {a, b}) {
+                s->opcode = IORING_OP_ASYNC_CANCEL;
+                s->fd = -1;
+                s->user_data = 0;
+            }
+            a->addr = e.id | poll_tag;
+            b->addr = e.id;
+        } else {
+            auto it = ops_.find(e.id);
+            if (it == ops_.end()) return true; // already done with
+            const op& o = it->second;
+            // the descriptors are non-blocking, so wait until they
+            // are ready rather than have the operation fail with EAGAIN
+            a->opcode = IORING_OP_POLL_ADD;
+            a->fd = o.fd;
+            a->poll_events = o.events;
+            a->flags = IOSQE_IO_LINK;
+            a->user_data = e.id | poll_tag;
+
+            b->opcode = o.opcode;
+            b->fd = o.fd;
+            b->addr = o.addr;
+            b->len = o.len;
+            if (o.buf_index >= 0) b->buf_index = (uint16_t) o.buf_index;
+            b->user_data = e.id;
+        }
+        sq_array_[i] = i;
+        sq_array_[j] = j;
+        __atomic_store_n(sq_tail_, tail + 2, __ATOMIC_RELEASE);
+        queued_ += 2;
+        return true;
+    }
+
+    void
+    uring::fill() {
+        while (!backlog_.empty() && push(backlog_.front())) backlog_.pop_front();
+    }
+
+    void
+    uring::post_flush() {
+        // everything queued while handling the
+        // current event is submitted together
+        if (flush_posted_) return;
+        flush_posted_ = true;
+        std::weak_ptr<bool> alive{alive_};
+        io::post(*ioc_, [this, alive] () {
+            if (!alive.lock()) return;
+            flush_posted_ = false;
+            flush();
+        });
+    }
+
+    void
+    uring::flush() {
+        for (;;) {
+            fill();
+            if (!queued_) return;
+            int r = sys_enter(fd_, queued_, 0, 0);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EBUSY) {
+                    // the completion queue is backed up, try
+                    // again once the completions are reaped
+                    reap();
+                    post_flush();
+                } else {
+                    fail_unsubmitted(boost::system::error_code(errno,
+                                        boost::system::system_category()));
+                }
+                return;
+            }
+            queued_ -= std::min<unsigned>(queued_, (unsigned) r);
+            if (r == 0) return;
+        }
+    }
+
+    void
+    uring::fail_unsubmitted(const boost::system::error_code& ec) {
+        // take back what the kernel hasn't consumed, it only
+        // reads the submission queue from within io_uring_enter
+        std::vector<uint64_t> failed;
+        auto* sqes = static_cast<io_uring_sqe*>(sqes_);
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        for (unsigned t = head; t != *sq_tail_; t++) {
+            const io_uring_sqe& s = sqes[sq_array_[t & sq_mask_]];
+            if (s.opcode != IORING_OP_ASYNC_CANCEL && s.user_data && !(s.user_data & poll_tag)) {
+                failed.push_back(s.user_data);
+            }
+        }
+        __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+        queued_ = 0;
+        for (const entry& e : backlog_) {
+            if (!e.cancel) failed.push_back(e.id);
+        }
+        backlog_.clear();
+
+        for (uint64_t id : failed) {
+            auto it = ops_.find(id);
+            if (it == ops_.end()) continue;
+            op o = std::move(it->second);
+            ops_.erase(it);
+            o.h(o.cancelled ? boost::system::error_code(io::error::operation_aborted) : ec, 0);
+        }
+    }
+
+    void
+    uring::wait_events() {
+        std::weak_ptr<bool> alive{alive_};
+        events_->async_read_some(io::buffer(&event_count_, sizeof(event_count_)),
+            [this, alive] (const boost::system::error_code& ec, size_t) {
+                if (!alive.lock() || ec == io::error::operation_aborted) return;
+                reap();
+                wait_events();
+            });
+    }
+
+    void
+    uring::reap() {
+        // copy the completions out first, handlers will submit more
+        std::vector<std::pair<uint64_t, int>> done;
+        auto* cqes = static_cast<io_uring_cqe*>(cqes_);
+        for (;;) {
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                const io_uring_cqe& c = cqes[head & cq_mask_];
+                done.emplace_back(c.user_data, c.res);
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            // completions which didn't fit are held by the
+            // kernel until asked for, now that there is room
+            if (!(__atomic_load_n(sq_flags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)) break;
+            if (sys_enter(fd_, 0, 0, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) break;
+        }
+
+        for (auto [id, res] : done) {
+            // polls and cancels, the operations report for themselves
+            if (!id || (id & poll_tag)) continue;
+            auto it = ops_.find(id);
+            if (it == ops_.end()) continue;
+            if (res == -EAGAIN && !it->second.cancelled) {
+                submit(id);
+                continue;
+            }
+            op o = std::move(it->second);
+            ops_.erase(it);
+            boost::system::error_code ec;
+            if (res == -ECANCELED || res == -EINTR || o.cancelled) ec = io::error::operation_aborted;
+            else if (res < 0) ec = boost::system::error_code(-res, boost::system::system_category());
+            o.h(ec, res < 0 ? 0 : (size_t) res);
+        }
+    }
+#else
+    // io_uring is linux only
+    bool uring::start(io::io_context&, unsigned) { return false; }
+    uring::~uring() {}
+    void uring::shutdown() {}
+    uint64_t uring::read_some(int, const buffer_ptr&, handler) { return 0; }
+    uint64_t uring::write_some(int, const std::vector<io::const_buffer>&, handler) { return 0; }
+    void uring::cancel(uint64_t) {}
+    uint64_t uring::start_op(op&&) { return 0; }
+    void uring::submit(uint64_t) {}
+    bool uring::push(const entry&) { return false; }
+    void uring::fill() {}
+    void uring::post_flush() {}
+    void uring::flush() {}
+    void uring::fail_unsubmitted(const boost::system::error_code&) {}
+    void uring::wait_events() {}
+    void uring::reap() {}
+#endif
+}
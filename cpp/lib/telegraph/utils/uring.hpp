@@ -0,0 +1,155 @@
+#ifndef __TELEGRAPH_UTILS_URING_HPP__
+#define __TELEGRAPH_UTILS_URING_HPP__
+
+#include "io.hpp"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/execution_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__) && !defined(__ANDROID__) && __has_include(<linux/io_uring.h>)
+#define TELEGRAPH_HAS_IO_URING
+#endif
+
+namespace telegraph {
+    // An opt-in io_uring backend for the serial ports and the plain
+    // stream sockets, enabled once per io_context at startup.
+    // Submissions made while handling one event go out together in
+    // a single io_uring_enter, completions are signalled through an
+    // eventfd on the io_context. Reads go into buffers registered with
+    // the kernel up front, so they aren't mapped in on every read.
+    class uring : public io::execution_context::service {
+    public:
+        using handler = std::function<void(const boost::system::error_code&, size_t)>;
+
+        // registered read buffers
+        static constexpr size_t buffer_size = 4096;
+        static constexpr unsigned num_buffers = 64;
+
+        // a registered buffer, returned to the ring once released
+        // (ops in flight keep their buffer alive)
+        class buffer {
+            friend class uring;
+        private:
+            std::weak_ptr<bool> alive_;
+            uring* ring_;
+            unsigned index_;
+            uint8_t* data_;
+        public:
+            buffer(uring* r, unsigned index, uint8_t* data);
+            ~buffer();
+
+            uint8_t* data() const { return data_; }
+            constexpr size_t size() const { return buffer_size; }
+        };
+        using buffer_ptr = std::shared_ptr<buffer>;
+
+        static io::execution_context::id id;
+
+        explicit uring(io::execution_context& ctx);
+        ~uring();
+
+        // sets up a ring for the io_context, false if
+        // io_uring is not available (the default backend is kept)
+        static bool enable(io::io_context& ioc, unsigned entries = 256);
+        // the ring of the context, null unless enabled
+        static uring* get(io::execution_context& ctx);
+
+        // whether reads go into registered buffers, this fails
+        // when the locked memory limit is too low
+        constexpr bool has_fixed_buffers() const { return fixed_; }
+
+        // null if all the buffers are in use
+        buffer_ptr acquire_buffer();
+
+        // reads some bytes into the buffer once the descriptor is readable,
+        // returns an id for cancelling
+        uint64_t read_some(int fd, const buffer_ptr& b, handler h);
+        // writes some of the buffers once the descriptor is writable
+        uint64_t write_some(int fd, const std::vector<io::const_buffer>& bufs, handler h);
+        // the handler sees operation_aborted
+        void cancel(uint64_t op);
+    private:
+        struct op {
+            handler h;
+            std::shared_ptr<void> keep; // memory used by the kernel
+            int fd;
+            short events; // polled for before the operation
+            uint8_t opcode;
+            uint64_t addr;
+            uint32_t len;
+            int buf_index; // -1 unless a registered buffer
+            bool cancelled;
+        };
+
+        bool start(io::io_context& ioc, unsigned entries);
+        void shutdown() override;
+
+        // an operation, or the cancelling of one, waiting for room
+        struct entry {
+            uint64_t id;
+            bool cancel;
+        };
+
+        uint64_t start_op(op&& o);
+        // queues the poll with the operation linked behind it
+        void submit(uint64_t id);
+        // false if the submission queue is full
+        bool push(const entry& e);
+        // moves the backlog into the submission queue
+        void fill();
+        void post_flush();
+        void flush();
+        // on a submit error the operations which didn't reach the kernel fail
+        void fail_unsubmitted(const boost::system::error_code& ec);
+        void wait_events();
+        void reap();
+
+        int fd_;
+        int event_fd_;
+        bool fixed_;
+        bool flush_posted_;
+        io::io_context* ioc_;
+        std::unique_ptr<io::posix::stream_descriptor> events_;
+        uint64_t event_count_;
+        std::shared_ptr<bool> alive_;
+
+        // mapped rings
+        void* sq_ring_;
+        size_t sq_ring_size_;
+        void* cq_ring_;
+        size_t cq_ring_size_;
+        void* sqes_;
+        size_t sqes_size_;
+
+        unsigned* sq_head_;
+        unsigned* sq_tail_;
+        unsigned* sq_flags_;
+        unsigned sq_mask_;
+        unsigned sq_entries_;
+        unsigned* sq_array_;
+        unsigned* cq_head_;
+        unsigned* cq_tail_;
+        unsigned cq_mask_;
+        void* cqes_;
+
+        unsigned queued_; // entries not yet submitted
+        std::deque<entry> backlog_;
+
+        uint64_t next_op_;
+        std::unordered_map<uint64_t, op> ops_;
+
+        std::unique_ptr<uint8_t[]> buffers_;
+        std::vector<unsigned> free_buffers_;
+    };
+}
+
+#endif
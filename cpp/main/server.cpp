@@ -1,11 +1,16 @@
 #include <telegraph/local/namespace.hpp>
 #include <telegraph/local/device.hpp>
 #include <telegraph/local/dummy_device.hpp>
+#include <telegraph/local/load_generator.hpp>
 #include <telegraph/local/container.hpp>
+#include <telegraph/local/derived.hpp>
+#include <telegraph/local/relay.hpp>
 #include <telegraph/remote/server.hpp>
+#include <telegraph/utils/uring.hpp>
 
 #include <iostream>
 #include <filesystem>
+#include <string>
 
 #include <boost/asio/io_context.hpp>
 
@@ -22,18 +27,47 @@ int main(int argc, char** argv) {
     std::shared_ptr<local_namespace> ns = std::make_shared<local_namespace>(ctx);
     ns->register_factory("device_scanner", device_scanner::create);
     ns->register_factory("device", device::create);
+    ns->register_factory("device_replay", device_replay::create);
     ns->register_factory("dummy_device", dummy_device::create);
+    ns->register_factory("load_generator", load_generator::create);
     ns->register_factory("container", container::create);
+    ns->register_factory("derived", derived::create);
+    ns->register_factory("relay", relay::create);
 
     // start a server on the relay
     // this will enqueue callbacks on the io context
     auto const address = net::ip::make_address("0.0.0.0");
     const unsigned short port = 8081;
 
+    // websocket on 8081, plus optionally
+    //  --tcp <port>: length-prefixed packets over tcp
+    //  --unix <path>: length-prefixed packets over a unix socket
+    //  --io-uring: serial ports and tcp/unix sockets go through io_uring (linux)
+    //  --shm-records <n>: most records in a unix socket client's shared-memory ring
+    server::options opts;
+    opts.websocket = tcp::endpoint{address, port};
+    for (int i = 1; i < argc; i++) {
+        std::string arg{argv[i]};
+        if (arg == "--io-uring") {
+            if (!uring::enable(ctx)) {
+                std::cerr << "io_uring is not available, using the default backend" << std::endl;
+            }
+        } else if (arg == "--tcp" && i + 1 < argc) {
+            opts.tcp = tcp::endpoint{address, (unsigned short) std::stoi(argv[++i])};
+        } else if (arg == "--unix" && i + 1 < argc) {
+            opts.unix_path = argv[++i];
+        } else if (arg == "--shm-records" && i + 1 < argc) {
+            opts.max_shm_records = (uint32_t) std::stoul(argv[++i]);
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
     io::spawn(ctx,
         [&](io::yield_context yield) {
             io::yield_ctx c(yield);
-            server s(ctx, tcp::endpoint{address,port}, ns);
+            server s(ctx, opts, ns);
             s.run(c);
         });
 
@@ -0,0 +1,368 @@
+#include <telegraph/local/compressed_series.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace telegraph;
+
+using point = std::pair<int64_t, value>;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// bit for bit, so NaNs and -0.0 compare as well
+static bool same(const value& a, const value& b) {
+    if (a.get_type_class() != b.get_type_class()) return false;
+    switch (a.get_type_class()) {
+    case value_type::None: return true;
+    case value_type::Bool: return a.get<bool>() == b.get<bool>();
+    case value_type::Enum:
+    case value_type::Uint8: return a.get<uint8_t>() == b.get<uint8_t>();
+    case value_type::Uint16: return a.get<uint16_t>() == b.get<uint16_t>();
+    case value_type::Uint32: return a.get<uint32_t>() == b.get<uint32_t>();
+    case value_type::Uint64: return a.get<uint64_t>() == b.get<uint64_t>();
+    case value_type::Int8: return a.get<int8_t>() == b.get<int8_t>();
+    case value_type::Int16: return a.get<int16_t>() == b.get<int16_t>();
+    case value_type::Int32: return a.get<int32_t>() == b.get<int32_t>();
+    case value_type::Int64: return a.get<int64_t>() == b.get<int64_t>();
+    case value_type::Float: {
+        float x = a.get<float>(), y = b.get<float>();
+        return std::memcmp(&x, &y, sizeof(x)) == 0;
+    }
+    case value_type::Double: {
+        double x = a.get<double>(), y = b.get<double>();
+        return std::memcmp(&x, &y, sizeof(x)) == 0;
+    }
+    default: return false;
+    }
+}
+
+static void expect_equal(const std::vector<point>& got,
+                         const std::vector<point>& want, const std::string& what) {
+    if (got.size() != want.size()) {
+        check(false, what + ": " + std::to_string(got.size()) +
+                        " datapoints instead of " + std::to_string(want.size()));
+        return;
+    }
+    for (size_t i = 0; i < got.size(); i++) {
+        if (got[i].first != want[i].first || !same(got[i].second, want[i].second)) {
+            check(false, what + ": datapoint " + std::to_string(i) + " differs");
+            return;
+        }
+    }
+}
+
+static void add(std::vector<point>& out, const datapoint_batch& b) {
+    for (size_t i = 0; i < b.size(); i++) out.emplace_back(b.micros(i), b.value_at(i));
+}
+
+static std::vector<point> scanned(const compressed_series& s) {
+    std::vector<point> r;
+    s.scan([&r] (const datapoint_batch& b) { add(r, b); });
+    return r;
+}
+
+static std::vector<point> read_all(data_cursor& c, size_t n, const std::string& what) {
+    std::vector<point> r;
+    datapoint_batch b;
+    for (;;) {
+        c.next(n, b);
+        if (b.empty()) break;
+        check(b.size() <= n, what + ": batch larger than asked for");
+        for (size_t i = 1; i < b.size(); i++) {
+            check(b.value_at(i).get_type_class() == b.value_at(0).get_type_class(),
+                    what + ": batch mixes types");
+        }
+        add(r, b);
+    }
+    return r;
+}
+
+// encodes the points, then checks that scan() and
+// cursors reading in various batch sizes return them exactly
+static void round_trip(const std::vector<point>& pts, const std::string& what) {
+    compressed_series s;
+    for (const auto& p : pts) s.append(p.first, p.second);
+    check(s.size() == pts.size(), what + ": size");
+    expect_equal(scanned(s), pts, what + " (scan)");
+    for (size_t n : {1, 7, 1000, 5000}) {
+        auto c = s.cursor();
+        expect_equal(read_all(*c, n, what), pts, what + " (cursor of " + std::to_string(n) + ")");
+    }
+}
+
+template<typename T>
+    static value random_int(std::mt19937_64& rng) {
+        // mostly small steps, sometimes anything at all
+        static T last = 0;
+        switch (rng() % 4) {
+        case 0: last = (T) rng(); break;
+        case 1: last = (T) ((uint64_t) last + rng() % 5); break; // wrapping
+        case 2: last = (rng() % 2) ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max(); break;
+        default: break;
+        }
+        return value{last};
+    }
+
+static value random_value(value_type::type_class t, std::mt19937_64& rng) {
+    switch (t) {
+    case value_type::None: return value{};
+    case value_type::Bool: return value{(rng() % 3) == 0};
+    case value_type::Enum: return value{value_type::Enum, (uint8_t) (rng() % 4)};
+    case value_type::Uint8: return random_int<uint8_t>(rng);
+    case value_type::Uint16: return random_int<uint16_t>(rng);
+    case value_type::Uint32: return random_int<uint32_t>(rng);
+    case value_type::Uint64: return random_int<uint64_t>(rng);
+    case value_type::Int8: return random_int<int8_t>(rng);
+    case value_type::Int16: return random_int<int16_t>(rng);
+    case value_type::Int32: return random_int<int32_t>(rng);
+    case value_type::Int64: return random_int<int64_t>(rng);
+    case value_type::Float: {
+        static float last = 1.0f;
+        switch (rng() % 6) {
+        case 0: { // any bit pattern, NaNs included
+            uint32_t u = (uint32_t) rng();
+            std::memcpy(&last, &u, sizeof(u));
+        } break;
+        case 1: last = std::nextafter(last, 2*last + 1); break;
+        case 2: last = (float) (rng() % 1000) / 8; break;
+        case 3: last = (rng() % 2) ? -0.0f : std::numeric_limits<float>::infinity(); break;
+        default: break;
+        }
+        return value{last};
+    }
+    case value_type::Double: {
+        static double last = 1.0;
+        switch (rng() % 6) {
+        case 0: {
+            uint64_t u = rng();
+            std::memcpy(&last, &u, sizeof(u));
+        } break;
+        case 1: last = std::nextafter(last, 2*last + 1); break;
+        case 2: last = (double) (rng() % 1000) / 8; break;
+        case 3: last = (rng() % 2) ? -0.0 : std::numeric_limits<double>::denorm_min(); break;
+        default: break;
+        }
+        return value{last};
+    }
+    default: return value{};
+    }
+}
+
+static int64_t random_time(int64_t last, std::mt19937_64& rng) {
+    switch (rng() % 8) {
+    case 0: return (int64_t) rng(); // jumps of any size, either way
+    // wrapping, like the encoder
+    case 1: return (int64_t) ((uint64_t) last - rng() % 1000);
+    case 2: return (int64_t) ((uint64_t) last + rng() % (1 << 20));
+    default: return (int64_t) ((uint64_t) last + 1000); // steady, delta-of-delta 0
+    }
+}
+
+static const value_type::type_class scalar_types[] = {
+    value_type::None, value_type::Bool, value_type::Enum,
+    value_type::Uint8, value_type::Uint16, value_type::Uint32, value_type::Uint64,
+    value_type::Int8, value_type::Int16, value_type::Int32, value_type::Int64,
+    value_type::Float, value_type::Double
+};
+
+static void test_random() {
+    std::mt19937_64 rng{42};
+    for (auto t : scalar_types) {
+        std::vector<point> pts;
+        int64_t time = 1700000000000000;
+        // several chunks, the last one partial
+        for (size_t i = 0; i < 3*compressed_series::chunk_points + 17; i++) {
+            time = random_time(time, rng);
+            pts.emplace_back(time, random_value(t, rng));
+        }
+        round_trip(pts, "random type " + std::to_string((int) t));
+    }
+}
+
+static void test_extremes() {
+    const int64_t lo = std::numeric_limits<int64_t>::min();
+    const int64_t hi = std::numeric_limits<int64_t>::max();
+    // deltas and delta-of-deltas which overflow, both in the
+    // timestamps and the integer values
+    std::vector<point> pts;
+    const int64_t times[] = {0, hi, lo, hi, hi, lo, 0, -1, 1, lo, lo};
+    const int64_t vals[] = {lo, hi, lo, 0, hi, hi, -1, lo, 1, hi, lo};
+    for (size_t i = 0; i < 11; i++) pts.emplace_back(times[i], value{vals[i]});
+    round_trip(pts, "int64 extremes");
+
+    std::vector<point> u;
+    const uint64_t uvals[] = {0, ~0ull, 0, 1ull << 63, (1ull << 63) - 1, ~0ull, ~0ull, 0};
+    for (size_t i = 0; i < 8; i++) u.emplace_back(times[i], value{uvals[i]});
+    round_trip(u, "uint64 extremes");
+}
+
+static void test_word_boundaries() {
+    // a 1-bit entry followed by 64-bit ones shifts every
+    // following put across a word boundary, at each offset
+    for (int shift = 0; shift < 64; shift++) {
+        std::vector<point> pts;
+        int64_t time = 0;
+        int64_t v = 0;
+        for (int i = 0; i < shift; i++) {
+            time += 10;
+            pts.emplace_back(time, value{v}); // a 1-bit time and value
+        }
+        for (int i = 0; i < 8; i++) {
+            // 64-bit delta-of-delta, wrapping
+            time = (int64_t) ((uint64_t) time + ((i % 2) ? (1ull << 62) : -(1ull << 61)));
+            v ^= (int64_t) (0xa5a5a5a5a5a5a5a5ull >> i); // 64-bit zigzag delta
+            pts.emplace_back(time, value{v});
+        }
+        round_trip(pts, "word boundary at " + std::to_string(shift));
+    }
+}
+
+static void test_xor_windows() {
+    // a wide window first, then values which fit in it (reused),
+    // then ones which need a new, narrower or shifted window
+    std::vector<point> pts;
+    const uint64_t bits[] = {
+        0x3ff0000000000000ull, 0x3ff00000000fffffull, 0x3ff0000000000001ull,
+        0x3ff0000000000010ull, 0x3ff0000000000010ull, 0xbff0000000000010ull,
+        0x3ff0000000000011ull, 0x7ff8000000000001ull, 0x0000000000000001ull,
+        0x8000000000000000ull, 0x8000000000000001ull, 0x0000000000000000ull
+    };
+    int64_t time = 0;
+    for (uint64_t b : bits) {
+        double d;
+        std::memcpy(&d, &b, sizeof(d));
+        pts.emplace_back(time += 1000, value{d});
+    }
+    round_trip(pts, "double xor windows");
+
+    std::vector<point> f;
+    const uint32_t fbits[] = {
+        0x3f800000u, 0x3f80ffffu, 0x3f800001u, 0x3f800100u, 0xbf800100u,
+        0x7fc00001u, 0x00000001u, 0x80000000u, 0xffffffffu, 0x00000000u
+    };
+    for (uint32_t b : fbits) {
+        float x;
+        std::memcpy(&x, &b, sizeof(x));
+        f.emplace_back(time += 1000, value{x});
+    }
+    round_trip(f, "float xor windows");
+}
+
+static void test_type_changes() {
+    // every type change starts a new chunk, batches
+    // from the cursor must still be of one type
+    std::mt19937_64 rng{7};
+    std::vector<point> pts;
+    int64_t time = 0;
+    size_t ntypes = sizeof(scalar_types)/sizeof(scalar_types[0]);
+    for (int run = 0; run < 200; run++) {
+        auto t = scalar_types[rng() % ntypes];
+        size_t len = 1 + rng() % 20;
+        if (run % 50 == 0) len = compressed_series::chunk_points + 3;
+        for (size_t i = 0; i < len; i++) {
+            time = random_time(time, rng);
+            pts.emplace_back(time, random_value(t, rng));
+        }
+    }
+    round_trip(pts, "type changes");
+}
+
+static void test_append_while_reading() {
+    compressed_series s;
+    std::vector<point> pts;
+    auto c = s.cursor();
+    std::vector<point> got;
+    std::mt19937_64 rng{3};
+    int64_t time = 0;
+    for (int round = 0; round < 50; round++) {
+        size_t n = rng() % 100;
+        for (size_t i = 0; i < n; i++) {
+            time += 1000;
+            value v{(int32_t) (rng() % 100)};
+            s.append(time, v);
+            pts.emplace_back(time, v);
+        }
+        auto part = read_all(*c, 1 + rng() % 64, "append while reading");
+        got.insert(got.end(), part.begin(), part.end());
+    }
+    expect_equal(got, pts, "append while reading");
+}
+
+static void test_drop_before() {
+    const size_t cp = compressed_series::chunk_points;
+    compressed_series s;
+    std::vector<point> pts;
+    for (size_t i = 0; i < 6*cp; i++) {
+        pts.emplace_back((int64_t) i, value{(double) i / 3});
+        s.append(pts.back().first, pts.back().second);
+    }
+
+    // a reader in the middle of a chunk which is then dropped
+    // continues at the first chunk still there
+    auto behind = s.cursor();
+    datapoint_batch b;
+    behind->next(cp/2, b);
+    // a reader past the dropped chunks isn't affected
+    auto ahead = s.cursor();
+    size_t ahead_read = 0;
+    while (ahead_read < 3*cp + 5) {
+        ahead->next(std::min(cp, 3*cp + 5 - ahead_read), b);
+        ahead_read += b.size();
+    }
+
+    s.drop_before((int64_t) (2*cp)); // the first two chunks
+    check(s.size() == 4*cp, "drop_before: size");
+    std::vector<point> kept(pts.begin() + 2*cp, pts.end());
+    expect_equal(scanned(s), kept, "drop_before (scan)");
+    expect_equal(read_all(*behind, 100, "drop_before"), kept, "drop_before (reader behind)");
+    expect_equal(read_all(*ahead, 100, "drop_before"),
+                 std::vector<point>(pts.begin() + 3*cp + 5, pts.end()), "drop_before (reader ahead)");
+    expect_equal(read_all(*s.cursor(), 100, "drop_before"), kept, "drop_before (new reader)");
+
+    // dropping right up to a partially read chunk
+    auto mid = s.cursor();
+    mid->next(cp + 10, b); // into the second kept chunk
+    s.drop_before((int64_t) (3*cp));
+    std::vector<point> rest(pts.begin() + 3*cp + 10, pts.end());
+    expect_equal(read_all(*mid, 100, "drop_before"), rest, "drop_before (reader in a kept chunk)");
+
+    // and everything, after which appends are still read
+    auto all = s.cursor();
+    s.drop_before(std::numeric_limits<int64_t>::max());
+    check(s.empty(), "drop_before: empty");
+    check(read_all(*all, 100, "drop_before").empty(), "drop_before: nothing left to read");
+    s.append(10*(int64_t) cp, value{1.5});
+    auto after = read_all(*all, 100, "drop_before");
+    check(after.size() == 1 && after[0].first == 10*(int64_t) cp,
+            "drop_before: reading appends after dropping everything");
+}
+
+int main() {
+    test_random();
+    test_extremes();
+    test_word_boundaries();
+    test_xor_windows();
+    test_type_changes();
+    test_append_while_reading();
+    test_drop_before();
+    if (failures) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all passed" << std::endl;
+    return 0;
+}
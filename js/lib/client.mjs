@@ -287,6 +287,30 @@ class RemoteContext extends Context {
     return query;
   }
 
+  // latest cached values for all variables under path,
+  // as a list of {path, t, v}
+  async snapshot(path=[]) {
+    if (!this.ns || !this.ns._conn) throw new Error("Not connected!");
+    var msg = {
+      snapshot: {
+        uuid: this.uuid,
+        path: path
+      }
+    }
+    var res = await this.ns._conn.requestResponse(msg);
+    checkError(res);
+    if (res.payload != 'snapshotData') return null;
+    var tree = await this.fetch();
+    var entries = [];
+    for (let e of (res.snapshotData.entries || [])) {
+      var v = tree ? tree.fromPath(e.path) : null;
+      if (!v || !v.getType) continue;
+      entries.push({path: e.path, t: parseInt(e.value.timestamp),
+                    v: Value.unpack(e.value.value, v.getType())});
+    }
+    return entries;
+  }
+
   async request(params, placeholder=false) {
     if (!this.ns || !this.ns._conn) throw new Error("Not connected!");
     var msg = {
@@ -225,11 +225,13 @@ export class Type {
   static INT64 = new Type('int64', [], 11);
   static FLOAT = new Type('float', [], 12);
   static DOUBLE = new Type('double', [], 13);
+  static BLOCK = new Type('block', [], 14);
 
-  constructor(name = null, labels = [], class_=2) {
+  constructor(name = null, labels = [], class_=2, element=null) {
     this._class = class_;
     this._name = name;
     this._labels = labels;
+    this._element = element; // sample type of a block
   }
 
   get valid() { return this._class != Type.INVALID._class; }
@@ -250,9 +252,12 @@ export class Type {
       case Type.INT64._class:  type = 11; break;
       case Type.FLOAT ._class: type = 12; break;
       case Type.DOUBLE._class: type = 13; break;
+      case Type.BLOCK._class:  type = 14; break;
       default: type = 0; break; // invalid
     }
-    return {name: this._name, type: type, labels: this._labels};
+    var packed = {name: this._name, type: type, labels: this._labels};
+    if (this._element) packed.element = this._element.pack().type;
+    return packed;
   }
 
   static unpack(proto) {
@@ -271,6 +276,8 @@ export class Type {
       case 11: return Type.INT64;
       case 12: return Type.FLOAT;
       case 13: return Type.DOUBLE;
+      case 14: return new Type(proto.name, [], Type.BLOCK._class,
+                               Type.unpack({type: proto.element}));
       default: return Type.INVALID;
     }
   }
@@ -290,11 +297,47 @@ export class Type {
       case Type.INT64._class:  return 'int64';
       case Type.FLOAT._class:  return 'float';
       case Type.DOUBLE._class: return 'double';
+      case Type.BLOCK._class:  return 'block<' + this._element.toString() + '>';
       default: return 'invalid';
     }
   }
 }
 
+// samples are packed little-endian, back to back,
+// enums and bools as one byte like the c++ side
+const BLOCK_ARRAYS = {
+  2: Uint8Array, 3: Uint8Array, 4: Uint8Array, 5: Uint16Array, 6: Uint32Array, 7: BigUint64Array,
+  8: Int8Array, 9: Int16Array, 10: Int32Array, 11: BigInt64Array,
+  12: Float32Array, 13: Float64Array
+};
+
+function unpackBlock(proto) {
+  var Arr = BLOCK_ARRAYS[proto.type];
+  var bytes = proto.data || new Uint8Array(0);
+  var samples = null;
+  if (Arr) {
+    // copy so the samples are aligned
+    var count = Math.min(proto.count || 0, Math.floor(bytes.length / Arr.BYTES_PER_ELEMENT));
+    samples = new Arr(bytes.slice(0, count * Arr.BYTES_PER_ELEMENT).buffer);
+  }
+  return {
+    start: parseInt(proto.start), // microseconds
+    period: proto.period, // microseconds
+    samples: samples
+  };
+}
+
+function packBlock(val, element) {
+  var samples = val.samples || new Uint8Array(0);
+  return {
+    type: element ? element.pack().type : 0,
+    start: val.start,
+    period: val.period,
+    count: samples.length,
+    data: new Uint8Array(samples.buffer, samples.byteOffset, samples.byteLength)
+  };
+}
+
 export var Value = {
   pack(val, type) {
     if (!type) return {};
@@ -309,14 +352,16 @@ export var Value = {
       case Type.UINT32._class: return { u32: val };
       case Type.UINT64._class: return { u64: val };
       case Type.INT8._class:   return { i8: val };
-      case Type.INT16._class:  return { i16: VAL };
+      case Type.INT16._class:  return { i16: val };
       case Type.INT32._class:  return { i32: val };
       case Type.INT64._class:  return { i64: val };
       case Type.FLOAT._class:  return { f: val };
       case Type.DOUBLE._class: return { d: val };
+      case Type.BLOCK._class:  return { block: packBlock(val, type._element) };
     }
   },
   unpack(proto, type) {
+    if (proto.block) return unpackBlock(proto.block);
     if (proto.f) return proto.f;
     if (proto.d) return proto.d;
     if (proto.b) return proto.b;